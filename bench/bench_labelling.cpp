@@ -0,0 +1,117 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include <vigra/timing.hxx>
+#include <vigra/multi_array.hxx>
+#include <vigra/labelimage.hxx>
+#include <vigra/labelvolume.hxx>
+
+#include <bw/runlabelling.h>
+
+//
+// compare the run-based labelling of binary data (bw/runlabelling.h)
+// with vigra's labelImageWithBackground / labelVolumeWithBackground
+//
+// ./bench_labelling
+//
+
+const int repetitions = 5;
+
+/**
+ * 'percent' percent random foreground pixels
+ */
+template<int N>
+void fillNoise(vigra::MultiArrayView<N, vigra::UInt8> a, int percent) {
+    for(int i=0; i<a.size(); ++i) {
+        a[i] = (std::rand() % 100) < percent ? 1 : 0;
+    }
+}
+
+/**
+ * large, smooth foreground objects, as after thresholding a probability map
+ */
+template<int N>
+void fillBlobs(vigra::MultiArrayView<N, vigra::UInt8> a) {
+    for(int i=0; i<a.size(); ++i) {
+        typename vigra::MultiArrayShape<N>::type c = a.scanOrderIndexToCoordinate(i);
+        double v = 0.0;
+        for(int k=0; k<N; ++k) {
+            v += std::sin(c[k] / (7.0+3*k));
+        }
+        a[i] = v > 0.3 ? 1 : 0;
+    }
+}
+
+template<int N>
+vigra::UInt32 labelVigra(const vigra::MultiArrayView<N, vigra::UInt8>& in, vigra::MultiArrayView<N, vigra::UInt32> out);
+
+template<>
+vigra::UInt32 labelVigra<2>(const vigra::MultiArrayView<2, vigra::UInt8>& in, vigra::MultiArrayView<2, vigra::UInt32> out) {
+    return vigra::labelImageWithBackground(in, out, false, (vigra::UInt8)0);
+}
+
+template<>
+vigra::UInt32 labelVigra<3>(const vigra::MultiArrayView<3, vigra::UInt8>& in, vigra::MultiArrayView<3, vigra::UInt32> out) {
+    return vigra::labelVolumeWithBackground(in, out, vigra::NeighborCode3DSix(), (vigra::UInt8)0);
+}
+
+/**
+ * print the best time of both methods (in ms) for labelling 'data'
+ */
+template<int N>
+void bench(const std::string& name, const vigra::MultiArrayView<N, vigra::UInt8>& data) {
+    USETICTOC;
+    vigra::MultiArray<N, vigra::UInt32> out1(data.shape());
+    vigra::MultiArray<N, vigra::UInt32> out2(data.shape());
+    double tVigra = 1e30, tRuns = 1e30;
+    vigra::UInt32 n1 = 0, n2 = 0;
+    for(int i=0; i<repetitions; ++i) {
+        TIC;
+        n1 = labelVigra<N>(data, out1);
+        tVigra = std::min(tVigra, (double)TOCN);
+
+        TIC;
+        n2 = BW::labelRuns(data, out2);
+        tRuns = std::min(tRuns, (double)TOCN);
+    }
+    const bool same = n1 == n2 && std::equal(out1.begin(), out1.end(), out2.begin());
+    std::cout << "  " << std::setw(24) << std::left << name
+              << " : vigra " << std::setw(8) << std::right << std::fixed << std::setprecision(2) << tVigra << " ms"
+              << ", runs " << std::setw(8) << tRuns << " ms"
+              << " (x" << std::setprecision(1) << tVigra/tRuns << ")"
+              << (same ? "" : " RESULTS DIFFER") << std::endl;
+}
+
+int main() {
+    using namespace vigra;
+
+    std::cout << "* 2D, 2048x2048, 4-neighbourhood" << std::endl;
+    {
+        MultiArray<2, UInt8> a(MultiArrayShape<2>::type(2048, 2048));
+        int percent[3] = {10, 50, 90};
+        for(int i=0; i<3; ++i) {
+            fillNoise(a, percent[i]);
+            std::ostringstream name; name << "noise " << percent[i] << "%";
+            bench<2>(name.str(), a);
+        }
+        fillBlobs(a);
+        bench<2>("blobs", a);
+    }
+
+    std::cout << "* 3D, 256^3, 6-neighbourhood" << std::endl;
+    {
+        MultiArray<3, UInt8> a(MultiArrayShape<3>::type(256, 256, 256));
+        int percent[3] = {10, 50, 90};
+        for(int i=0; i<3; ++i) {
+            fillNoise(a, percent[i]);
+            std::ostringstream name; name << "noise " << percent[i] << "%";
+            bench<3>(name.str(), a);
+        }
+        fillBlobs(a);
+        bench<3>("blobs", a);
+    }
+}
@@ -53,6 +53,32 @@ struct PyConnectedComponents {
     typedef ConnectedComponents<N> BCC;
 };
 
+/**
+ * read the labels of the region [p, q) of the connected components result
+ */
+template<int N>
+vigra::NumpyAnyArray readConnectedComponents(const ConnectedComponents<N>& cc,
+                                             typename ConnectedComponents<N>::V p,
+                                             typename ConnectedComponents<N>::V q)
+{
+    vigra::MultiArray<N, vigra::UInt32> block(q-p);
+    cc.readBlock(Roi<N>(p, q), block);
+    vigra::NumpyArray<N, vigra::UInt32> out(block.shape());
+    out = block;
+    return out;
+}
+
+/**
+ * the input has changed within the region [p, q)
+ */
+template<int N>
+void updateConnectedComponents(ConnectedComponents<N>& cc,
+                               typename ConnectedComponents<N>::V p,
+                               typename ConnectedComponents<N>::V q)
+{
+    cc.update(Roi<N>(p, q));
+}
+
 template<int N, class V>
 struct ExportV {
     static void export_();
@@ -83,6 +109,26 @@ struct ExportV<4, V> {
     }
 };
 
+/**
+ * Export Source<M,T> and SourceHDF5<M,T> as "ChannelSource" and
+ * "ChannelSourceHDF5" into the module of dimension M-1, as the inputs of
+ * its ChannelSelector and ChannelSelectorSource. Only needed for the
+ * largest dimension, the others take the sources of the next module.
+ */
+template<int M, class T>
+void exportChannelSources() {
+    using namespace boost::python;
+
+    std::stringstream fullModname; fullModname << "_blockedarray.dim" << M-1;
+    object module(handle<>(borrowed(PyImport_AddModule(fullModname.str().c_str()))));
+    scope s = module;
+
+    class_<Source<M, T> >("ChannelSource", no_init);
+    class_<SourceHDF5<M, T>, bases<Source<M, T> >, boost::noncopyable>("ChannelSourceHDF5",
+        init<std::string, std::string>())
+    ;
+}
+
 template<int N, class T>
 void blockwiseCC() {
 
@@ -106,12 +152,14 @@ void blockwiseCC() {
     ExportV<N, typename BCC::V>::export_();
 
     class_<Source<N, T> >("Source", no_init);
+    class_<Source<N, vigra::UInt8> >("SourceUInt8", no_init);
+    class_<Source<N, vigra::UInt32> >("SourceUInt32", no_init);
     class_<Sink<N, T> >("Sink", no_init);
 
-    class_<SourceHDF5<N, T>, bases<Source<N, T> > >("SourceHDF5",
+    class_<SourceHDF5<N, T>, bases<Source<N, T> >, boost::noncopyable>("SourceHDF5",
         init<std::string, std::string>())
     ;
-    class_<SinkHDF5<N, T>, bases<Sink<N, T> > >("SinkHDF5",
+    class_<SinkHDF5<N, T>, bases<Sink<N, T> >, boost::noncopyable>("SinkHDF5",
         init<std::string, std::string>())
     ;
 
@@ -127,14 +175,42 @@ void blockwiseCC() {
             (arg("dimension"), arg("channel"), arg("sink")))
     ;
 
-    class_<BCC>("ConnectedComponents",
-        init<Source<N, vigra::UInt8>*, typename BCC::V>())
-        .def("writeResult", &BCC::writeResult,
+    //lazy sources, which keep their upstream source alive
+    class_<ThresholdingSource<N, T>, bases<Source<N, vigra::UInt8> > >("ThresholdingSource",
+        init<Source<N,T>*, T, vigra::UInt8, vigra::UInt8>(
+            (arg("source"), arg("threshold"), arg("ifLower"), arg("ifHigher")))
+        [with_custodian_and_ward<1,2>()])
+    ;
+
+    class_<ChannelSelectorSource<N+1, T>, bases<Source<N, T> > >("ChannelSelectorSource",
+        init<Source<N+1,T>*, int, int>(
+            (arg("source"), arg("dimension"), arg("channel")))
+        [with_custodian_and_ward<1,2>()])
+    ;
+
+    void (BCC::*writeResultHDF5)(const std::string&, const std::string&, int) = &BCC::writeResult;
+
+    class_<BCC, bases<Source<N, vigra::UInt32> >, boost::noncopyable>("ConnectedComponents",
+        init<Source<N, vigra::UInt8>*, typename BCC::V>()
+        [with_custodian_and_ward<1,2>()])
+        .def("setScratchFile", &BCC::setScratchFile,
+             (arg("hdf5file"), arg("hdf5group")))
+        .def("setIncremental", &BCC::setIncremental,
+             (arg("incremental")))
+        .def("run", &BCC::run)
+        .def("update", &updateConnectedComponents<N>,
+             (arg("p"), arg("q")))
+        .def("writeResult", writeResultHDF5,
              (arg("hdf5file"), arg("hdf5group"), arg("compression")=1))
+        .def("readBlock", vigra::registerConverters(&readConnectedComponents<N>),
+             (arg("p"), arg("q")))
+        .def("maxLabel", &BCC::maxLabel)
     ;
 }
 
 void export_blockwiseCC() {
+    //dim2.ChannelSelector(Source) takes a dim3.Source, e.g. dim3.SourceHDF5
     blockwiseCC<2, float>();
     blockwiseCC<3, float>();
+    exportChannelSources<4, float>();
 }
@@ -1,3 +1,4 @@
+import gc
 import numpy
 import vigra
 import h5py
@@ -74,6 +75,23 @@ def test1():
     ba.setCompressionEnabled(True)
     ba.setCompressionEnabled(False)
 
+def testConnectedComponentsKeepsSourceAlive():
+    f = h5py.File("test_cc_py.h5", 'w')
+    a = numpy.zeros((20,20,20), dtype=numpy.float32)
+    a[:10] = 1
+    f.create_dataset("data", data=a)
+    f.close()
+
+    def make():
+        source = dim3.ThresholdingSource(dim3.SourceHDF5("test_cc_py.h5", "data"), 0.5, 0, 1)
+        return dim3.ConnectedComponents(source, dim3.V(8,8,8))
+    #the temporary sources are only referenced by the ConnectedComponents
+    cc = make()
+    gc.collect()
+    cc.run()
+    assert cc.maxLabel() == 1
+
 if __name__ == "__main__":
     test1()
+    testConnectedComponentsKeepsSourceAlive()
     print "success"
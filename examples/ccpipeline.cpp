@@ -29,6 +29,7 @@
 
 #include <iostream>
 
+#include <bw/blocking.h>
 #include <bw/channelselector.h>
 #include <bw/thresholding.h>
 #include <bw/connectedcomponents.h>
@@ -49,41 +50,26 @@ int main(int argc, char** argv) {
 
     typedef TinyVector<int, 3> V;
 
-    V blockShape(100,100,100);
+    //blocks of at most 128^3 pixels, aligned to the chunks of the input
+    const size_t maxBlockSize = 128*128*128;
 
-    //extract channel 0
-    {
-        SourceHDF5<4, float> source(hdf5file, hdf5group);
-        SinkHDF5<3, float> sink("01_channel0.h5", "channel0");
-        sink.setBlockShape(blockShape);
-        ChannelSelector<4, float> cs(&source, blockShape);
-        cs.run(0, 0, &sink);
-    }
-
-    //threshold
-    {
-        SourceHDF5<3, float> source("01_channel0.h5", "channel0");
-        SinkHDF5<3, vigra::UInt8> sink("02_thresh.h5", "thresh");
-        sink.setBlockShape(blockShape);
-        Thresholding<3, float> bs(&source, blockShape);
-        bs.run(0.5, 0, 1, &sink);
-    }
+    //connected components of threshold(channel0(input)),
+    //computed on demand from a single read of the input
+    SourceHDF5<4, float> source(hdf5file, hdf5group);
+    ChannelSelectorSource<4, float> channel0(&source, 0, 0);
+    ThresholdingSource<3, float> thresh(&channel0, 0.5, 0, 1);
+    const V blockShape = Blocking<3>::chunkAlignedBlockShape(thresh.shape(), thresh.chunkShape(), maxBlockSize);
+    std::cout << "* block shape " << blockShape << std::endl;
+    ConnectedComponents<3, UInt32> bs(&thresh, blockShape);
+    bs.setScratchFile("03_cc_scratch.h5", "cc");
+    //object sizes, bounding boxes and mean intensities from the same pass
+    bs.setStatistics(true, &channel0);
+    bs.writeResult("03_cc.h5", "cc", 1);
+    bs.writeStatistics("03_cc_statistics.h5");
 
+    //region features, reading the labels directly from the
     //connected components
-    {
-        SourceHDF5<3, UInt8> source("02_thresh.h5", "thresh");
-        ConnectedComponents<3> bs(&source, blockShape);
-        bs.writeResult("03_cc.h5", "cc", 1);
-    }
-
-    //region features
-    {
-        SourceHDF5<3, float> sourceData("02_thresh.h5", "thresh");
-        SourceHDF5<3, uint32_t> sourceLabels("02_thresh.h5", "thresh");
-        RegionFeatures<3, float, uint32_t> rf(&sourceData, &sourceLabels, blockShape);
-        vigra::MultiArray<2, float> out;
-        rf.run("test_result.h5");
-    }
-
+    RegionFeatures<3, float, UInt32> rf(&channel0, &bs, blockShape);
+    rf.run("test_result.h5");
 }
 
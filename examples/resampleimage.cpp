@@ -3,6 +3,9 @@
 #include <bw/resampleimage.h>
 #include <bw/sourcehdf5.h>
 #include <bw/sinkhdf5.h>
+#include <bw/sourceprefetching.h>
+#include <bw/sinkwritebehind.h>
+#include <bw/hdf5mutex.h>
 #include <bw/roi.h>
 
 class H5DataDescriptor {
@@ -50,14 +53,26 @@ int main(int argc, char **argv) {
     std::cout << "in  = " << in << std::endl;
     std::cout << "out = " << out << std::endl;
     
-    SourceHDF5<3, uint32_t> source(in.filename, in.groupname);
-    std::cout << source.shape() << std::endl;
+    SourceHDF5<3, uint32_t> sourceHDF5(in.filename, in.groupname);
+    std::cout << sourceHDF5.shape() << std::endl;
+
+    //overlap reading and writing with resampling: the prefetching thread
+    //reads 'sourceHDF5' while the write-behind thread writes 'sinkHDF5'.
+    //Both only call HDF5 through HDF5Dataset, which holds the global
+    //hdf5Mutex() (see bw/hdf5mutex.h), so the two threads never enter
+    //libhdf5 at the same time. Any direct HDF5 call made here while they
+    //run must hold an HDF5Lock as well.
+    Blocking<3> blocking(Roi<3>(V(), sourceHDF5.shape()), inBlockShape, V());
+    SourcePrefetching<3, uint32_t> source(&sourceHDF5, blocking);
 
     ResampleImage<3, uint32_t> r(&source, inBlockShape);
     
-    SinkHDF5<3, uint32_t> sink(out.filename, out.groupname, 0 /* no compression */);
+    SinkHDF5<3, uint32_t> sinkHDF5(out.filename, out.groupname, 0 /* no compression */);
+    SinkWriteBehind<3, uint32_t> sink(&sinkHDF5);
     
     r.run(1.0/4.0, &sink, outBlockShape);
+    sink.close();
+    sinkHDF5.close();
     
     return 0;
 }
\ No newline at end of file
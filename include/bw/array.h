@@ -239,6 +239,12 @@ class Array {
      */
     void blockBounds(V c, V&p, V& q) const;
 
+    /**
+     * returns the block stored at block coordinate 'c',
+     * or a null pointer if no such block exists
+     */
+    BlockPtr block(V c) const;
+
     VoxelValues nonzero() const;
 
     std::vector<V> enumerateBlocksInRange(V p, V q) const;
@@ -710,6 +716,15 @@ void Array<N,T>::blockBounds(
     }
 }
 
+template<int N, typename T>
+typename Array<N,T>::BlockPtr Array<N,T>::block(V c) const {
+    typename BlocksMap::const_iterator it = blocks_.find(c);
+    if(it == blocks_.end()) {
+        return BlockPtr();
+    }
+    return it->second;
+}
+
 //==== IMPLEMENTATION (RwIterator) =====//
 
 template<int N, typename T>
@@ -0,0 +1,322 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_ARRAYCLIENT_H
+#define BW_ARRAYCLIENT_H
+
+#include <sys/un.h>
+
+#include <deque>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vigra/multi_array.hxx>
+
+#include <bw/roi.h>
+#include <bw/compressedarray.h>
+#include <bw/arrayprotocol.h>
+
+namespace BW {
+
+/**
+ * Accesses an Array served by an ArrayServer in another process.
+ *
+ * Reads can be pipelined: submitRead() sends the request and returns
+ * immediately, the results are received by waitAll(). Reads larger than
+ * sharedMemoryThreshold() bytes are transferred through a shared memory
+ * segment instead of the socket.
+ */
+template<int N, class T>
+class ArrayClient : boost::noncopyable {
+    public:
+    typedef typename vigra::MultiArrayShape<N>::type V;
+
+    ArrayClient(const std::string& socketPath)
+        : fd_(-1)
+        , nextRequestId_(0)
+        , maxPending_(64)
+        , shmThreshold_(0)
+        , compressedBlocks_(false)
+    {
+        vigra_precondition(N <= ArrayProtocolMaxDim, "dimension not supported by protocol");
+
+        sockaddr_un addr;
+        vigra_precondition(socketPath.size() < sizeof(addr.sun_path), "socket path too long");
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, socketPath.c_str());
+
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd_ < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        if(connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            std::string err(std::strerror(errno));
+            close(fd_);
+            throw std::runtime_error("cannot connect to " + socketPath + ": " + err);
+        }
+    }
+
+    ~ArrayClient() {
+        try {
+            waitAll();
+        }
+        catch(...) {}
+        close(fd_);
+    }
+
+    /**
+     * reads of at least 'bytes' bytes are transferred via shared memory
+     * (0 disables shared memory transfers, which is the default)
+     */
+    void setSharedMemoryThreshold(size_t bytes) { shmThreshold_ = bytes; }
+    size_t sharedMemoryThreshold() const { return shmThreshold_; }
+
+    /**
+     * If enabled, reads transfer the stored (compressed) blocks instead of
+     * the dense region of interest, which are then decompressed by the client.
+     * Takes precedence over shared memory transfers.
+     */
+    void setTransferCompressedBlocks(bool enable) { compressedBlocks_ = enable; }
+    bool transferCompressedBlocks() const { return compressedBlocks_; }
+
+    /**
+     * maximal number of outstanding reads; submitRead() waits for the
+     * oldest ones to complete when this limit is reached
+     */
+    void setMaxPending(size_t n) { vigra_precondition(n > 0, "maxPending must be > 0"); maxPending_ = n; }
+
+    size_t numPending() const { return pending_.size(); }
+
+    V blockShape() {
+        waitAll();
+        sendRequest(OpBlockShape, V(), V(), 0, 0);
+        std::vector<char> r = receiveResponse(nextRequestId_-1);
+        vigra_precondition(r.size() == N*sizeof(int64_t), "invalid response");
+        int64_t s[N];
+        std::memcpy(s, &r[0], sizeof(s));
+        V bs;
+        std::copy(s, s+N, bs.begin());
+        return bs;
+    }
+
+    /**
+     * read the region of interest [p,q) into 'out'
+     */
+    void readSubarray(V p, V q, vigra::MultiArrayView<N,T>& out) {
+        submitRead(p, q, out);
+        waitAll();
+    }
+
+    /**
+     * send a read request for the region of interest [p,q).
+     * 'out' must stay valid until waitAll() has returned.
+     */
+    void submitRead(V p, V q, vigra::MultiArrayView<N,T>& out) {
+        vigra_precondition(out.shape() == q-p, "shape of 'out' does not match region of interest");
+        while(pending_.size() >= maxPending_) {
+            completeOldest();
+        }
+
+        Pending r;
+        r.p = p;
+        r.out = out;
+        r.opcode = OpRead;
+        size_t bytes = Roi<N>(p,q).size()*sizeof(T);
+        std::string shmName;
+        if(compressedBlocks_) {
+            r.opcode = OpReadBlocks;
+        }
+        else if(shmThreshold_ > 0 && bytes >= shmThreshold_) {
+            r.opcode = OpReadShared;
+            r.shm.reset(new SharedMemoryBuffer(bytes));
+            shmName = r.shm->name();
+        }
+        r.requestId = sendRequest(r.opcode, p, q, 0, 0, shmName);
+        pending_.push_back(r);
+    }
+
+    /**
+     * receive the results of all submitted reads
+     */
+    void waitAll() {
+        while(!pending_.empty()) {
+            completeOldest();
+        }
+    }
+
+    /**
+     * write 'a' into the region of interest [p,q)
+     */
+    void writeSubarray(V p, V q, const vigra::MultiArrayView<N,T>& a) {
+        vigra_precondition(a.shape() == q-p, "shape of 'a' does not match region of interest");
+        waitAll();
+        vigra::MultiArray<N,T> tmp(a); //contiguous copy
+        uint64_t id = sendRequest(OpWrite, p, q, reinterpret_cast<const char*>(tmp.data()), tmp.size()*sizeof(T));
+        receiveResponse(id);
+    }
+
+    /**
+     * delete all blocks intersecting the region of interest [p,q)
+     */
+    void deleteSubarray(V p, V q) {
+        waitAll();
+        uint64_t id = sendRequest(OpDelete, p, q, 0, 0);
+        receiveResponse(id);
+    }
+
+    private:
+
+    struct Pending {
+        uint64_t requestId;
+        uint32_t opcode;
+        V p;
+        vigra::MultiArrayView<N,T> out;
+        boost::shared_ptr<SharedMemoryBuffer> shm;
+    };
+
+    uint64_t sendRequest(uint32_t opcode, V p, V q, const char* payload, size_t n,
+                         const std::string& shmName = std::string())
+    {
+        ArrayRequestHeader h;
+        std::memset(&h, 0, sizeof(h));
+        h.magic = ArrayProtocolMagic;
+        h.opcode = opcode;
+        h.requestId = nextRequestId_++;
+        h.ndim = N;
+        h.dtypeSize = sizeof(T);
+        std::copy(p.begin(), p.end(), h.p);
+        std::copy(q.begin(), q.end(), h.q);
+        h.payloadBytes = n;
+        vigra_precondition(shmName.size() < ArrayProtocolShmNameLength, "shared memory name too long");
+        std::copy(shmName.begin(), shmName.end(), h.shmName);
+
+        protocol::sendAll(fd_, &h, sizeof(h));
+        if(n > 0) {
+            protocol::sendAll(fd_, payload, n);
+        }
+        return h.requestId;
+    }
+
+    std::vector<char> receiveResponse(uint64_t requestId) {
+        ArrayResponseHeader h;
+        protocol::recvAll(fd_, &h, sizeof(h));
+        if(h.magic != ArrayProtocolMagic || h.requestId != requestId) {
+            throw std::runtime_error("ArrayClient: unexpected response");
+        }
+        std::vector<char> payload(h.payloadBytes);
+        if(h.payloadBytes > 0) {
+            protocol::recvAll(fd_, &payload[0], h.payloadBytes);
+        }
+        if(h.status != StatusOk) {
+            throw std::runtime_error("ArrayServer: " + std::string(payload.begin(), payload.end()));
+        }
+        return payload;
+    }
+
+    void completeOldest() {
+        Pending r = pending_.front();
+        pending_.pop_front();
+
+        std::vector<char> payload = receiveResponse(r.requestId);
+        switch(r.opcode) {
+            case OpRead: {
+                vigra_precondition(payload.size() == r.out.size()*sizeof(T), "invalid response");
+                r.out.copy(vigra::MultiArrayView<N,T>(r.out.shape(), reinterpret_cast<T*>(&payload[0])));
+                break;
+            }
+            case OpReadShared: {
+                r.out.copy(vigra::MultiArrayView<N,T>(r.out.shape(), reinterpret_cast<T*>(r.shm->data())));
+                break;
+            }
+            case OpReadBlocks: {
+                decodeBlocks(r.p, r.out, payload);
+                break;
+            }
+        }
+    }
+
+    /**
+     * decompress the blocks in 'payload' and copy their intersection with
+     * the region of interest starting at 'p' into 'out'
+     */
+    void decodeBlocks(V p, vigra::MultiArrayView<N,T>& out, const std::vector<char>& payload) {
+        out.init(T());
+        Roi<N> roi(p, p+out.shape());
+
+        size_t pos = 0;
+        uint64_t count;
+        read(payload, pos, &count, sizeof(count));
+        for(uint64_t i=0; i<count; ++i) {
+            int64_t o[N], s[N];
+            uint8_t compressed;
+            uint64_t bytes;
+            read(payload, pos, o, sizeof(o));
+            read(payload, pos, s, sizeof(s));
+            read(payload, pos, &compressed, sizeof(compressed));
+            read(payload, pos, &bytes, sizeof(bytes));
+            vigra_precondition(pos+bytes <= payload.size(), "invalid response");
+
+            V shape;
+            std::copy(s, s+N, shape.begin());
+            CompressedArray<N,T> block = CompressedArray<N,T>::fromRawData(
+                shape, compressed != 0, bytes > 0 ? &payload[pos] : 0, bytes);
+            pos += bytes;
+
+            V blockP;
+            std::copy(o, o+N, blockP.begin());
+            Roi<N> blockRoi(blockP, blockP+shape);
+
+            Roi<N> isect;
+            if(!roi.intersect(blockRoi, isect)) { continue; }
+
+            vigra::MultiArray<N,T> a(shape);
+            block.readArray(a);
+            out.subarray(isect.p-p, isect.q-p) = a.subarray(isect.p-blockP, isect.q-blockP);
+        }
+    }
+
+    static void read(const std::vector<char>& payload, size_t& pos, void* dest, size_t n) {
+        vigra_precondition(pos+n <= payload.size(), "invalid response");
+        std::memcpy(dest, &payload[pos], n);
+        pos += n;
+    }
+
+    int fd_;
+    uint64_t nextRequestId_;
+    size_t maxPending_;
+    size_t shmThreshold_;
+    bool compressedBlocks_;
+    std::deque<Pending> pending_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_ARRAYCLIENT_H */
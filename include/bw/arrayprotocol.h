@@ -0,0 +1,228 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_ARRAYPROTOCOL_H
+#define BW_ARRAYPROTOCOL_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/noncopyable.hpp>
+
+namespace BW {
+
+/**
+ * Binary protocol spoken between ArrayServer and ArrayClient
+ * over a Unix domain socket.
+ *
+ * Every request consists of an ArrayRequestHeader followed by
+ * 'payloadBytes' bytes of payload, every response of an
+ * ArrayResponseHeader followed by its payload. The server answers the
+ * requests of one connection in the order in which they were sent, so that
+ * a client may send several requests before reading the first response.
+ */
+static const uint32_t ArrayProtocolMagic  = 0x52415742; // "BWAR"
+static const int      ArrayProtocolMaxDim = 5;
+static const int      ArrayProtocolShmNameLength = 64;
+
+enum ArrayOpcode {
+    OpBlockShape  = 1, ///< response: int64[N] block shape
+    OpRead        = 2, ///< response: the ROI [p,q) as dense array
+    OpReadShared  = 3, ///< the ROI [p,q) is written into shared memory 'shmName'
+    OpReadBlocks  = 4, ///< response: the (compressed) blocks intersecting [p,q)
+    OpWrite       = 5, ///< payload: the ROI [p,q) as dense array
+    OpDelete      = 6  ///< delete all blocks intersecting [p,q)
+};
+
+enum ArrayStatus {
+    StatusOk    = 0,
+    StatusError = 1 ///< response payload is the error message
+};
+
+struct ArrayRequestHeader {
+    uint32_t magic;
+    uint32_t opcode;
+    uint64_t requestId;
+    uint32_t ndim;
+    uint32_t dtypeSize;
+    int64_t  p[ArrayProtocolMaxDim];
+    int64_t  q[ArrayProtocolMaxDim];
+    uint64_t payloadBytes;
+    char     shmName[ArrayProtocolShmNameLength];
+};
+
+struct ArrayResponseHeader {
+    uint32_t magic;
+    uint32_t status;
+    uint64_t requestId;
+    uint64_t payloadBytes;
+};
+
+/**
+ * Layout of one block in the response to OpReadBlocks
+ * (the payload starts with the number of blocks as uint64):
+ *   int64[N] offset of the block, int64[N] block shape,
+ *   uint8 compressed flag, uint64 size in bytes, data
+ */
+
+namespace protocol {
+
+inline void sendAll(int fd, const void* data, size_t n) {
+    const char* d = reinterpret_cast<const char*>(data);
+    while(n > 0) {
+        ssize_t r = ::send(fd, d, n, MSG_NOSIGNAL);
+        if(r < 0 && errno == EINTR) { continue; }
+        if(r <= 0) {
+            throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+        }
+        d += r;
+        n -= r;
+    }
+}
+
+inline void recvAll(int fd, void* data, size_t n) {
+    char* d = reinterpret_cast<char*>(data);
+    while(n > 0) {
+        ssize_t r = ::recv(fd, d, n, 0);
+        if(r < 0 && errno == EINTR) { continue; }
+        if(r == 0) {
+            throw std::runtime_error("recv: connection closed");
+        }
+        if(r < 0) {
+            throw std::runtime_error(std::string("recv: ") + std::strerror(errno));
+        }
+        d += r;
+        n -= r;
+    }
+}
+
+} /* namespace protocol */
+
+/**
+ * A POSIX shared memory segment, mapped into this process.
+ *
+ * Used for large reads: the client creates the segment, the server maps it
+ * by name and writes the result directly into it.
+ */
+class SharedMemoryBuffer : boost::noncopyable {
+    public:
+
+    /**
+     * create a new segment of 'sizeBytes' bytes with a unique name
+     */
+    explicit SharedMemoryBuffer(size_t sizeBytes)
+        : data_(0)
+        , size_(sizeBytes)
+        , owner_(true)
+    {
+        static unsigned int counter = 0;
+        for(int attempt=0; ; ++attempt) {
+            std::stringstream n;
+            n << "/bw-" << getpid() << "-" << counter++;
+            name_ = n.str();
+            int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if(fd < 0 && errno == EEXIST && attempt < 100) { continue; }
+            if(fd < 0) {
+                throw std::runtime_error(std::string("shm_open: ") + std::strerror(errno));
+            }
+            if(ftruncate(fd, std::max<size_t>(size_, 1)) != 0) {
+                close(fd);
+                shm_unlink(name_.c_str());
+                throw std::runtime_error(std::string("ftruncate: ") + std::strerror(errno));
+            }
+            map(fd);
+            break;
+        }
+    }
+
+    /**
+     * map the existing segment 'name' of 'sizeBytes' bytes
+     */
+    SharedMemoryBuffer(const std::string& name, size_t sizeBytes)
+        : name_(name)
+        , data_(0)
+        , size_(sizeBytes)
+        , owner_(false)
+    {
+        int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+        if(fd < 0) {
+            throw std::runtime_error(std::string("shm_open: ") + std::strerror(errno));
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < size_) {
+            close(fd);
+            throw std::runtime_error("shared memory segment is too small");
+        }
+        map(fd);
+    }
+
+    ~SharedMemoryBuffer() {
+        munmap(data_, std::max<size_t>(size_, 1));
+        if(owner_) {
+            shm_unlink(name_.c_str());
+        }
+    }
+
+    const std::string& name() const { return name_; }
+    char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    private:
+
+    void map(int fd) {
+        void* d = mmap(0, std::max<size_t>(size_, 1), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(d == MAP_FAILED) {
+            if(owner_) { shm_unlink(name_.c_str()); }
+            throw std::runtime_error(std::string("mmap: ") + std::strerror(errno));
+        }
+        data_ = reinterpret_cast<char*>(d);
+    }
+
+    std::string name_;
+    char* data_;
+    size_t size_;
+    bool owner_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_ARRAYPROTOCOL_H */
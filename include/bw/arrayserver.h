@@ -0,0 +1,403 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_ARRAYSERVER_H
+#define BW_ARRAYSERVER_H
+
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <vector>
+
+#include <bw/array.h>
+#include <bw/arrayprotocol.h>
+
+namespace BW {
+
+/**
+ * Serves read and write requests for regions of interest of an Array
+ * to clients (see ArrayClient) connecting via the Unix domain socket
+ * 'socketPath'.
+ *
+ * All requests are processed on the thread calling run() or
+ * processEvents(), so the Array needs no synchronization. Responses are
+ * queued per client and sent without blocking, so a client which does
+ * not read its responses does not stall the others. While more than
+ * maxQueuedBytes() are queued for a client, no further requests of it are
+ * read or processed. Requests for regions of interest larger than
+ * maxRequestBytes() are rejected.
+ */
+template<int N, class T>
+class ArrayServer : boost::noncopyable {
+    public:
+    typedef typename Array<N,T>::V V;
+
+    ArrayServer(Array<N,T>& array, const std::string& socketPath)
+        : array_(array)
+        , socketPath_(socketPath)
+        , listenFd_(-1)
+        , maxRequestBytes_(size_t(1) << 30)
+        , maxQueuedBytes_(size_t(64) << 20)
+        , stopped_(0)
+    {
+        vigra_precondition(N <= ArrayProtocolMaxDim, "dimension not supported by protocol");
+
+        sockaddr_un addr;
+        vigra_precondition(socketPath.size() < sizeof(addr.sun_path), "socket path too long");
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, socketPath.c_str());
+
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listenFd_ < 0) {
+            throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+        }
+        unlink(socketPath.c_str());
+        if(bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+           || listen(listenFd_, 16) != 0)
+        {
+            std::string err(std::strerror(errno));
+            close(listenFd_);
+            throw std::runtime_error("cannot listen on " + socketPath + ": " + err);
+        }
+    }
+
+    ~ArrayServer() {
+        for(size_t i=0; i<connections_.size(); ++i) {
+            close(connections_[i].fd);
+        }
+        close(listenFd_);
+        unlink(socketPath_.c_str());
+    }
+
+    /**
+     * serve requests until stop() is called
+     */
+    void run() {
+        while(processEvents(100)) {}
+    }
+
+    /**
+     * make run() return after the current iteration
+     * (may be called from a signal handler)
+     */
+    void stop() { stopped_ = 1; }
+
+    /**
+     * largest region of interest (in bytes) which may be read or written
+     * by one request (default: 1 GiB); larger requests get an error,
+     * and a client sending a larger payload is disconnected
+     */
+    void setMaxRequestBytes(size_t n) { maxRequestBytes_ = n; }
+    size_t maxRequestBytes() const { return maxRequestBytes_; }
+
+    /**
+     * number of response bytes (default: 64 MiB) which may be queued for
+     * one client before the server stops processing its requests until
+     * the client has read some of them. The responses of one request are
+     * always queued completely, so up to maxRequestBytes() more may be
+     * queued.
+     */
+    void setMaxQueuedBytes(size_t n) { maxQueuedBytes_ = n; }
+    size_t maxQueuedBytes() const { return maxQueuedBytes_; }
+
+    /**
+     * wait at most 'timeoutMs' milliseconds for new connections or requests
+     * and process them.
+     *
+     * returns: false if the server has been stopped
+     */
+    bool processEvents(int timeoutMs) {
+        if(stopped_) { return false; }
+
+        std::vector<pollfd> fds(connections_.size()+1);
+        fds[0].fd = listenFd_;
+        fds[0].events = POLLIN;
+        for(size_t i=0; i<connections_.size(); ++i) {
+            fds[i+1].fd = connections_[i].fd;
+            fds[i+1].events = 0;
+            if(!full(connections_[i])) {
+                fds[i+1].events |= POLLIN;
+            }
+            if(connections_[i].outPos < connections_[i].out.size()) {
+                fds[i+1].events |= POLLOUT;
+            }
+        }
+        int r = poll(&fds[0], fds.size(), timeoutMs);
+        if(r < 0 && errno != EINTR) {
+            throw std::runtime_error(std::string("poll: ") + std::strerror(errno));
+        }
+        if(r <= 0) { return !stopped_; }
+
+        //iterate backwards, so that closed connections can be erased
+        for(size_t i=connections_.size(); i>0; --i) {
+            if(fds[i].revents == 0) { continue; }
+            Connection& c = connections_[i-1];
+            bool ok = true;
+            if(fds[i].revents & ~POLLOUT) {
+                ok = receive(c);
+            }
+            if(ok) {
+                ok = flush(c);
+            }
+            //process the requests held back while the output was full
+            while(ok && !full(c) && !c.buffer.empty()) {
+                size_t before = c.buffer.size();
+                ok = processRequests(c) && flush(c);
+                if(c.buffer.size() == before) { break; }
+            }
+            if(!ok) {
+                close(c.fd);
+                connections_.erase(connections_.begin()+(i-1));
+            }
+        }
+        if(fds[0].revents & POLLIN) {
+            int fd = accept(listenFd_, 0, 0);
+            if(fd >= 0) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                connections_.push_back(Connection());
+                connections_.back().fd = fd;
+            }
+        }
+        return !stopped_;
+    }
+
+    size_t numConnections() const { return connections_.size(); }
+
+    /**
+     * number of response bytes queued for all clients, but not sent yet
+     */
+    size_t queuedBytes() const {
+        size_t n = 0;
+        for(size_t i=0; i<connections_.size(); ++i) {
+            n += connections_[i].out.size()-connections_[i].outPos;
+        }
+        return n;
+    }
+
+    private:
+
+    struct Connection {
+        Connection() : fd(-1), outPos(0) {}
+        int fd;
+        //received data which does not form a complete request yet
+        std::vector<char> buffer;
+        //queued responses, of which the first 'outPos' bytes are sent
+        std::vector<char> out;
+        size_t outPos;
+    };
+
+    /**
+     * whether so much output is queued for 'c' that its requests
+     * are held back
+     */
+    bool full(const Connection& c) const {
+        return c.out.size()-c.outPos > maxQueuedBytes_;
+    }
+
+    /**
+     * read available data from 'c' and process the complete requests
+     *
+     * returns: false if the connection has been closed
+     */
+    bool receive(Connection& c) {
+        char tmp[65536];
+        ssize_t n = recv(c.fd, tmp, sizeof(tmp), 0);
+        if(n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) { return true; }
+        if(n <= 0) { return false; }
+        c.buffer.insert(c.buffer.end(), tmp, tmp+n);
+        return processRequests(c);
+    }
+
+    /**
+     * process the complete requests received from 'c' until its
+     * output is full
+     *
+     * returns: false if the client has sent an invalid request
+     */
+    bool processRequests(Connection& c) {
+        size_t pos = 0;
+        while(!full(c) && c.buffer.size()-pos >= sizeof(ArrayRequestHeader)) {
+            ArrayRequestHeader h;
+            std::memcpy(&h, &c.buffer[pos], sizeof(h));
+            if(h.magic != ArrayProtocolMagic) { return false; }
+            //the payload would have to be buffered before it could be rejected
+            if(h.payloadBytes > maxRequestBytes_) { return false; }
+            if(c.buffer.size()-pos-sizeof(h) < h.payloadBytes) { break; }
+            handleRequest(c, h, &c.buffer[pos]+sizeof(h));
+            pos += sizeof(h)+h.payloadBytes;
+        }
+        c.buffer.erase(c.buffer.begin(), c.buffer.begin()+pos);
+        return true;
+    }
+
+    /**
+     * send as much of the queued responses of 'c' as possible without
+     * blocking
+     *
+     * returns: false if the connection is broken
+     */
+    static bool flush(Connection& c) {
+        while(c.outPos < c.out.size()) {
+            ssize_t n = ::send(c.fd, &c.out[c.outPos], c.out.size()-c.outPos, MSG_NOSIGNAL);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+            if(n <= 0) { return false; }
+            c.outPos += n;
+        }
+        if(c.outPos == c.out.size()) {
+            c.out.clear();
+            c.outPos = 0;
+        }
+        return true;
+    }
+
+    void handleRequest(Connection& c, const ArrayRequestHeader& h, const char* payload) {
+        std::vector<char> response;
+        try {
+            vigra_precondition(h.ndim == N && h.dtypeSize == sizeof(T), "wrong dimension or data type");
+            V p, q;
+            std::copy(h.p, h.p+N, p.begin());
+            std::copy(h.q, h.q+N, q.begin());
+            if(h.opcode != OpBlockShape) {
+                double bytes = sizeof(T);
+                for(int i=0; i<N; ++i) {
+                    vigra_precondition(p[i] >= 0 && p[i] < q[i], "invalid region of interest");
+                    bytes *= q[i]-p[i];
+                }
+                vigra_precondition(bytes <= maxRequestBytes_, "region of interest too large");
+            }
+            switch(h.opcode) {
+                case OpBlockShape: {
+                    V bs = array_.blockShape();
+                    int64_t s[N];
+                    std::copy(bs.begin(), bs.end(), s);
+                    response.assign(reinterpret_cast<char*>(s), reinterpret_cast<char*>(s)+sizeof(s));
+                    break;
+                }
+                case OpRead: {
+                    response.resize(Roi<N>(p,q).size()*sizeof(T));
+                    vigra::MultiArrayView<N,T> out(q-p, reinterpret_cast<T*>(&response[0]));
+                    array_.readSubarray(p, q, out);
+                    break;
+                }
+                case OpReadShared: {
+                    std::string name(h.shmName, strnlen(h.shmName, ArrayProtocolShmNameLength));
+                    SharedMemoryBuffer shm(name, Roi<N>(p,q).size()*sizeof(T));
+                    vigra::MultiArrayView<N,T> out(q-p, reinterpret_cast<T*>(shm.data()));
+                    array_.readSubarray(p, q, out);
+                    break;
+                }
+                case OpReadBlocks: {
+                    serializeBlocks(p, q, response);
+                    break;
+                }
+                case OpWrite: {
+                    vigra_precondition(h.payloadBytes == Roi<N>(p,q).size()*sizeof(T), "payload size does not match region of interest");
+                    vigra::MultiArray<N,T> a(q-p);
+                    std::memcpy(a.data(), payload, h.payloadBytes);
+                    array_.writeSubarray(p, q, a);
+                    break;
+                }
+                case OpDelete: {
+                    array_.deleteSubarray(p, q);
+                    break;
+                }
+                default:
+                    throw std::runtime_error("unknown opcode");
+            }
+        }
+        catch(const std::exception& e) {
+            std::string err(e.what());
+            queueResponse(c, h.requestId, StatusError, err.data(), err.size());
+            return;
+        }
+        queueResponse(c, h.requestId, StatusOk, response.empty() ? 0 : &response[0], response.size());
+    }
+
+    void serializeBlocks(V p, V q, std::vector<char>& out) const {
+        std::vector<V> coords = array_.enumerateBlocksInRange(p, q);
+        uint64_t count = 0;
+        out.resize(sizeof(count));
+        for(size_t i=0; i<coords.size(); ++i) {
+            typename Array<N,T>::BlockPtr b = array_.block(coords[i]);
+            if(!b) { continue; }
+            ++count;
+
+            V bp, bq;
+            array_.blockBounds(coords[i], bp, bq);
+            int64_t o[N], s[N];
+            std::copy(bp.begin(), bp.end(), o);
+            V sh = b->shape();
+            std::copy(sh.begin(), sh.end(), s);
+            uint8_t compressed = b->isCompressed() ? 1 : 0;
+            uint64_t bytes = b->currentSizeBytes();
+
+            append(out, o, sizeof(o));
+            append(out, s, sizeof(s));
+            append(out, &compressed, sizeof(compressed));
+            append(out, &bytes, sizeof(bytes));
+            append(out, b->rawData(), bytes);
+        }
+        std::memcpy(&out[0], &count, sizeof(count));
+    }
+
+    static void append(std::vector<char>& out, const void* data, size_t n) {
+        const char* d = reinterpret_cast<const char*>(data);
+        out.insert(out.end(), d, d+n);
+    }
+
+    /**
+     * append a response to the output of 'c' (sent by flush())
+     */
+    static void queueResponse(Connection& c, uint64_t requestId, uint32_t status, const char* payload, size_t n) {
+        ArrayResponseHeader r;
+        r.magic = ArrayProtocolMagic;
+        r.status = status;
+        r.requestId = requestId;
+        r.payloadBytes = n;
+        append(c.out, &r, sizeof(r));
+        if(n > 0) {
+            append(c.out, payload, n);
+        }
+    }
+
+    Array<N,T>& array_;
+    std::string socketPath_;
+    int listenFd_;
+    std::vector<Connection> connections_;
+    size_t maxRequestBytes_;
+    size_t maxQueuedBytes_;
+    volatile sig_atomic_t stopped_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_ARRAYSERVER_H */
@@ -27,6 +27,7 @@
 /*                                                                      */
 /************************************************************************/
 
+
 #ifndef BW_BLOCKING_H
 #define BW_BLOCKING_H
 
@@ -34,13 +35,42 @@
 
 #include <vector>
 #include <iostream>
+#include <iterator>
+#include <algorithm>
+
+#include <vigra/error.hxx>
 
 #include "roi.h"
 
 namespace BW {
 
+/**
+ * Order in which the blocks of a Blocking are enumerated
+ */
+enum BlockOrder {
+    /** the last axis varies fastest */
+    RowMajorOrder,
+    /** Z-order curve (bit interleaving of the block coordinates) */
+    MortonOrder,
+    /**
+     * Hilbert curve: consecutive blocks are neighbours if the grid has the
+     * same power-of-two number of blocks along each axis; on other grids,
+     * the curve is cut off at the border and may jump between blocks
+     */
+    HilbertOrder
+};
+
 /**
  * Computes a tiling of (possibly overlapping) blocks.
+ *
+ * The blocks are not stored, but computed on demand: a Blocking needs O(1)
+ * memory and block(i) gives random access to the i-th block in the
+ * selected BlockOrder. Space filling curve orders keep blocks which are
+ * close in space also close in the sequence of blocks, which improves the
+ * reuse of cached data (and chunks) shared by neighbouring blocks.
+ *
+ * Iterating a Blocking (or [begin(), end())) yields the pairs
+ * (block coordinate, block roi).
  */
 template<int N>
 class Blocking {
@@ -49,50 +79,191 @@ class Blocking {
 
     typedef std::pair<V, Roi<N> > Pair;
 
-    Blocking() {}
+    /**
+     * random access iterator over the blocks, dereferencing to a Pair
+     */
+    class const_iterator {
+        public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef Pair value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const Pair* pointer;
+        typedef Pair reference;
+
+        const_iterator() : blocking_(0), i_(0) {}
+        const_iterator(const Blocking* blocking, size_t i) : blocking_(blocking), i_(i) {}
+
+        Pair operator*() const { return blocking_->block(i_); }
+        Pair operator[](difference_type n) const { return blocking_->block(i_+n); }
+
+        const_iterator& operator++() { ++i_; return *this; }
+        const_iterator& operator--() { --i_; return *this; }
+        const_iterator operator++(int) { const_iterator r(*this); ++i_; return r; }
+        const_iterator operator--(int) { const_iterator r(*this); --i_; return r; }
+        const_iterator& operator+=(difference_type n) { i_ += n; return *this; }
+        const_iterator& operator-=(difference_type n) { i_ -= n; return *this; }
+        const_iterator operator+(difference_type n) const { return const_iterator(blocking_, i_+n); }
+        const_iterator operator-(difference_type n) const { return const_iterator(blocking_, i_-n); }
+        difference_type operator-(const const_iterator& o) const { return (difference_type)i_ - (difference_type)o.i_; }
+
+        bool operator==(const const_iterator& o) const { return i_ == o.i_; }
+        bool operator!=(const const_iterator& o) const { return i_ != o.i_; }
+        bool operator<(const const_iterator& o) const { return i_ < o.i_; }
+        bool operator>(const const_iterator& o) const { return i_ > o.i_; }
+        bool operator<=(const const_iterator& o) const { return i_ <= o.i_; }
+        bool operator>=(const const_iterator& o) const { return i_ >= o.i_; }
 
-    Blocking(Roi<N> roi, V blockShape, V overlap = V() )
+        /** index of the block in the Blocking */
+        size_t index() const { return i_; }
+
+        private:
+        const Blocking* blocking_;
+        size_t i_;
+    };
+    typedef const_iterator iterator;
+
+    Blocking()
+        : order_(RowMajorOrder)
+        , numBlocks_(0)
+        , levels_(0)
+    {}
+
+    Blocking(Roi<N> roi, V blockShape, V overlap = V(), BlockOrder order = RowMajorOrder)
         : roi_(roi)
         , blockShape_(blockShape)
         , overlap_(overlap)
+        , order_(order)
+        , numBlocks_(1)
+        , levels_(0)
     {
-
-        V blockP = blockGivenCoordinateP(roi.p);
-        V blockQ = blockGivenCoordinateQ(roi.q);
-
-        V x = roi.p;
-        int dim=N-1;
-        addBlock(x);
-        while(dim >= 0) {
-            while(dim >= 0) {
-                if(x[dim] >= blockQ[dim]-1) {
-                    x[dim] = blockP[dim];
-                    --dim;
-                    continue;
-                } else {
-                    ++x[dim];
-                    addBlock(x);
-                    break;
-                }
-            }
-            if(dim >= 0) {
-                dim = N-1;
+        first_ = blockGivenCoordinateP(roi.p);
+        gridShape_ = blockGivenCoordinateQ(roi.q) - first_;
+        for(int i=0; i<N; ++i) {
+            numBlocks_ *= gridShape_[i];
+            while((typename V::value_type(1) << levels_) < gridShape_[i]) {
+                ++levels_;
             }
         }
     }
 
     size_t numBlocks() const {
-        return blocks_.size();
+        return numBlocks_;
+    }
+
+    BlockOrder order() const { return order_; }
+
+    /**
+     * number of blocks along each axis
+     */
+    V gridShape() const { return gridShape_; }
+
+    /**
+     * whether there is a block with coordinate 'x' (as in block(i).first)
+     */
+    bool containsBlock(V x) const {
+        for(int k=0; k<N; ++k) {
+            if(x[k] < first_[k] || x[k] >= first_[k]+gridShape_[k]) { return false; }
+        }
+        return true;
+    }
+
+    /**
+     * the i-th block in the order of this blocking
+     */
+    Pair block(size_t i) const {
+        vigra_precondition(i < numBlocks_, "Blocking: block index out of range");
+        V x = (order_ == RowMajorOrder) ? rowMajorCoordinate(i) : curveCoordinate(i);
+        x += first_;
+        return std::make_pair(x, blockRoi(x));
     }
 
+    /**
+     * index of the block with coordinate 'x' (as in block(i).first)
+     */
+    size_t indexOf(V x) const {
+        x -= first_;
+        for(int k=0; k<N; ++k) {
+            vigra_precondition(x[k] >= 0 && x[k] < gridShape_[k], "Blocking: block coordinate out of range");
+        }
+        return (order_ == RowMajorOrder) ? rowMajorIndex(x) : curveIndex(x);
+    }
+
+    /**
+     * index of the block whose roi is 'roi', or numBlocks() if there is none
+     */
+    size_t find(const Roi<N>& roi) const {
+        V x;
+        for(int k=0; k<N; ++k) {
+            if(blockShape_[k] <= 0 || roi.p[k] % blockShape_[k] != 0) { return numBlocks_; }
+            x[k] = roi.p[k] / blockShape_[k] - first_[k];
+            if(x[k] < 0 || x[k] >= gridShape_[k]) { return numBlocks_; }
+        }
+        size_t i = indexOf(x + first_);
+        return block(i).second == roi ? i : numBlocks_;
+    }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, numBlocks_); }
+
     void pprint() {
         std::pair<V, Roi<N> > roi;
-        BOOST_FOREACH(roi, blocks_) {
+        BOOST_FOREACH(roi, *this) {
             std::cout << roi.first << ": " << roi.second << std::endl;
         }
     }
 
-    std::vector< std::pair<V, Roi<N> > > blocks() const { return blocks_; }
+    /**
+     * all blocks, in order
+     *
+     * This materializes all blocks, prefer iterating over the Blocking
+     * or using block(i).
+     */
+    std::vector< std::pair<V, Roi<N> > > blocks() const {
+        return std::vector< std::pair<V, Roi<N> > >(begin(), end());
+    }
+
+    /**
+     * Chooses a block shape for processing data of the given 'shape' which
+     * is stored in chunks of shape 'chunkShape': each block extent is a
+     * multiple of the chunk extent (or covers the whole 'shape'), so that
+     * no chunk is shared between blocks. Starting from a single chunk,
+     * the block is grown along its shortest axis as long as it has at most
+     * 'maxBlockSize' elements, which yields blocks that are as cubic
+     * as the budget allows.
+     *
+     * If 'chunkShape' is V() (unknown), chunks of size 1 are assumed.
+     * A block always contains at least one chunk, even if it exceeds
+     * the budget.
+     */
+    static V chunkAlignedBlockShape(V shape, V chunkShape, size_t maxBlockSize) {
+        V block;
+        for(int k=0; k<N; ++k) {
+            vigra_precondition(shape[k] > 0, "chunkAlignedBlockShape: shape must be positive");
+            typename V::value_type c = chunkShape[k] > 0 ? chunkShape[k] : 1;
+            block[k] = std::min(c, shape[k]);
+            chunkShape[k] = c;
+        }
+        bool canGrow[N];
+        std::fill(canGrow, canGrow+N, true);
+        while(true) {
+            int dim = -1;
+            for(int k=0; k<N; ++k) {
+                if(!canGrow[k] || block[k] >= shape[k]) { continue; }
+                if(dim < 0 || block[k] < block[dim]) { dim = k; }
+            }
+            if(dim < 0) { break; }
+
+            V grown = block;
+            grown[dim] = std::min(block[dim]+chunkShape[dim], shape[dim]);
+            if(Roi<N>(V(), grown).size() > maxBlockSize) {
+                canGrow[dim] = false;
+            }
+            else {
+                block = grown;
+            }
+        }
+        return block;
+    }
 
     private:
 
@@ -108,20 +279,159 @@ class Blocking {
         return c;
     }
 
-    void addBlock(V x) {
+    Roi<N> blockRoi(V x) const {
         Roi<N> r;
         for(int i=0; i<N; ++i) {
             r.p[i] = x[i]*blockShape_[i];
             r.q[i] = std::min( (x[i]+1)*blockShape_[i]+overlap_[i], roi_.q[i] );
         }
-        blocks_.push_back(std::make_pair(x, r) );
+        return r;
+    }
+
+    V rowMajorCoordinate(size_t i) const {
+        V x;
+        for(int k=N-1; k>=0; --k) {
+            x[k] = i % gridShape_[k];
+            i /= gridShape_[k];
+        }
+        return x;
+    }
+
+    size_t rowMajorIndex(V x) const {
+        size_t i = 0;
+        for(int k=0; k<N; ++k) {
+            i = i*gridShape_[k] + x[k];
+        }
+        return i;
+    }
+
+    //
+    // Space filling curves
+    //
+    // The grid of blocks is embedded into a cube of 2^levels_ blocks per
+    // axis, which is traversed recursively: on each level, the current
+    // cube is split into 2^N subcubes, which are visited in the order given
+    // by the curve. Subcubes which lie partially outside of the grid are
+    // shortened by the blocks they do not contain, so the index of a block
+    // is found by counting the blocks in the preceding subcubes.
+    //
+    // The Hilbert curve follows Hamilton, "Compact Hilbert Indices" (2006):
+    // the state of a subcube is its entry point 'e' and direction 'd'.
+    //
+
+    /**
+     * position (bit k: upper half along axis k) of the w-th subcube
+     */
+    unsigned int subcube(unsigned int w, unsigned int e, int d) const {
+        if(order_ == MortonOrder) {
+            return w;
+        }
+        return rotl(w ^ (w >> 1), d+1) ^ e;
+    }
+
+    void descend(unsigned int w, unsigned int& e, int& d) const {
+        if(order_ == MortonOrder) {
+            return;
+        }
+        //entry point and direction of the w-th subcube
+        unsigned int entry = 0;
+        int dir = 0;
+        if(w > 0) {
+            unsigned int v = 2*((w-1)/2);
+            entry = v ^ (v >> 1);
+            dir = (w % 2 == 0) ? trailingSetBits(w-1) % N : trailingSetBits(w) % N;
+        }
+        e ^= rotl(entry, d+1);
+        d = (d + dir + 1) % N;
+    }
+
+    /**
+     * number of blocks of the grid in the subcube at 'p' with side 'side'
+     */
+    size_t countInside(const V& p, typename V::value_type side) const {
+        size_t n = 1;
+        for(int k=0; k<N; ++k) {
+            typename V::value_type q = std::min(p[k]+side, gridShape_[k]);
+            if(q <= p[k]) { return 0; }
+            n *= q - p[k];
+        }
+        return n;
+    }
+
+    V curveCoordinate(size_t i) const {
+        V p;
+        unsigned int e = 0;
+        int d = 0;
+        for(int level=levels_-1; level>=0; --level) {
+            typename V::value_type side = typename V::value_type(1) << level;
+            for(unsigned int w=0; w < (1u << N); ++w) {
+                unsigned int s = subcube(w, e, d);
+                V c = p;
+                for(int k=0; k<N; ++k) {
+                    if(s & (1u << k)) { c[k] += side; }
+                }
+                size_t n = countInside(c, side);
+                if(i < n) {
+                    p = c;
+                    descend(w, e, d);
+                    break;
+                }
+                i -= n;
+            }
+        }
+        return p;
+    }
+
+    size_t curveIndex(V x) const {
+        size_t i = 0;
+        V p;
+        unsigned int e = 0;
+        int d = 0;
+        for(int level=levels_-1; level>=0; --level) {
+            typename V::value_type side = typename V::value_type(1) << level;
+            for(unsigned int w=0; w < (1u << N); ++w) {
+                unsigned int s = subcube(w, e, d);
+                V c = p;
+                bool contains = true;
+                for(int k=0; k<N; ++k) {
+                    if(s & (1u << k)) { c[k] += side; }
+                    contains = contains && x[k] >= c[k] && x[k] < c[k]+side;
+                }
+                if(contains) {
+                    p = c;
+                    descend(w, e, d);
+                    break;
+                }
+                i += countInside(c, side);
+            }
+        }
+        return i;
+    }
+
+    /**
+     * rotate the N-bit number 'x' left by 'r'
+     */
+    static unsigned int rotl(unsigned int x, int r) {
+        const unsigned int mask = (1u << N) - 1;
+        r %= N;
+        return ((x << r) | (x >> (N-r))) & mask;
+    }
+
+    static int trailingSetBits(unsigned int x) {
+        int n = 0;
+        while(x & 1u) { ++n; x >>= 1; }
+        return n;
     }
 
     Roi<N> roi_;
     V blockShape_;
     V overlap_;
+    BlockOrder order_;
 
-    std::vector< std::pair<V, Roi<N> > > blocks_;
+    V first_;
+    V gridShape_;
+    size_t numBlocks_;
+    int levels_;
 };
 
 } /* namespace BW */
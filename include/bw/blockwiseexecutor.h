@@ -0,0 +1,267 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_BLOCKWISEEXECUTOR_H
+#define BW_BLOCKWISEEXECUTOR_H
+
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
+#include <bw/blocking.h>
+
+namespace BW {
+
+/**
+ * Runs a blockwise operation over all blocks of a Blocking
+ * as a bounded pipeline on several threads.
+ *
+ * The operation 'op' passed to run() has to provide
+ *
+ *   typedef ... Data;  //default constructible, holds the state of one block
+ *   void read(size_t i, const Roi<N>& roi, Data& d);
+ *   void compute(size_t i, const Roi<N>& roi, Data& d);
+ *   void write(size_t i, const Roi<N>& roi, Data& d);
+ *
+ * where 'i' is the index of the block in the Blocking (see Blocking::block()).
+ *
+ * read() is called for one block at a time in block order, write() is
+ * called for one block at a time in block order, so that Sources
+ * and Sinks need not be thread safe and the output is deterministic.
+ * compute() is called concurrently for different blocks.
+ *
+ * At most maxInFlight() blocks are between read() and the end
+ * of write() at any time, which bounds the memory usage.
+ */
+template<int N>
+class BlockwiseExecutor {
+    public:
+
+    BlockwiseExecutor(const Blocking<N>& blocking)
+        : blocking_(blocking)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
+        , maxInFlight_(0)
+        , verbose_(true)
+    {}
+
+    /**
+     * number of worker threads (default: number of cores)
+     */
+    void setNumThreads(int n) {
+        vigra_precondition(n > 0, "number of threads must be > 0");
+        numThreads_ = n;
+    }
+    int numThreads() const { return numThreads_; }
+
+    /**
+     * maximal number of blocks held in memory at the same time
+     * (default: 0, meaning twice the number of threads)
+     */
+    void setMaxInFlight(size_t n) { maxInFlight_ = n; }
+    size_t maxInFlight() const { return maxInFlight_ > 0 ? maxInFlight_ : 2*numThreads_; }
+
+    /**
+     * whether to print progress
+     */
+    void setVerbose(bool verbose) { verbose_ = verbose; }
+
+    template<class Op>
+    void run(Op& op) {
+        Run<Op> r(op, blocking_, maxInFlight(), verbose_);
+        if(numThreads_ == 1) {
+            r.work();
+        }
+        else {
+            boost::thread_group threads;
+            for(int t=0; t<numThreads_; ++t) {
+                threads.create_thread(boost::bind(&Run<Op>::work, &r));
+            }
+            threads.join_all();
+        }
+        if(verbose_ && blocking_.numBlocks() > 0) {
+            std::cout << std::endl;
+        }
+        if(r.failed) {
+            throw std::runtime_error(r.error);
+        }
+    }
+
+    private:
+
+    /**
+     * state of one execution of run()
+     *
+     * Every worker thread reads the next block (serialized by readMutex),
+     * computes it, and queues it for writing. A block is written as soon as
+     * all previous blocks have been written, by whichever thread queued
+     * the last missing block.
+     */
+    template<class Op>
+    struct Run {
+        typedef typename Op::Data Data;
+        typedef boost::shared_ptr<Data> DataPtr;
+
+        Run(Op& op, const Blocking<N>& blocking, size_t maxInFlight, bool verbose)
+            : op(op), blocking(blocking), maxInFlight(maxInFlight), verbose(verbose)
+            , nextRead(0), nextWrite(0), inFlight(0), writing(false), failed(false)
+        {}
+
+        void work() {
+            try {
+                while(true) {
+                    size_t i;
+                    Roi<N> roi;
+                    DataPtr d(new Data);
+                    {
+                        boost::unique_lock<boost::mutex> lock(mutex);
+                        while(!failed && nextRead < blocking.numBlocks() && inFlight >= maxInFlight) {
+                            changed.wait(lock);
+                        }
+                        if(failed || nextRead >= blocking.numBlocks()) { return; }
+                        ++inFlight;
+                    }
+                    {
+                        boost::lock_guard<boost::mutex> lock(readMutex);
+                        {
+                            //several workers may have passed the check above
+                            //for the last block; only one of them gets it
+                            boost::lock_guard<boost::mutex> lock2(mutex);
+                            if(nextRead >= blocking.numBlocks()) {
+                                --inFlight;
+                                changed.notify_all();
+                                return;
+                            }
+                            i = nextRead++;
+                        }
+                        roi = blocking.block(i).second;
+                        op.read(i, roi, *d);
+                    }
+
+                    op.compute(i, roi, *d);
+
+                    {
+                        boost::unique_lock<boost::mutex> lock(mutex);
+                        done[i] = d;
+                        if(writing) { continue; }
+                        writing = true;
+                    }
+                    writeQueued();
+                }
+            }
+            catch(const std::exception& e) {
+                fail(e.what());
+            }
+            catch(...) {
+                fail("unknown error");
+            }
+        }
+
+        /**
+         * write all queued blocks that are next in order
+         */
+        void writeQueued() {
+            while(true) {
+                size_t i;
+                DataPtr d;
+                {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    typename std::map<size_t, DataPtr>::iterator it = done.find(nextWrite);
+                    if(failed || it == done.end()) {
+                        writing = false;
+                        return;
+                    }
+                    i = it->first;
+                    d = it->second;
+                    done.erase(it);
+                }
+                if(verbose) {
+                    std::cout << "  block " << i+1 << "/" << blocking.numBlocks() << "        \r" << std::flush;
+                }
+                try {
+                    op.write(i, blocking.block(i).second, *d);
+                }
+                catch(...) {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    writing = false;
+                    throw;
+                }
+                d.reset();
+                {
+                    boost::lock_guard<boost::mutex> lock(mutex);
+                    ++nextWrite;
+                    --inFlight;
+                }
+                changed.notify_all();
+            }
+        }
+
+        void fail(const std::string& msg) {
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                if(!failed) {
+                    failed = true;
+                    error = msg;
+                }
+            }
+            changed.notify_all();
+        }
+
+        Op& op;
+        const Blocking<N>& blocking;
+        size_t maxInFlight;
+        bool verbose;
+
+        boost::mutex mutex;
+        boost::mutex readMutex;
+        boost::condition_variable changed;
+        size_t nextRead;
+        size_t nextWrite;
+        size_t inFlight;
+        bool writing;
+        std::map<size_t, DataPtr> done;
+
+        bool failed;
+        std::string error;
+    };
+
+    Blocking<N> blocking_;
+    int numThreads_;
+    size_t maxInFlight_;
+    bool verbose_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_BLOCKWISEEXECUTOR_H */
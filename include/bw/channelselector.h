@@ -33,9 +33,73 @@
 #include <bw/source.h>
 #include <bw/sink.h>
 #include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
 
 namespace BW {
 
+/**
+ * Source which selects channel 'channel' along axis 'dim'
+ * of the blocks read from 'source' on demand.
+ */
+template<int N, class T>
+class ChannelSelectorSource : public Source<N-1, T> {
+    public:
+    typedef typename Source<N-1, T>::V V;
+
+    ChannelSelectorSource(Source<N,T>* source, int dim, int channel)
+        : Source<N-1, T>()
+        , source_(source)
+        , dim_(dim)
+        , channel_(channel)
+    {
+        vigra_precondition(dim >= 0 && dim < N, "invalid axis");
+        vigra_precondition(channel >= 0 && channel < source->shape()[dim], "invalid channel");
+    }
+
+    virtual void setRoi(Roi<N-1> roi) {
+        roi_ = roi;
+    }
+
+    virtual V shape() const {
+        V ret = Roi<N>(typename Roi<N>::V(), source_->shape()).removeAxis(dim_).shape();
+        if(roi_ != Roi<N-1>()) {
+            Roi<N-1> in(V(), ret);
+            Roi<N-1> out;
+            in.intersect(roi_, out);
+            return out.shape();
+        }
+        return ret;
+    }
+
+    virtual V chunkShape() const {
+        return Roi<N>(typename Roi<N>::V(), source_->chunkShape()).removeAxis(dim_).shape();
+    }
+
+    virtual bool readBlock(Roi<N-1> roi, vigra::MultiArrayView<N-1, T>& block) const {
+        if(roi_ != Roi<N-1>()) {
+            roi += roi_.p;
+            Roi<N-1> newRoi;
+            roi_.intersect(roi, newRoi);
+            roi = newRoi;
+        }
+        vigra_precondition(roi.shape() == block.shape(), "shapes differ");
+
+        Roi<N> newRoi = roi.insertAxisBefore(dim_, channel_, channel_+1);
+        vigra::MultiArray<N, T> inBlock(newRoi.shape());
+        if(!source_->readBlock(newRoi, inBlock)) {
+            return false;
+        }
+        block.copy(inBlock.bindAt(dim_, 0));
+        return true;
+    }
+
+    private:
+    Source<N,T>* source_;
+    int dim_;
+    int channel_;
+    Roi<N-1> roi_;
+};
+
 /**
  *  channel selector.
  *
@@ -50,12 +114,12 @@ class ChannelSelector {
     ChannelSelector(Source<N,T>* source, V blockShape)
         : blockShape_(blockShape)
         , source_(source)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
     {
     }
 
     void run(int dim, int channel, Sink<N-1, T>* sink) {
         using namespace vigra;
-        using std::vector;
 
         //read input shape
         typename Roi<N>::V sh = source_->shape();
@@ -79,27 +143,50 @@ class ChannelSelector {
 
         sink->setShape(shape_);
 
-        int blockNum = 0;
-        vector<typename Blocking<N-1>::Pair> blocks = blocking_.blocks();
-        for(int i=0; i<blocks.size(); ++i) {
-            const Roi<N-1>& roi = blocks[i].second;
+        Op op(source_, sink, dim, channel);
+        BlockwiseExecutor<N-1> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
+    }
 
-            std::cout << "  block " << i+1 << "/" << blocks.size() << "        \r" << std::flush;
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
 
+    private:
+
+    struct Op {
+        struct Data {
+            vigra::MultiArray<N, T> inBlock;
+        };
+
+        Op(Source<N,T>* source, Sink<N-1,T>* sink, int dim, int channel)
+            : source(source), sink(sink), dim(dim), channel(channel)
+        {}
+
+        void read(size_t, const Roi<N-1>& roi, Data& d) {
             Roi<N> newRoi = roi.insertAxisBefore(dim, channel, channel+1);
-            MultiArray<N, T> inBlock(newRoi.q - newRoi.p);
-            source_->readBlock(newRoi, inBlock);
+            d.inBlock.reshape(newRoi.q - newRoi.p);
+            source->readBlock(newRoi, d.inBlock);
+        }
 
-            MultiArrayView<N-1, T> outBlock = inBlock.bindAt(dim, 0 /*newRoi has a singleton dim here*/);
+        void compute(size_t, const Roi<N-1>&, Data&) {}
+
+        void write(size_t, const Roi<N-1>& roi, Data& d) {
+            vigra::MultiArrayView<N-1, T> outBlock = d.inBlock.bindAt(dim, 0 /*newRoi has a singleton dim here*/);
             sink->writeBlock(roi, outBlock);
-            ++blockNum;
         }
-        std::cout << std::endl;
-    }
 
-    private:
+        Source<N,T>* source;
+        Sink<N-1,T>* sink;
+        int dim;
+        int channel;
+    };
+
     V blockShape_;
     Source<N,T>* source_;
+    int numThreads_;
     V shape_;
     Blocking<N-1> blocking_;
 };
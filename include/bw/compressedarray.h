@@ -103,6 +103,13 @@ class CompressedArray {
 
     static CompressedArray<N,T> readHDF5(hid_t group, const char* name);
 
+    /**
+     * construct a CompressedArray of shape 'shape' from the 'sizeBytes'
+     * bytes at 'data', as previously obtained from rawData()
+     */
+    static CompressedArray<N,T> fromRawData(V shape, bool isCompressed,
+                                            const char* data, size_t sizeBytes);
+
     void writeHDF5(hid_t group, const char* name) const;
 
     /**
@@ -186,6 +193,12 @@ class CompressedArray {
 
     V shape() const { return shape_; }
 
+    /**
+     * returns this array's data as currently stored (compressed or not),
+     * which is currentSizeBytes() long
+     */
+    const char* rawData() const { return reinterpret_cast<const char*>(data_); }
+
     private:
     T*                data_;
     size_t            compressedSize_;
@@ -287,6 +300,32 @@ bool CompressedArray<N,T>::operator==(
                       reinterpret_cast<char*>(other.data_));
 }
 
+template<int N, typename T>
+CompressedArray<N,T> CompressedArray<N,T>::fromRawData(
+    V shape,
+    bool isCompressed,
+    const char* data,
+    size_t sizeBytes
+) {
+    vigra_precondition(sizeBytes % sizeof(T) == 0, "size is not a multiple of sizeof(T)");
+
+    CompressedArray<N,T> ca;
+    ca.shape_ = shape;
+    ca.isCompressed_ = isCompressed;
+    ca.compressedSize_ = isCompressed ? sizeBytes/sizeof(T) : 0;
+    vigra_precondition(isCompressed || sizeBytes == ca.uncompressedSizeBytes(), "size does not match shape");
+
+    ca.data_ = new T[sizeBytes/sizeof(T)];
+    std::copy(data, data+sizeBytes, reinterpret_cast<char*>(ca.data_));
+
+    size_t n = 0;
+    for(int d=0; d<N; ++d) {
+        n += shape[d];
+    }
+    ca.dirtyDimensions_.resize(n);
+    return ca;
+}
+
 //==========================================================================//
 // dirtyness                                                                //
 //==========================================================================//
@@ -33,11 +33,18 @@
 #include <iostream>
 #include <algorithm>
 #include <numeric>
+#include <set>
 #include <cassert>
 
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
 
-#include <vigra/union_find.hxx>
 #include <vigra/multi_array.hxx>
 #include <vigra/labelvolume.hxx>
 #include <vigra/labelimage.hxx>
@@ -49,42 +56,13 @@
 #include <bw/sourcehdf5.h>
 #include <bw/sinkhdf5.h>
 #include <bw/compressedarray.h>
+#include <bw/runlabelling.h>
+#include <bw/hdf5dataset.h>
+#include <bw/hdf5mutex.h>
+#include <bw/threadpool.h>
 
 namespace BW {
 
-using vigra::detail::UnionFindArray;
-
-template<int N, class T>
-void blockMerge(
-    UnionFindArray<int>& ufd,
-    Roi<N> roi1,
-    T offset1,
-    const vigra::MultiArrayView<N,T>& block1,
-    Roi<N> roi2,
-    T offset2,
-    const vigra::MultiArrayView<N,T>& block2
-) {
-    typedef vigra::MultiArrayView<N,T> ArrayView;
-
-    Roi<N> intersection;
-    if(!roi1.intersect(roi2, intersection)) { return; }
-
-    ArrayView ov1 = block1.subarray(intersection.p - roi1.p, intersection.q -roi1.p);
-    ArrayView ov2 = block2.subarray(intersection.p - roi2.p, intersection.q -roi2.p);
-    if(ov1.shape() != ov2.shape()) { throw std::runtime_error("err"); }
-
-    typename ArrayView::iterator it1 = ov1.begin();
-    typename ArrayView::iterator it2 = ov2.begin();
-    for(; it1 != ov1.end(); ++it1, ++it2) {
-        int x = *it1+offset1;
-        int y = *it2+offset2;
-        //if(*it1 == 0) ufd.makeUnion(0,y);
-        //if(*it2 == 0) ufd.makeUnion(x,0);
-        ufd.makeUnion(x, y);
-    }
-}
-
-
 /**
  * Compute connected components either in 2D or 3D using 4 or 6 neighborhood.
  */
@@ -108,179 +86,1193 @@ struct ConnectedComponentsComputer<3,T,LabelType> {
 };
 
 /**
- * Compute connected components block-wise (less limited to RAM)
+ * UInt8 images and volumes (e.g. thresholded data) are labelled with the
+ * faster, run-based labelRuns(), which gives the same result.
+ */
+template<class LabelType>
+struct ConnectedComponentsComputer<2,vigra::UInt8,LabelType> {
+    static LabelType compute(const vigra::MultiArrayView<2,vigra::UInt8>& in, vigra::MultiArrayView<2,LabelType>& out) {
+        return labelRuns(in, out);
+    }
+};
+
+template<class LabelType>
+struct ConnectedComponentsComputer<3,vigra::UInt8,LabelType> {
+    static LabelType compute(const vigra::MultiArrayView<3,vigra::UInt8>& in, vigra::MultiArrayView<3,LabelType>& out) {
+        return labelRuns(in, out);
+    }
+};
+
+/**
+ * Size, bounding box, center and intensity sum of an object, accumulated
+ * pixel by pixel and merged over the blocks it spans.
  */
 template<int N>
-class ConnectedComponents {
+struct ObjectStatistics {
+    typedef typename Roi<N>::V V;
+
+    ObjectStatistics() : count(0), intensitySum(0.0) {}
+
+    void add(const V& x, double intensity) {
+        for(int k=0; k<N; ++k) {
+            if(count == 0 || x[k] < boundingBox.p[k])  { boundingBox.p[k] = x[k]; }
+            if(count == 0 || x[k] >= boundingBox.q[k]) { boundingBox.q[k] = x[k]+1; }
+            coordinateSum[k] += x[k];
+        }
+        ++count;
+        intensitySum += intensity;
+    }
+
+    void merge(const ObjectStatistics& other) {
+        if(other.count == 0) { return; }
+        for(int k=0; k<N; ++k) {
+            if(count == 0 || other.boundingBox.p[k] < boundingBox.p[k]) { boundingBox.p[k] = other.boundingBox.p[k]; }
+            if(count == 0 || other.boundingBox.q[k] > boundingBox.q[k]) { boundingBox.q[k] = other.boundingBox.q[k]; }
+        }
+        count += other.count;
+        coordinateSum += other.coordinateSum;
+        intensitySum += other.intensitySum;
+    }
+
+    /** mean pixel coordinate */
+    vigra::TinyVector<double, N> center() const {
+        return coordinateSum / (double)count;
+    }
+
+    /** number of pixels */
+    size_t count;
+    /** [p, q) */
+    Roi<N> boundingBox;
+    vigra::TinyVector<double, N> coordinateSum;
+    double intensitySum;
+};
+
+/**
+ * Compute connected components block-wise (less limited to RAM)
+ *
+ * The blocks are labelled separately (overlapping by one pixel), and the
+ * labels of adjacent blocks are merged with a union find structure. Each
+ * face between two blocks is merged as soon as both are labelled, while
+ * other blocks are still being labelled.
+ *
+ * Within each block, the labels touching a face shared with a neighbouring
+ * block come first. Only these enter the union find structure; the
+ * remaining (interior) labels of a block are final up to an offset. The
+ * memory needed for merging therefore grows with the surface of the
+ * blocks, not with the number of provisional labels.
+ *
+ * The result is a Source: the blocks keep their provisional labels and are
+ * mapped to the final, contiguous labels whenever a region is read. The
+ * provisional labels are kept compressed in memory, or in a scratch file
+ * (see setScratchFile()).
+ *
+ * Optionally, statistics of the objects are accumulated in the same pass
+ * (see setStatistics()).
+ *
+ * 'LabelType' is the type of the labels, use vigra::UInt64 for volumes
+ * with more than 2^32 components per block or in total.
+ */
+template<int N, class LabelType = vigra::UInt32>
+class ConnectedComponents : public Source<N, LabelType> {
     public:
     typedef typename Roi<N>::V V;
 
-    typedef int LabelType;
+    typedef LabelType label_type;
 
     typedef CompressedArray<N,LabelType> Compressed;
 
-    ConnectedComponents(Source<N,vigra::UInt8>* blockProvider, V blockShape)
+    /**
+     * label 'blockProvider' blockwise, merging the blocks on 'numThreads'
+     * threads (0: one per core)
+     *
+     * The labelling is done by run(), or on the first access to the result.
+     */
+    ConnectedComponents(Source<N,vigra::UInt8>* blockProvider, V blockShape, int numThreads = 0)
         : blockProvider_(blockProvider)
         , blockShape_(blockShape)
+        , numThreads_(numThreads)
+        , numMerged_(0)
+        , numUnusedNodes_(0)
+        , maxLabel_(0)
+        , statisticsEnabled_(false)
+        , intensities_(0)
+        , statisticsDirty_(false)
+        , incremental_(false)
+        , hasRun_(false)
     {
-        using namespace vigra;
-        using std::vector;
-        using std::pair;
-
         //blocks are overlapping by 1 pixel in all directions
         V overlap; std::fill(overlap.begin(), overlap.end(), 1);
+        blocking_ = Blocking<N>( Roi<N>(V(), blockProvider->shape()), blockShape, overlap);
+    }
+
+    /**
+     * Stream the provisional labels of the blocks to the dataset 'hdf5group'
+     * of the file 'hdf5file' (which is replaced) instead of keeping them in
+     * memory. Only the faces between blocks (until the blocks are merged)
+     * and the label tables are kept in memory then.
+     *
+     * Has to be called before run().
+     */
+    void setScratchFile(const std::string& hdf5file, const std::string& hdf5group) {
+        vigra_precondition(!hasRun_, "setScratchFile() has to be called before run()");
+        scratch_.reset(new HDF5Dataset<N, LabelType>(hdf5file, hdf5group));
+    }
+
+    /**
+     * Keep the faces of the blocks and the label pairs merged between
+     * adjacent blocks after run(), so that update() can be used.
+     *
+     * Has to be called before run().
+     */
+    void setIncremental(bool incremental) {
+        vigra_precondition(!hasRun_, "setIncremental() has to be called before run()");
+        incremental_ = incremental;
+    }
+
+    /**
+     * Accumulate the statistics of each object while labelling (see
+     * statistics()), including the sum of 'intensities' over the object
+     * if given. 'intensities' must have the same shape as the input.
+     *
+     * Has to be called before run().
+     */
+    void setStatistics(bool enabled, Source<N,float>* intensities = 0) {
+        vigra_precondition(!hasRun_, "setStatistics() has to be called before run()");
+        vigra_precondition(!intensities || intensities->shape() == blockProvider_->shape(), "shapes do not match");
+        statisticsEnabled_ = enabled;
+        intensities_ = intensities;
+    }
+
+    bool statisticsEnabled() const { return statisticsEnabled_; }
+
+    /**
+     * statistics of the objects (see setStatistics()), indexed by label
+     * (entry 0 is unused)
+     */
+    const std::vector<ObjectStatistics<N> >& statistics() const {
+        vigra_precondition(statisticsEnabled_, "statistics() requires setStatistics(true)");
+        boost::lock_guard<boost::mutex> lock(runMutex_);
+        ConnectedComponents* self = const_cast<ConnectedComponents*>(this);
+        self->runImpl();
+        if(statisticsDirty_) {
+            self->assembleStatistics();
+        }
+        return statistics_;
+    }
+
+    /**
+     * Write the statistics of the objects to 'filename', with one row per
+     * label (row 0 is the background): "count" (uint64), "boundingBoxMin",
+     * "boundingBoxMax" (exclusive), "regionCenter" and, if intensities
+     * were given, "intensitySum" and "mean" (double).
+     */
+    void writeStatistics(const std::string& filename) const {
+        const std::vector<ObjectStatistics<N> >& stats = statistics();
+        const vigra::MultiArrayIndex n = stats.size();
+        const vigra::Shape1 shape(n);
+
+        std::cout << "write object statistics to " << filename << std::endl;
+        HDF5Lock lock;
+        vigra::HDF5File f(filename, vigra::HDF5File::Open);
+        {
+            vigra::MultiArray<1, vigra::UInt64> count(shape);
+            for(vigra::MultiArrayIndex i=0; i<n; ++i) { count(i) = stats[i].count; }
+            f.write("count", count);
+        }
+        {
+            vigra::MultiArray<2, float> bbMin(vigra::Shape2(n, N));
+            vigra::MultiArray<2, float> bbMax(vigra::Shape2(n, N));
+            vigra::MultiArray<2, float> regionCenter(vigra::Shape2(n, N));
+            for(vigra::MultiArrayIndex i=0; i<n; ++i) {
+                if(stats[i].count == 0) { continue; }
+                for(int k=0; k<N; ++k) {
+                    bbMin(i, k) = stats[i].boundingBox.p[k];
+                    bbMax(i, k) = stats[i].boundingBox.q[k];
+                    regionCenter(i, k) = stats[i].center()[k];
+                }
+            }
+            f.write("boundingBoxMin", bbMin);
+            f.write("boundingBoxMax", bbMax);
+            f.write("regionCenter", regionCenter);
+        }
+        if(intensities_) {
+            vigra::MultiArray<1, double> sum(shape);
+            vigra::MultiArray<1, double> mean(shape);
+            for(vigra::MultiArrayIndex i=0; i<n; ++i) {
+                sum(i) = stats[i].intensitySum;
+                mean(i) = stats[i].count > 0 ? stats[i].intensitySum / stats[i].count : 0;
+            }
+            f.write("intensitySum", sum);
+            f.write("mean", mean);
+        }
+        f.close();
+    }
+
+    /**
+     * label the blocks and merge them (if not done yet)
+     */
+    void run() {
+        boost::lock_guard<boost::mutex> lock(runMutex_);
+        runImpl();
+    }
+
+    /**
+     * The input has changed within 'roi': relabel only the blocks touching
+     * 'roi' and recompute the label pairs on their faces. The union find
+     * structure and the statistics are kept between calls: only the
+     * components which contained a face label of these blocks, or which
+     * touch them now, are dissolved and merged again. Their labels are
+     * reused; if there are fewer components than before, the components
+     * with the largest labels are moved into the gaps, so that the labels
+     * stay contiguous. The interior labels of the blocks after the first
+     * changed one are shifted if the number of components changes. Once
+     * most nodes of the union find structure belong to labellings which
+     * have been replaced, it is compacted and all components are numbered
+     * again (see rebuildLabelTable()).
+     *
+     * Requires setIncremental(true). Waits for running calls of
+     * readBlock() and writeResult(), which in turn wait for the update to
+     * finish.
+     */
+    void update(Roi<N> roi) {
+        boost::lock_guard<boost::mutex> lock(runMutex_);
+        boost::unique_lock<boost::shared_mutex> writeLock(resultMutex_);
+        vigra_precondition(incremental_, "update() requires setIncremental(true)");
+        if(!hasRun_) {
+            runImpl();
+            return;
+        }
+
+        //blocks whose roi (including the overlap) intersects 'roi'
+        std::vector<size_t> changed;
+        V first, last;
+        for(int k=0; k<N; ++k) {
+            first[k] = roi.p[k] > 0 ? (roi.p[k]-1) / blockShape_[k] : 0;
+            last[k]  = std::min((roi.q[k]-1) / blockShape_[k], blocking_.gridShape()[k]-1);
+            if(roi.q[k] <= roi.p[k] || first[k] > last[k]) { return; }
+        }
+        V c = first;
+        while(true) {
+            const size_t i = blocking_.indexOf(c);
+            Roi<N> isect;
+            if(blocking_.block(i).second.intersect(roi, isect)) {
+                changed.push_back(i);
+            }
+            int k = 0;
+            for(; k<N; ++k) {
+                if(c[k] < last[k]) { ++c[k]; break; }
+                c[k] = first[k];
+            }
+            if(k == N) { break; }
+        }
+        std::cout << "* update " << changed.size() << " of " << blocking_.numBlocks() << " blocks" << std::endl;
+
+        //the faces of the changed blocks with their neighbours
+        std::vector<size_t> faces;
+        BOOST_FOREACH(size_t i, changed) {
+            const V x = blocking_.block(i).first;
+            for(int k=0; k<N; ++k) {
+                V y = x; --y[k];
+                if(blocking_.containsBlock(y)) { faces.push_back(blocking_.indexOf(y)*N + k); }
+                y = x; ++y[k];
+                if(blocking_.containsBlock(y)) { faces.push_back(i*N + k); }
+            }
+        }
+        std::sort(faces.begin(), faces.end());
+        faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+
+        //dissolve the components of the old face labels of the changed
+        //blocks; these labels become unused nodes, the other members are
+        //merged again below
+        std::set<LabelType> freed;
+        boost::unordered_set<size_t> members;
+        {
+            const boost::unordered_set<size_t> changedBlocks(changed.begin(), changed.end());
+            std::vector<size_t> roots;
+            BOOST_FOREACH(size_t i, changed) {
+                for(LabelType l=1; l<=numFaceLabels_[i]; ++l) {
+                    roots.push_back(findRoot(faceOffsets_[i]+l));
+                }
+            }
+            std::sort(roots.begin(), roots.end());
+            roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+            BOOST_FOREACH(size_t r, roots) {
+                freed.insert(faceTable_[r]);
+                std::vector<size_t> ring;
+                componentNodes(r, ring);
+                BOOST_FOREACH(size_t n, ring) {
+                    parent_[n] = n;
+                    next_[n] = n;
+                    if(changedBlocks.count(nodeBlock_[n])) {
+                        nodeBlock_[n] = NoBlock;
+                        ++numUnusedNodes_;
+                    }
+                    else {
+                        members.insert(n);
+                    }
+                }
+            }
+        }
+
+        ThreadPool pool(numThreads_);
+        labelBlocks(changed, pool);
+        const size_t firstNewNode = parent_.size();
+        BOOST_FOREACH(size_t i, changed) {
+            addNodes(i);
+        }
+        faceTable_.resize(parent_.size(), 0);
+
+        //merge the remaining members along the unchanged faces of their
+        //blocks, and the faces of the changed blocks
+        std::vector<size_t> memberFaces;
+        BOOST_FOREACH(size_t n, members) {
+            const V x = blocking_.block(nodeBlock_[n]).first;
+            for(int k=0; k<N; ++k) {
+                V y = x; --y[k];
+                if(blocking_.containsBlock(y)) { memberFaces.push_back(blocking_.indexOf(y)*N + k); }
+                y = x; ++y[k];
+                if(blocking_.containsBlock(y)) { memberFaces.push_back(nodeBlock_[n]*N + k); }
+            }
+        }
+        std::sort(memberFaces.begin(), memberFaces.end());
+        memberFaces.erase(std::unique(memberFaces.begin(), memberFaces.end()), memberFaces.end());
+        {
+            TaskGroup tasks(pool);
+            BOOST_FOREACH(size_t f, memberFaces) {
+                if(std::binary_search(faces.begin(), faces.end(), f)) { continue; }
+                tasks.run(boost::bind(&ConnectedComponents::mergeEdges, this, f, &members));
+            }
+            BOOST_FOREACH(size_t f, faces) {
+                tasks.run(boost::bind(&ConnectedComponents::findAndMergeEdges, this, f));
+            }
+            tasks.wait();
+        }
+
+        //the components to number: those of the members, of the new face
+        //labels, and the untouched ones which the new faces joined
+        std::vector<size_t> seeds(members.begin(), members.end());
+        for(size_t n=firstNewNode; n<parent_.size(); ++n) {
+            seeds.push_back(n);
+        }
+        BOOST_FOREACH(size_t f, faces) {
+            const size_t i = f/N;
+            V y = blocking_.block(i).first; ++y[f%N];
+            const size_t j = blocking_.indexOf(y);
+            typedef std::pair<LabelType, LabelType> Edge;
+            BOOST_FOREACH(const Edge& e, edges_[f]) {
+                const size_t ends[2] = { faceOffsets_[i]+e.first, faceOffsets_[j]+e.second };
+                for(int s=0; s<2; ++s) {
+                    if(ends[s] < firstNewNode && !members.count(ends[s])) {
+                        freed.insert(faceTable_[ends[s]]);
+                        seeds.push_back(ends[s]);
+                    }
+                }
+            }
+        }
+        std::vector<size_t> roots;
+        BOOST_FOREACH(size_t n, seeds) {
+            roots.push_back(findRoot(n));
+        }
+        std::sort(roots.begin(), roots.end());
+        roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+        BOOST_FOREACH(size_t r, roots) {
+            LabelType label;
+            if(!freed.empty()) {
+                label = *freed.begin();
+                freed.erase(freed.begin());
+            }
+            else {
+                label = ++numMerged_;
+            }
+            setComponentLabel(r, label);
+        }
+
+        //fill the gaps with the components with the largest labels
+        while(!freed.empty()) {
+            const LabelType largest = numMerged_--;
+            if(freed.count(largest)) {
+                freed.erase(largest);
+                continue;
+            }
+            const LabelType gap = *freed.begin();
+            freed.erase(freed.begin());
+            if(statisticsEnabled_) {
+                faceStatistics_[gap] = faceStatistics_[largest];
+            }
+            setComponentLabel(labelNodes_[largest], gap, false);
+        }
+        labelNodes_.resize(numMerged_+1);
+        if(statisticsEnabled_) {
+            faceStatistics_.resize(numMerged_+1);
+        }
+
+        numberInteriorLabels();
+        statisticsDirty_ = statisticsEnabled_;
+
+        //compact the nodes once most of them are unused
+        if(numUnusedNodes_ > parent_.size()/2) {
+            rebuildLabelTable(pool);
+        }
+    }
+
+    /**
+     * largest label of the result (labels are contiguous, 0 is background)
+     */
+    LabelType maxLabel() const {
+        ensureRun();
+        return maxLabel_;
+    }
+
+    virtual void setRoi(Roi<N> roi) {
+        roi_ = roi;
+    }
+
+    virtual V shape() const {
+        V ret = blockProvider_->shape();
+        if(roi_ != Roi<N>()) {
+            Roi<N> in(V(), ret);
+            Roi<N> out;
+            in.intersect(roi_, out);
+            return out.shape();
+        }
+        return ret;
+    }
+
+    virtual V chunkShape() const {
+        return blockShape_;
+    }
+
+    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,LabelType>& block) const {
+        if(roi_ != Roi<N>()) {
+            roi += roi_.p;
+            Roi<N> newRoi;
+            roi_.intersect(roi, newRoi);
+            roi = newRoi;
+        }
+        vigra_precondition(roi.shape() == block.shape(), "shapes differ");
+        ensureRun();
+        boost::shared_lock<boost::shared_mutex> readLock(resultMutex_);
+        readResult(roi, block);
+        return true;
+    }
+
+    /**
+     * Write the result to 'sink', one block at a time. Each pixel is
+     * written exactly once (the overlap of the blocks is not written).
+     */
+    void writeResult(Sink<N, LabelType>* sink) {
+        run();
+        const V shape = blockProvider_->shape();
+        sink->setShape(shape);
+        if(sink->blockShape() == V()) {
+            sink->setBlockShape(blockShape_);
+        }
+        Blocking<N> cores(Roi<N>(V(), shape), blockShape_);
+        vigra::MultiArray<N,LabelType> cc;
+        boost::shared_lock<boost::shared_mutex> readLock(resultMutex_);
+        for(size_t i=0; i<cores.numBlocks(); ++i) {
+            std::cout << "  block " << i+1 << "/" << cores.numBlocks() << "        \r" << std::flush;
+            const Roi<N> roi = cores.block(i).second;
+            cc.reshape(roi.shape());
+            readResult(roi, cc);
+            sink->writeBlock(roi, cc);
+        }
+        std::cout << std::endl;
+    }
+
+    void writeResult(const std::string& hdf5file, const std::string& hdf5group, int compression = 1) {
+        vigra_precondition(compression >= 1 && compression <= 9, "compression must be >= 1 and <= 9");
+        SinkHDF5<N, LabelType> sink(hdf5file, hdf5group, compression);
+        sink.setBlockShape(blockShape_);
+        writeResult(&sink);
+        sink.close();
+    }
+
+    private:
+
+    void ensureRun() const {
+        boost::lock_guard<boost::mutex> lock(runMutex_);
+        const_cast<ConnectedComponents*>(this)->runImpl();
+    }
+
+    void runImpl() {
+        if(hasRun_) { return; }
+
+        const size_t numBlocks = blocking_.numBlocks();
+        faces_.resize(numBlocks);
+        numFaceLabels_.assign(numBlocks, 0);
+        maxLabels_.assign(numBlocks, 0);
+        faceOffsets_.assign(numBlocks, 0);
+        parent_.assign(1, 0);
+        next_.assign(1, 0);
+        nodeBlock_.assign(1, NoBlock);
+        if(statisticsEnabled_) {
+            blockStatistics_.resize(numBlocks);
+        }
+        if(scratch_) {
+            std::cout << "* scratch file " << scratch_->filename() << "/" << scratch_->path() << std::endl;
+            scratch_->create(blockProvider_->shape(), blockShape_, 1);
+        }
+        else {
+            ccBlocks_.resize(numBlocks);
+        }
 
         //
-        // run connected components on each block separately
+        // run connected components on each block separately and merge the
+        // label pairs on the faces between adjacent blocks as soon as both
+        // blocks of a face are labelled
         //
+        //face i*N+k is the one between block i and its forward neighbour
+        //along axis k
+        std::cout << "* run connected components on each of " << numBlocks << " blocks separately" << std::endl;
+        edges_.resize(numBlocks*N);
+        ThreadPool pool(numThreads_);
+        std::vector<size_t> blocks(numBlocks);
+        for(size_t i=0; i<numBlocks; ++i) { blocks[i] = i; }
+        labelBlocks(blocks, pool, true);
 
-        Blocking<N> blocking( Roi<N>(V(), blockProvider->shape()), blockShape, overlap);
-        blockRois_ = blocking.blocks();
-        vector<LabelType> offsets(blockRois_.size()+1);
-        ccBlocks_.resize(blockRois_.size());
+        numberComponents();
+        if(statisticsEnabled_) {
+            assembleStatistics();
+        }
+        if(!incremental_) {
+            faces_.clear();
+            edges_.clear();
+            blockStatistics_.clear();
+            std::vector<size_t>().swap(parent_);
+            std::vector<size_t>().swap(next_);
+            std::vector<size_t>().swap(nodeBlock_);
+            std::vector<size_t>().swap(labelNodes_);
+            faceStatistics_.clear();
+        }
+        hasRun_ = true;
+    }
 
-        std::cout << "* run connected components on each of " << blockRois_.size() << " blocks separately" << std::endl;
+    struct LabellingProgress {
+        LabellingProgress() : blocksDone(0), sizeBytes(0), sizeBytesUncompressed(0), mergeFaces(false) {}
+        boost::mutex mutex;
+        //the blocks are labelled concurrently, but the Sources and the
+        //scratch file need not be thread safe, so all I/O is serialized
+        boost::mutex ioMutex;
+        size_t blocksDone;
+        size_t sizeBytes;
+        size_t sizeBytesUncompressed;
+        //if the faces are merged while labelling: which blocks are
+        //labelled, and how many faces of each block are not merged yet
+        bool mergeFaces;
+        std::vector<bool> labelled;
+        std::vector<int> pendingFaces;
+    };
 
-        size_t sizeBytes = 0;
-        size_t sizeBytesUncompressed = 0;
+    /**
+     * Label the 'blocks' concurrently on 'pool'. Their labels are numbered
+     * from 1 within each block.
+     *
+     * If 'mergeFaces', the face labels of the blocks are added to the
+     * union find structure, and each face between two of the 'blocks' is
+     * merged as soon as both are labelled (see mergeFace()), so that the
+     * faces need not be kept until all blocks are labelled.
+     */
+    void labelBlocks(const std::vector<size_t>& blocks, ThreadPool& pool, bool mergeFaces = false) {
+        LabellingProgress progress;
+        if(mergeFaces) {
+            progress.mergeFaces = true;
+            progress.labelled.assign(blocking_.numBlocks(), false);
+            progress.pendingFaces.assign(blocking_.numBlocks(), 0);
+            BOOST_FOREACH(size_t i, blocks) {
+                const V x = blocking_.block(i).first;
+                for(int k=0; k<N; ++k) {
+                    V y = x; ++y[k];
+                    if(blocking_.containsBlock(y)) {
+                        ++progress.pendingFaces[i];
+                        ++progress.pendingFaces[blocking_.indexOf(y)];
+                    }
+                }
+            }
+        }
+        {
+            TaskGroup tasks(pool);
+            BOOST_FOREACH(size_t i, blocks) {
+                tasks.run(boost::bind(&ConnectedComponents::labelBlock, this, i,
+                                      blocks.size(), boost::ref(progress)));
+            }
+            tasks.wait();
+        }
+        std::cout << std::endl;
+        if(!scratch_) {
+            std::cout << "  " << progress.sizeBytes/(1024.0*1024.0) << " MB (vs. " << progress.sizeBytesUncompressed/(1024.0*1024.0) << "MB uncompressed)" << std::endl;
+        }
+    }
 
-        for(size_t i=0; i<blockRois_.size(); ++i) {
-            std::cout << "  block " << i+1 << "/" << blockRois_.size() << " (#components: " << offsets[i] << ", curr compressed size: " << sizeBytes/(1024.0*1024.0) << " MB)                  \r" << std::flush;
-            Roi<N>& block = blockRois_[i].second;
-            //std::cout << "  - CC on block " << block << std::endl;
+    /**
+     * Label block 'i' (with labels 1..maxLabels_[i], face labels first),
+     * save its faces and store its labels compressed or in the scratch file.
+     */
+    void labelBlock(size_t i, size_t numBlocks, LabellingProgress& progress) {
+        using namespace vigra;
 
-            //int maxLabel = vigra::labelVolumeWithBackground(
-            //    vigra::srcMultiArrayRange( labels_.subarray(block.p, block.q) ),
-            //    vigra::destMultiArray( ccBlocks[i] ), vigra::NeighborCode3DSix(), 0);
+        const typename Blocking<N>::Pair b = blocking_.block(i);
+        const Roi<N>& block = b.second;
 
-            MultiArray<N, vigra::UInt8> inBlock(block.q-block.p);
+        const Roi<N> core = coreRoi(b.first);
+        MultiArray<N, vigra::UInt8> inBlock(block.q-block.p);
+        MultiArray<N, float> intensities;
+        {
+            boost::lock_guard<boost::mutex> lock(progress.ioMutex);
             blockProvider_->readBlock(block, inBlock);
+            if(statisticsEnabled_ && intensities_) {
+                intensities.reshape(core.shape());
+                intensities_->readBlock(core, intensities);
+            }
+        }
 
-            MultiArray<N, LabelType> cc(block.q-block.p);
+        MultiArray<N, LabelType> cc(block.q-block.p);
 
-            LabelType maxLabel = ConnectedComponentsComputer<N, vigra::UInt8, LabelType>::compute(inBlock, cc);
-            //LabelType maxLabel = vigra::labelImageWithBackground(
-            //    inBlock,
-            //    cc,
-            //    false /*use 4-neighbors*/,
-            //    0 /*bg label*/);
+        maxLabels_[i] = ConnectedComponentsComputer<N, vigra::UInt8, LabelType>::compute(inBlock, cc);
+        numFaceLabels_[i] = sortFaceLabelsFirst(b.first, cc, maxLabels_[i]);
+        if(progress.mergeFaces) {
+            addNodes(i);
+        }
 
-            //ccBlocks_[i] = cc;
+        saveFaces(i, b.first, cc);
 
+        if(statisticsEnabled_) {
+            accumulateStatistics(i, core, cc, intensities);
+        }
+
+        size_t sizeBytes = 0;
+        size_t sizeBytesUncompressed = 0;
+        if(scratch_) {
+            //only the block without its overlap is needed later
+            boost::lock_guard<boost::mutex> lock(progress.ioMutex);
+            scratch_->writeBlock(block.p, cc.subarray(V(), core.shape()));
+        }
+        else {
             ccBlocks_[i] = Compressed(cc);
             ccBlocks_[i].compress();
+            sizeBytes = ccBlocks_[i].currentSizeBytes();
+            sizeBytesUncompressed = ccBlocks_[i].uncompressedSizeBytes();
+        }
 
-            sizeBytes += ccBlocks_[i].currentSizeBytes();
-            sizeBytesUncompressed += ccBlocks_[i].uncompressedSizeBytes();
+        //the faces shared with neighbours which are already labelled
+        std::vector<size_t> ready;
+        {
+            boost::lock_guard<boost::mutex> lock(progress.mutex);
+            ++progress.blocksDone;
+            progress.sizeBytes += sizeBytes;
+            progress.sizeBytesUncompressed += sizeBytesUncompressed;
+            std::cout << "  block " << progress.blocksDone << "/" << numBlocks << " (curr compressed size: " << progress.sizeBytes/(1024.0*1024.0) << " MB)                  \r" << std::flush;
 
-            offsets[i+1] = offsets[i] + maxLabel + 1;
+            if(progress.mergeFaces) {
+                progress.labelled[i] = true;
+                for(int k=0; k<N; ++k) {
+                    V y = b.first; --y[k];
+                    if(blocking_.containsBlock(y) && progress.labelled[blocking_.indexOf(y)]) {
+                        ready.push_back(blocking_.indexOf(y)*N + k);
+                    }
+                    y = b.first; ++y[k];
+                    if(blocking_.containsBlock(y) && progress.labelled[blocking_.indexOf(y)]) {
+                        ready.push_back(i*N + k);
+                    }
+                }
+                if(progress.pendingFaces[i] == 0) {
+                    freeFaces(i);
+                }
+            }
         }
-        std::cout << std::endl;
-        std::cout << "  " << sizeBytes/(1024.0*1024.0) << " MB (vs. " << sizeBytesUncompressed/(1024.0*1024.0) << "MB uncompressed)" << std::endl;
+        BOOST_FOREACH(size_t f, ready) {
+            mergeFace(f, progress);
+        }
+    }
 
-        LabelType maxOffset = offsets[offsets.size()-1];
+    /**
+     * find and merge the label pairs of face 'f' (see runImpl()) and free
+     * the faces of its blocks once all their label pairs are known
+     */
+    void mergeFace(size_t f, LabellingProgress& progress) {
+        const size_t i = f/N;
+        V y = blocking_.block(i).first; ++y[f%N];
+        const size_t j = blocking_.indexOf(y);
 
-        std::cout << "  initialize union find datastructure with maxOffset = " << maxOffset << std::endl;
-        UnionFindArray<LabelType> ufd(maxOffset);
+        faceEdges(i, (int)(f%N));
+        mergeEdges(f);
 
-        //
-        // merge adjacent blocks
-        //
-        std::cout << "* merge adjacent blocks" << std::endl;
+        boost::lock_guard<boost::mutex> lock(progress.mutex);
+        if(--progress.pendingFaces[i] == 0) { freeFaces(i); }
+        if(--progress.pendingFaces[j] == 0) { freeFaces(j); }
+    }
 
-        //FIXME: use adjacency relation of blocks
-        std::vector< std::pair<size_t, size_t> > adjBlocks;
-        for(size_t i=0; i<blockRois_.size(); ++i) {
-            for(int j=i+1; j<blockRois_.size(); ++j) {
-                V bc1 = blockRois_[i].first;
-                V bc2 = blockRois_[j].first;
+    /**
+     * free the faces of block 'i', unless they are needed by update()
+     */
+    void freeFaces(size_t i) {
+        if(!incremental_) {
+            std::vector<Compressed>().swap(faces_[i]);
+        }
+    }
 
-                if(std::abs(vigra::squaredNorm(bc1-bc2)) == 1) {
-                    adjBlocks.push_back(std::make_pair(i,j));
-                }
+    /**
+     * add the face labels of block 'i' to the union find structure,
+     * as nodes faceOffsets_[i]+1 .. faceOffsets_[i]+numFaceLabels_[i]
+     */
+    void addNodes(size_t i) {
+        boost::lock_guard<boost::mutex> lock(mergeMutex_);
+        faceOffsets_[i] = parent_.size()-1;
+        for(LabelType l=1; l<=numFaceLabels_[i]; ++l) {
+            const size_t n = parent_.size();
+            parent_.push_back(n);
+            next_.push_back(n);
+            nodeBlock_.push_back(i);
+        }
+    }
+
+    size_t findRoot(size_t n) {
+        size_t r = n;
+        while(parent_[r] != r) { r = parent_[r]; }
+        while(parent_[n] != r) {
+            const size_t next = parent_[n];
+            parent_[n] = r;
+            n = next;
+        }
+        return r;
+    }
+
+    /**
+     * join the components of the nodes 'a' and 'b', including their rings
+     * of nodes (see componentNodes())
+     */
+    void makeUnion(size_t a, size_t b) {
+        a = findRoot(a);
+        b = findRoot(b);
+        if(a == b) { return; }
+        if(a < b) { parent_[b] = a; } else { parent_[a] = b; }
+        std::swap(next_[a], next_[b]);
+    }
+
+    /**
+     * the nodes of the component of node 'n': next_ links the nodes of
+     * each component to a ring
+     */
+    void componentNodes(size_t n, std::vector<size_t>& nodes) const {
+        nodes.clear();
+        size_t m = n;
+        do {
+            nodes.push_back(m);
+            m = next_[m];
+        } while(m != n);
+    }
+
+    /**
+     * Merge the label pairs of face 'f' (see runImpl()) in the union find
+     * structure, or only those whose first node is in 'only' (if given).
+     * The faces are merged concurrently: the pairs are found without a
+     * lock (see faceEdges()), and mergeMutex_ is taken once per face to
+     * add them.
+     */
+    void mergeEdges(size_t f, const boost::unordered_set<size_t>* only = 0) {
+        const size_t i = f/N;
+        V y = blocking_.block(i).first; ++y[f%N];
+        const size_t j = blocking_.indexOf(y);
+
+        typedef std::pair<LabelType, LabelType> Edge;
+        boost::lock_guard<boost::mutex> lock(mergeMutex_);
+        BOOST_FOREACH(const Edge& e, edges_[f]) {
+            const size_t a = faceOffsets_[i]+e.first;
+            if(only && !only->count(a)) { continue; }
+            makeUnion(a, faceOffsets_[j]+e.second);
+        }
+    }
+
+    void findAndMergeEdges(size_t f) {
+        faceEdges(f/N, (int)(f%N));
+        mergeEdges(f);
+    }
+
+    /**
+     * Renumber the nodes of the union find structure contiguously in block
+     * order, merge all faces again on 'pool' and number the components.
+     */
+    void rebuildLabelTable(ThreadPool& pool) {
+        parent_.assign(1, 0);
+        next_.assign(1, 0);
+        nodeBlock_.assign(1, NoBlock);
+        numUnusedNodes_ = 0;
+        for(size_t i=0; i<blocking_.numBlocks(); ++i) {
+            addNodes(i);
+        }
+        {
+            TaskGroup tasks(pool);
+            for(size_t f=0; f<edges_.size(); ++f) {
+                if(edges_[f].empty()) { continue; }
+                tasks.run(boost::bind(&ConnectedComponents::mergeEdges, this, f,
+                                      (const boost::unordered_set<size_t>*)0));
             }
+            tasks.wait();
         }
+        numberComponents();
+        statisticsDirty_ = statisticsEnabled_;
+    }
 
-        for(vector<pair<size_t, size_t> >::iterator it=adjBlocks.begin(); it!=adjBlocks.end(); ++it) {
-            std::cout << "  pair " << std::distance(adjBlocks.begin(), it)+1 << "/" << adjBlocks.size() << "        \r" << std::flush;
-            size_t i = it->first;
-            size_t j = it->second;
+    /**
+     * Number the merged face labels 1..numMerged_ in the order of the
+     * blocks (so that the labels do not depend on the order in which the
+     * blocks were merged), the interior labels of block i follow at
+     * numMerged_ + interiorOffsets_[i].
+     *
+     * Instead of relabelling all blocks, their provisional labels are kept
+     * and mapped to the final ones on read.
+     */
+    void numberComponents() {
+        std::cout << "  " << parent_.size()-1 << " face labels merged" << std::endl;
 
-            Roi<N>& block1 = blockRois_[i].second;
-            Roi<N>& block2 = blockRois_[j].second;
+        faceTable_.assign(parent_.size(), 0);
+        labelNodes_.assign(1, 0);
+        faceStatistics_.assign(statisticsEnabled_ ? 1 : 0, ObjectStatistics<N>());
+        numMerged_ = 0;
+        for(size_t i=0; i<blocking_.numBlocks(); ++i) {
+            for(LabelType l=1; l<=numFaceLabels_[i]; ++l) {
+                const size_t n = faceOffsets_[i]+l;
+                LabelType& root = faceTable_[findRoot(n)];
+                if(root == 0) {
+                    root = ++numMerged_;
+                    labelNodes_.push_back(n);
+                    if(statisticsEnabled_) {
+                        faceStatistics_.push_back(ObjectStatistics<N>());
+                    }
+                }
+                faceTable_[n] = root;
+                if(statisticsEnabled_) {
+                    faceStatistics_[root].merge(blockStatistics_[i][l]);
+                }
+            }
+        }
+        numberInteriorLabels();
+    }
 
-            //cc1 = ccBlocks_[i];
-            //cc2 = ccBlocks_[j];
-            MultiArray<N,LabelType> cc1(block1.q-block1.p);
-            MultiArray<N,LabelType> cc2(block2.q-block2.p);
-            ccBlocks_[i].readArray(cc1);
-            ccBlocks_[j].readArray(cc2);
+    /**
+     * the interior labels of the blocks follow the merged ones, in
+     * block order (prefix sums over the blocks)
+     */
+    void numberInteriorLabels() {
+        const size_t numBlocks = blocking_.numBlocks();
+        interiorOffsets_.assign(numBlocks+1, numMerged_);
+        for(size_t i=0; i<numBlocks; ++i) {
+            interiorOffsets_[i+1] = interiorOffsets_[i] + (maxLabels_[i] - numFaceLabels_[i]);
+        }
+        maxLabel_ = interiorOffsets_[numBlocks];
+        std::cout << "* " << maxLabel_ << " connected components" << std::endl;
+    }
 
-            blockMerge<N, LabelType>(ufd,
-                block1, offsets[i], cc1,
-                block2, offsets[j], cc2);
+    /**
+     * Give the component of node 'n' the final label 'label' and, if
+     * 'accumulate', sum up its statistics from its face labels.
+     */
+    void setComponentLabel(size_t n, LabelType label, bool accumulate = true) {
+        std::vector<size_t> nodes;
+        componentNodes(n, nodes);
+        if(label >= labelNodes_.size()) {
+            labelNodes_.resize(label+1);
         }
-        std::cout << std::endl;
+        labelNodes_[label] = n;
+        if(statisticsEnabled_ && accumulate) {
+            if(label >= faceStatistics_.size()) {
+                faceStatistics_.resize(label+1);
+            }
+            faceStatistics_[label] = ObjectStatistics<N>();
+        }
+        BOOST_FOREACH(size_t m, nodes) {
+            faceTable_[m] = label;
+            if(statisticsEnabled_ && accumulate) {
+                const size_t i = nodeBlock_[m];
+                faceStatistics_[label].merge(blockStatistics_[i][m-faceOffsets_[i]]);
+            }
+        }
+    }
 
-        LabelType maxLabel = ufd.makeContiguous();
+    /**
+     * the statistics of all objects, indexed by final label
+     */
+    void assembleStatistics() {
+        statistics_.assign(maxLabel_+1, ObjectStatistics<N>());
+        std::copy(faceStatistics_.begin(), faceStatistics_.end(), statistics_.begin());
+        for(size_t i=0; i<blocking_.numBlocks(); ++i) {
+            for(LabelType l=numFaceLabels_[i]+1; l<=maxLabels_[i]; ++l) {
+                statistics_[finalLabel(i, l)] = blockStatistics_[i][l];
+            }
+        }
+        statisticsDirty_ = false;
+    }
 
-        std::cout << "* relabel" << std::endl;
-        sizeBytes = 0;
-        sizeBytesUncompressed = 0;
-        for(size_t i=0; i<blockRois_.size(); ++i) {
-            std::cout << "  block " << i+1 << "/" << blockRois_.size() << "        \r" << std::flush;
-            Roi<N>& roi = blockRois_[i].second;
+    /**
+     * final label of the provisional label 'l' > 0 of block 'i'
+     */
+    LabelType finalLabel(size_t i, LabelType l) const {
+        return l <= numFaceLabels_[i] ? faceTable_[faceOffsets_[i] + l] : interiorOffsets_[i] + (l - numFaceLabels_[i]);
+    }
 
-            //MultiArray<N,LabelType> cc = ccBlocks_[i];
-            MultiArray<N,LabelType> cc(roi.q-roi.p); ccBlocks_[i].readArray(cc);
+    /**
+     * accumulate the statistics of the provisional labels of block 'i'
+     * (labelled 'cc') over its region 'core' without the overlap, with
+     * the 'intensities' of 'core' if intensities_ are given
+     */
+    void accumulateStatistics(size_t i, const Roi<N>& core, const vigra::MultiArray<N, LabelType>& cc,
+                              const vigra::MultiArray<N, float>& intensities) {
+        std::vector<ObjectStatistics<N> >& stats = blockStatistics_[i];
+        stats.assign(maxLabels_[i]+1, ObjectStatistics<N>());
 
-            LabelType offset = offsets[i];
+        const V shape = core.shape();
+        V c;
+        for(size_t j=0; j<core.size(); ++j) {
+            const LabelType l = cc[c];
+            if(l != 0) {
+                stats[l].add(core.p + c, intensities_ ? intensities[c] : 0.0);
+            }
+            for(int k=0; k<N; ++k) {
+                if(++c[k] < shape[k]) { break; }
+                c[k] = 0;
+            }
+        }
+    }
 
-            for(size_t j=0; j<cc.size(); ++j) { cc[j] = ufd[ cc[j]+offset ]; }
+    /**
+     * the block with coordinate 'x' without its overlap
+     */
+    Roi<N> coreRoi(V x) const {
+        const V shape = blockProvider_->shape();
+        Roi<N> core(x*blockShape_, x*blockShape_+blockShape_);
+        for(int k=0; k<N; ++k) {
+            core.q[k] = std::min(core.q[k], shape[k]);
+        }
+        return core;
+    }
 
-            //ccBlocks_[i] = cc;
-            ccBlocks_[i] = Compressed(cc);
-            ccBlocks_[i].compress();
-            sizeBytes += ccBlocks_[i].currentSizeBytes();
-            sizeBytesUncompressed += ccBlocks_[i].uncompressedSizeBytes();
+    /**
+     * Read the final labels of 'roi' (in coordinates of the whole volume)
+     * from each block (without its overlap) intersecting 'roi'.
+     * The caller holds a shared lock of resultMutex_.
+     */
+    template<class S>
+    void readResult(const Roi<N>& roi, vigra::MultiArrayView<N,LabelType,S> block) const {
+        if(roi.size() == 0) { return; }
+
+        V first, last;
+        for(int k=0; k<N; ++k) {
+            first[k] = roi.p[k] / blockShape_[k];
+            last[k]  = (roi.q[k]-1) / blockShape_[k];
         }
-        std::cout << std::endl;
-        std::cout << "  " << sizeBytes/(1024.0*1024.0) << " MB (vs. " << sizeBytesUncompressed/(1024.0*1024.0) << "MB uncompressed)" << std::endl;
+        V c = first;
+        vigra::MultiArray<N,LabelType> cc;
+        while(true) {
+            const size_t i = blocking_.indexOf(c);
+            Roi<N> isect;
+            coreRoi(c).intersect(roi, isect);
 
+            if(scratch_) {
+                cc.reshape(isect.shape());
+                scratch_->readBlock(isect.p, cc);
+                relabel(cc, block.subarray(isect.p-roi.p, isect.q-roi.p), i);
+            }
+            else {
+                const Roi<N> blockRoi = blocking_.block(i).second;
+                cc.reshape(blockRoi.shape());
+                ccBlocks_[i].readArray(cc);
+                relabel(cc.subarray(isect.p-blockRoi.p, isect.q-blockRoi.p),
+                        block.subarray(isect.p-roi.p, isect.q-roi.p), i);
+            }
+
+            int k = 0;
+            for(; k<N; ++k) {
+                if(c[k] < last[k]) { ++c[k]; break; }
+                c[k] = first[k];
+            }
+            if(k == N) { break; }
+        }
     }
 
-    void writeResult(const std::string& hdf5file, const std::string& hdf5group, int compression = 1) {
-        using namespace vigra;
+    /**
+     * map the provisional labels 'in' of block 'i' to the final labels
+     * 'out', row by row along the first axis
+     */
+    template<class S1, class S2>
+    void relabel(const vigra::MultiArrayView<N, LabelType, S1>& in,
+                 vigra::MultiArrayView<N, LabelType, S2> out, size_t i) const
+    {
+        vigra_precondition(in.shape() == out.shape(), "shapes differ");
+        if(in.size() == 0) { return; }
+        const LabelType* table = &faceTable_[faceOffsets_[i]];
+        const LabelType numFaceLabels = numFaceLabels_[i];
+        //interior label l (> numFaceLabels) becomes l + interiorOffset
+        const LabelType interiorOffset = interiorOffsets_[i] - numFaceLabels;
+        const vigra::MultiArrayIndex n = in.shape(0);
+        const vigra::MultiArrayIndex is = in.stride(0);
+        const vigra::MultiArrayIndex os = out.stride(0);
+        V c;
+        while(true) {
+            const LabelType* src = &in[c];
+            LabelType* dst = &out[c];
+            for(vigra::MultiArrayIndex x=0; x<n; ++x) {
+                const LabelType l = src[x*is];
+                dst[x*os] = l == 0 ? 0 : (l <= numFaceLabels ? table[l] : l + interiorOffset);
+            }
+            int k = 1;
+            for(; k<N; ++k) {
+                if(++c[k] < in.shape(k)) { break; }
+                c[k] = 0;
+            }
+            if(k == N) { break; }
+        }
+    }
 
-        vigra_precondition(compression >= 1 && compression <= 9, "compression must be >= 1 and <= 9");
+    /**
+     * Renumber the labels 1..'maxLabel' of the block with coordinate 'x'
+     * (labelled 'cc') such that the labels which occur on a face shared
+     * with a neighbouring block (see saveFaces()) come first, keeping
+     * their relative order. Returns the number of these face labels.
+     */
+    LabelType sortFaceLabelsFirst(V x, vigra::MultiArrayView<N, LabelType> cc, LabelType maxLabel) const {
+        std::vector<bool> onFace(maxLabel+1, false);
+        for(int k=0; k<N; ++k) {
+            for(int side=0; side<2; ++side) {
+                V y = x; y[k] += side == 0 ? -1 : 1;
+                if(!blocking_.containsBlock(y)) { continue; }
+                V p, q = cc.shape();
+                if(side == 0) { q[k] = 1; } else { p[k] = cc.shape(k)-1; }
+                vigra::MultiArrayView<N, LabelType> face = cc.subarray(p, q);
+                for(typename vigra::MultiArrayView<N, LabelType>::iterator it = face.begin(); it != face.end(); ++it) {
+                    onFace[*it] = true;
+                }
+            }
+        }
+        std::vector<LabelType> newLabel(maxLabel+1, 0);
+        LabelType numFaceLabels = 0;
+        for(LabelType l=1; l<=maxLabel; ++l) {
+            if(onFace[l]) { newLabel[l] = ++numFaceLabels; }
+        }
+        LabelType next = numFaceLabels;
+        for(LabelType l=1; l<=maxLabel; ++l) {
+            if(!onFace[l]) { newLabel[l] = ++next; }
+        }
+        if(numFaceLabels == maxLabel) { return numFaceLabels; }
+        for(typename vigra::MultiArrayView<N, LabelType>::iterator it = cc.begin(); it != cc.end(); ++it) {
+            *it = newLabel[*it];
+        }
+        return numFaceLabels;
+    }
 
-        std::cout << "* write " << hdf5file << "/" << hdf5group << std::endl;
-        HDF5File out(hdf5file, HDF5File::Open);
-        out.createDataset<N, LabelType>(hdf5group, blockProvider_->shape(), 0, blockShape_, compression);
-        for(size_t i=0; i<blockRois_.size(); ++i) {
-            std::cout << "  block " << i+1 << "/" << blockRois_.size() << "        \r" << std::flush;
-            const Roi<N>& roi = blockRois_[i].second;
+    /**
+     * Store the faces of block 'i' (labelled 'cc') which overlap with its
+     * neighbours: face 2*k is the first and face 2*k+1 the last slice
+     * along axis k. The merge phase only needs these faces, so it does
+     * not have to decompress the whole blocks.
+     */
+    void saveFaces(size_t i, V x, const vigra::MultiArrayView<N, LabelType>& cc) {
+        faces_[i].resize(2*N);
+        for(int k=0; k<N; ++k) {
+            V p, q = cc.shape();
+            V prev = x; --prev[k];
+            if(blocking_.containsBlock(prev)) {
+                q[k] = 1;
+                faces_[i][2*k] = Compressed(cc.subarray(p, q));
+                faces_[i][2*k].compress();
+            }
+            V next = x; ++next[k];
+            if(blocking_.containsBlock(next)) {
+                p[k] = cc.shape(k)-1;
+                q[k] = cc.shape(k);
+                faces_[i][2*k+1] = Compressed(cc.subarray(p, q));
+                faces_[i][2*k+1].compress();
+            }
+        }
+    }
 
-            //cc = ccBlocks_[i];
-            MultiArray<N,LabelType> cc(roi.q-roi.p);
-            ccBlocks_[i].readArray(cc);
+    /**
+     * Find the distinct pairs of (block-local) labels of block 'i' and its
+     * forward neighbour along 'axis' which coincide in the last slice of
+     * 'i' and the first one of the neighbour (see saveFaces()).
+     */
+    void faceEdges(size_t i, int axis) {
+        V y = blocking_.block(i).first; ++y[axis];
+        const size_t j = blocking_.indexOf(y);
 
-            out.writeBlock(hdf5group, roi.p, cc);
+        V faceShape = blocking_.block(i).second.shape();
+        faceShape[axis] = 1;
+        vigra::MultiArray<N,LabelType> face1(faceShape);
+        vigra::MultiArray<N,LabelType> face2(faceShape);
+        faces_[i][2*axis+1].readArray(face1);
+        faces_[j][2*axis].readArray(face2);
 
+        std::vector<std::pair<LabelType, LabelType> >& edges = edges_[i*N + axis];
+        edges.clear();
+        for(vigra::MultiArrayIndex k=0; k<face1.size(); ++k) {
+            //the background is never merged
+            if(face1[k] == 0) { continue; }
+            edges.push_back(std::make_pair(face1[k], face2[k]));
         }
-        std::cout << std::endl;
-        out.close();
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
     }
 
-    private:
     Source<N,vigra::UInt8>* blockProvider_;
     V blockShape_;
+    int numThreads_;
 
-    std::vector< std::pair<V, Roi<N> > > blockRois_;
-    //std::vector< vigra::MultiArray<N,LabelType> > ccBlocks_;
+    Blocking<N> blocking_;
+    //provisional labels of the blocks, if no scratch file is used
     std::vector< Compressed > ccBlocks_;
+    boost::shared_ptr<HDF5Dataset<N, LabelType> > scratch_;
+    //faces of each block and the label pairs to merge on the face
+    //i*N+k between block i and its forward neighbour along axis k;
+    //unless incremental_, the faces of a block are freed as soon as the
+    //pairs of all its faces are known, and the pairs once they are merged
+    std::vector< std::vector< Compressed > > faces_;
+    std::vector< std::vector< std::pair<LabelType, LabelType> > > edges_;
+
+    //Provisional label l of block i is a face label if
+    //l <= numFaceLabels_[i], it is node faceOffsets_[i] + l of the union
+    //find structure 'parent_' then, and its final label is faceTable_ of
+    //that node. Otherwise, the final label is
+    //interiorOffsets_[i] + l - numFaceLabels_[i].
+    //Each component of face labels has the final label 1..numMerged_,
+    //next_ links its nodes to a ring, and labelNodes_ gives one node of
+    //each label. nodeBlock_ is the block of a node (NoBlock for the nodes
+    //of blocks which have been labelled again by update()).
+    static const size_t NoBlock = static_cast<size_t>(-1);
+    std::vector<size_t> faceOffsets_;
+    std::vector<size_t> parent_;
+    std::vector<size_t> next_;
+    std::vector<size_t> nodeBlock_;
+    std::vector<size_t> labelNodes_;
+    LabelType numMerged_;
+    size_t numUnusedNodes_;
+    //guards parent_ and next_ while faces are merged concurrently
+    boost::mutex mergeMutex_;
+    std::vector<LabelType> numFaceLabels_;
+    std::vector<LabelType> maxLabels_;
+    std::vector<LabelType> interiorOffsets_;
+    std::vector<LabelType> faceTable_;
+    LabelType maxLabel_;
+    Roi<N> roi_;
+
+    bool statisticsEnabled_;
+    Source<N,float>* intensities_;
+    //statistics of the provisional labels of each block, of the merged
+    //face labels (by final label), and of all objects (assembled from
+    //these on demand after an update())
+    std::vector< std::vector<ObjectStatistics<N> > > blockStatistics_;
+    std::vector< ObjectStatistics<N> > faceStatistics_;
+    std::vector< ObjectStatistics<N> > statistics_;
+    bool statisticsDirty_;
+
+    bool incremental_;
+    bool hasRun_;
+    mutable boost::mutex runMutex_;
+    //held shared while the result is read, exclusively by update()
+    mutable boost::shared_mutex resultMutex_;
 };
 
+template<int N, class LabelType>
+const size_t ConnectedComponents<N, LabelType>::NoBlock;
+
 } /* namespace BW */
 
 #endif /* BW_CONNECTEDCOMPONENTS_H */
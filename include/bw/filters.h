@@ -0,0 +1,265 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_FILTERS_H
+#define BW_FILTERS_H
+
+#include <cmath>
+
+#include <vigra/multi_array.hxx>
+#include <vigra/multi_convolution.hxx>
+#include <vigra/multi_tensorutilities.hxx>
+
+#include <bw/source.h>
+#include <bw/sink.h>
+#include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
+
+namespace BW {
+
+/**
+ * Separable convolution filters supported by Filters
+ */
+enum FilterType {
+    /** Gaussian smoothing (1 channel) */
+    GaussianSmoothing,
+    /** magnitude of the Gaussian gradient (1 channel) */
+    GaussianGradientMagnitude,
+    /** eigenvalues of the Hessian of Gaussian, descending (N channels) */
+    HessianOfGaussianEigenvalues,
+    /** eigenvalues of the structure tensor, descending (N channels) */
+    StructureTensorEigenvalues
+};
+
+/**
+ *  convolution filters (not limited by RAM)
+ *
+ * Each block is read with a halo on all sides which covers the support of
+ * the filter, filtered as a whole, and only the block itself (without the
+ * halo) is written. The result is the same as filtering the whole volume
+ * at once (vigra's reflective border treatment applies at the volume
+ * border only).
+ *
+ * The result of filtering an N-dimensional volume is written to a Sink
+ * with N+1 dimensions, the last one being the channel axis.
+ *
+ * The memory used is bounded by the number of blocks in flight
+ * (see BlockwiseExecutor), each of which holds a block plus its halo.
+ */
+template<int N, class T>
+class Filters {
+    public:
+
+    typedef typename Roi<N>::V V;
+    typedef typename Roi<N+1>::V V1;
+
+    Filters(Source<N,T>* source, V blockShape)
+        : shape_(source->shape())
+        , blockShape_(blockShape)
+        , source_(source)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
+    {
+        vigra_precondition(shape_.size() == N, "dataset shape is wrong");
+
+        Roi<N> roi(V(), shape_);
+        Blocking<N> bb(roi, blockShape, V());
+        std::cout << "* Filters with " << bb.numBlocks() << " blocks of shape " << blockShape << std::endl;
+        blocking_ = bb;
+    }
+
+    /**
+     * number of output channels of 'filter'
+     */
+    static int numChannels(FilterType filter) {
+        return (filter == GaussianSmoothing || filter == GaussianGradientMagnitude) ? 1 : N;
+    }
+
+    /**
+     * Width of the halo needed around each block so that the result inside
+     * the block is not affected by the block border: the radius of the
+     * largest kernel vigra uses for 'filter' (3 sigma for smoothing,
+     * 3.5 sigma for first and 4 sigma for second derivatives), plus one
+     * pixel for rounding.
+     */
+    static int halo(FilterType filter, double scale, double outerScale = 0.0) {
+        switch(filter) {
+            case GaussianSmoothing:
+                return (int)std::ceil(3.0*scale) + 1;
+            case GaussianGradientMagnitude:
+                return (int)std::ceil(3.5*scale) + 1;
+            case HessianOfGaussianEigenvalues:
+                return (int)std::ceil(4.0*scale) + 1;
+            case StructureTensorEigenvalues:
+                return (int)std::ceil(3.5*scale + 3.0*outerScale) + 1;
+        }
+        return 0;
+    }
+
+    /**
+     * Applies 'filter' at 'scale' and writes the result to 'sink'.
+     *
+     * 'outerScale' is the integration scale of the structure tensor
+     * (default: 2*scale), it is ignored by the other filters.
+     *
+     * If 'sink' has no block shape, it is given the block shape used here.
+     */
+    void run(FilterType filter, double scale, Sink<N+1, float>* sink, double outerScale = 0.0) {
+        vigra_precondition(scale > 0.0, "scale must be > 0");
+        if(outerScale <= 0.0) {
+            outerScale = 2.0*scale;
+        }
+        const int c = numChannels(filter);
+        sink->setShape(Roi<N>(V(), shape_).appendAxis(0, c).shape());
+        if(sink->blockShape() == V1()) {
+            sink->setBlockShape(Roi<N>(V(), blockShape_).appendAxis(0, c).shape());
+        }
+
+        Op op(source_, sink, shape_, filter, scale, outerScale);
+        BlockwiseExecutor<N> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
+    }
+
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
+    private:
+
+    enum { NumTensorComponents = N*(N+1)/2 };
+
+    struct Op {
+        struct Data {
+            Roi<N> padded;
+            vigra::MultiArray<N, float> in;
+            vigra::MultiArray<N+1, float> out;
+        };
+
+        Op(Source<N,T>* source, Sink<N+1, float>* sink, V shape, FilterType filter, double scale, double outerScale)
+            : source(source), sink(sink), shape(shape), filter(filter), scale(scale), outerScale(outerScale)
+            , halo(Filters::halo(filter, scale, outerScale))
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            for(int k=0; k<N; ++k) {
+                d.padded.p[k] = std::max<typename V::value_type>(roi.p[k]-halo, 0);
+                d.padded.q[k] = std::min<typename V::value_type>(roi.q[k]+halo, shape[k]);
+            }
+            vigra::MultiArray<N, T> in(d.padded.shape());
+            source->readBlock(d.padded, in);
+            d.in.reshape(in.shape());
+            d.in = in;
+        }
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            //the block inside of the padded block
+            const V p = roi.p - d.padded.p;
+            const V q = roi.q - d.padded.p;
+            const int c = Filters::numChannels(filter);
+            d.out.reshape(Roi<N>(V(), roi.shape()).appendAxis(0, c).shape());
+
+            switch(filter) {
+                case GaussianSmoothing: {
+                    vigra::MultiArray<N, float> smoothed(d.in.shape());
+                    vigra::gaussianSmoothMultiArray(d.in, smoothed, scale);
+                    d.out.bindOuter(0).copy(smoothed.subarray(p, q));
+                    break;
+                }
+                case GaussianGradientMagnitude: {
+                    vigra::MultiArray<N, vigra::TinyVector<float, N> > gradient(d.in.shape());
+                    vigra::gaussianGradientMultiArray(d.in, gradient, scale);
+                    copyChannels(gradient.subarray(p, q), d.out, true);
+                    break;
+                }
+                case HessianOfGaussianEigenvalues: {
+                    vigra::MultiArray<N, vigra::TinyVector<float, NumTensorComponents> > hessian(d.in.shape());
+                    vigra::hessianOfGaussianMultiArray(d.in, hessian, scale);
+                    eigenvalues(hessian.subarray(p, q), d.out);
+                    break;
+                }
+                case StructureTensorEigenvalues: {
+                    vigra::MultiArray<N, vigra::TinyVector<float, NumTensorComponents> > tensor(d.in.shape());
+                    vigra::structureTensorMultiArray(d.in, tensor, scale, outerScale);
+                    eigenvalues(tensor.subarray(p, q), d.out);
+                    break;
+                }
+            }
+        }
+
+        void write(size_t, const Roi<N>& roi, Data& d) {
+            sink->writeBlock(roi.appendAxis(0, d.out.shape(N)), d.out);
+        }
+
+        template<class S>
+        static void eigenvalues(const vigra::MultiArrayView<N, vigra::TinyVector<float, NumTensorComponents>, S>& tensor,
+                                vigra::MultiArray<N+1, float>& out)
+        {
+            vigra::MultiArray<N, vigra::TinyVector<float, N> > ev(tensor.shape());
+            vigra::tensorEigenvaluesMultiArray(tensor, ev);
+            copyChannels(ev, out, false);
+        }
+
+        /**
+         * copy the vector valued 'in' to the channels of 'out',
+         * or its norm to the single channel of 'out' if 'norm' is true
+         */
+        template<int M, class S>
+        static void copyChannels(const vigra::MultiArrayView<N, vigra::TinyVector<float, M>, S>& in,
+                                 vigra::MultiArray<N+1, float>& out, bool norm)
+        {
+            typedef typename vigra::MultiArrayView<N, vigra::TinyVector<float, M>, S>::const_iterator InIter;
+            for(int c=0; c<out.shape(N); ++c) {
+                vigra::MultiArrayView<N, float, vigra::StridedArrayTag> channel = out.bindOuter(c);
+                typename vigra::MultiArrayView<N, float, vigra::StridedArrayTag>::iterator o = channel.begin();
+                for(InIter i = in.begin(); i != in.end(); ++i, ++o) {
+                    *o = norm ? std::sqrt(vigra::squaredNorm(*i)) : (*i)[c];
+                }
+            }
+        }
+
+        Source<N,T>* source;
+        Sink<N+1, float>* sink;
+        V shape;
+        FilterType filter;
+        double scale;
+        double outerScale;
+        int halo;
+    };
+
+    V shape_;
+    V blockShape_;
+    Blocking<N> blocking_;
+    Source<N,T>* source_;
+    int numThreads_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_FILTERS_H */
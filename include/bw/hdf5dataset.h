@@ -0,0 +1,617 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_HDF5DATASET_H
+#define BW_HDF5DATASET_H
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/locks.hpp>
+
+#include <vigra/multi_array.hxx>
+#include <vigra/hdf5impex.hxx>
+
+#include <bw/roi.h>
+#include <bw/threadpool.h>
+#include <bw/hdf5mutex.h>
+
+//raw chunk access (H5Dread_chunk, H5Dwrite_chunk, H5Dget_chunk_info_by_coord)
+//is available since HDF5 1.10.5
+#if defined(H5_VERSION_GE)
+#  if H5_VERSION_GE(1,10,5)
+#    define BW_HAVE_H5D_CHUNK_IO
+#  endif
+#endif
+
+namespace BW {
+
+/**
+ * Parameters of the HDF5 raw data chunk cache of a dataset
+ * (see H5Pset_chunk_cache).
+ */
+struct HDF5ChunkCache {
+    HDF5ChunkCache(size_t nbytes = 32*1024*1024, size_t nslots = 10007, double w0 = 0.75)
+        : nbytes(nbytes), nslots(nslots), w0(w0)
+    {}
+
+    /** total size of the cache in bytes */
+    size_t nbytes;
+    /** number of hash table slots, should be a prime number */
+    size_t nslots;
+    /** preemption policy: 0 preempts least recently used chunks first,
+     *  1 fully read or written chunks first */
+    double w0;
+};
+
+/**
+ * A dataset of dimension N and pixel type T in a HDF5 file.
+ *
+ * The file and the dataset are opened on first access and stay open until
+ * close() is called or the object is destroyed, so that the dataset's chunk
+ * cache is kept between accesses. All accesses are serialized by the
+ * process-wide hdf5Mutex(), as the HDF5 library is not thread safe.
+ */
+template<int N, class T>
+class HDF5Dataset {
+    public:
+    typedef typename Roi<N>::V V;
+    typedef boost::shared_ptr<vigra::HDF5Handle> HandlePtr;
+
+    HDF5Dataset(const std::string& hdf5file, const std::string& hdf5group)
+        : hdf5file_(hdf5file)
+        , hdf5group_(hdf5group)
+        , readWrite_(false)
+        , chunkInfoValid_(false)
+        , rawChunks_(false)
+        , deflateLevel_(Z_DEFAULT_COMPRESSION)
+    {}
+
+    ~HDF5Dataset() {
+        HDF5Lock lock;
+        closeImpl();
+    }
+
+    const std::string& filename() const { return hdf5file_; }
+    const std::string& path() const { return hdf5group_; }
+
+    /**
+     * set the chunk cache parameters (takes effect when the dataset is opened)
+     */
+    void setChunkCache(const HDF5ChunkCache& cache) {
+        HDF5Lock lock;
+        cache_ = cache;
+        closeImpl();
+    }
+    const HDF5ChunkCache& chunkCache() const { return cache_; }
+
+    /**
+     * create the dataset with given 'shape', 'chunkShape' and
+     * deflate 'compression' (replacing an existing dataset),
+     * and open it for writing
+     */
+    void create(V shape, V chunkShape, int compression) {
+        HDF5Lock lock;
+        closeImpl();
+        {
+            vigra::HDF5File out(hdf5file_, vigra::HDF5File::Open);
+            out.createDataset<N, T>(hdf5group_, shape, 0, chunkShape, compression);
+            out.close();
+        }
+        openImpl(true);
+    }
+
+    /**
+     * close file and dataset (they are reopened on the next access)
+     */
+    void close() {
+        HDF5Lock lock;
+        closeImpl();
+    }
+
+    bool isOpen() const { return dataset_.get() != 0; }
+
+    V shape() const {
+        HDF5Lock lock;
+        openImpl(false);
+        return shapeImpl();
+    }
+
+    /**
+     * shape of the chunks, or V() if the dataset is not chunked
+     */
+    V chunkShape() const {
+        HDF5Lock lock;
+        openImpl(false);
+        vigra::HDF5Handle plist(H5Dget_create_plist(*dataset_), &H5Pclose, "HDF5Dataset: cannot get property list");
+        V ret;
+        if(H5Pget_layout(plist) != H5D_CHUNKED) {
+            return ret;
+        }
+        hsize_t dims[N];
+        vigra_precondition(H5Pget_chunk(plist, N, dims) == N, "dataset shape is wrong");
+        for(int k=0; k<N; ++k) {
+            ret[k] = dims[N-1-k];
+        }
+        return ret;
+    }
+
+    /**
+     * read the block starting at 'p' with the shape of 'block' into 'block'
+     */
+    template<class S>
+    void readBlock(V p, vigra::MultiArrayView<N, T, S> block) const {
+        HDF5Lock lock;
+        openImpl(false);
+        HandlePtr fileSpace = selectFileSpace(p, block.shape());
+        HandlePtr memSpace = createMemSpace(block);
+        if(memSpace) {
+            check(H5Dread(*dataset_, vigra::detail::getH5DataType<T>(), *memSpace, *fileSpace, H5P_DEFAULT, block.data()));
+        }
+        else {
+            vigra::MultiArray<N, T> tmp(block.shape());
+            memSpace = createMemSpace(tmp);
+            check(H5Dread(*dataset_, vigra::detail::getH5DataType<T>(), *memSpace, *fileSpace, H5P_DEFAULT, tmp.data()));
+            block.copy(tmp);
+        }
+    }
+
+    /**
+     * write 'block' starting at 'p'
+     */
+    template<class S>
+    void writeBlock(V p, const vigra::MultiArrayView<N, T, S>& block) {
+        HDF5Lock lock;
+        openImpl(true);
+        writeBlockImpl(p, block);
+    }
+
+    /**
+     * Like readBlock, but reads the raw (compressed) chunks intersecting
+     * the block from the file and decodes them in parallel on 'pool',
+     * outside of the HDF5 library. The dataset is locked only while
+     * reading raw chunks.
+     *
+     * Falls back to readBlock if the dataset's data type differs from T
+     * or it uses filters other than deflate and shuffle
+     * (see canDecodeChunks()).
+     */
+    template<class S>
+    void readBlockParallel(V p, vigra::MultiArrayView<N, T, S> block, ThreadPool& pool) const {
+        if(!canDecodeChunks()) {
+            readBlock(p, block);
+            return;
+        }
+
+        //iterate over all chunks intersecting [p, p+block.shape())
+        V first, last;
+        for(int k=0; k<N; ++k) {
+            first[k] = p[k] / chunkShape_[k];
+            last[k]  = (p[k]+block.shape(k)-1) / chunkShape_[k];
+        }
+        TaskGroup tasks(pool);
+        V c = first;
+        while(true) {
+            tasks.run(boost::bind(&HDF5Dataset::template decodeChunk<S>, this, c*chunkShape_, p, block));
+            int k = 0;
+            for(; k<N; ++k) {
+                if(c[k] < last[k]) { ++c[k]; break; }
+                c[k] = first[k];
+            }
+            if(k == N) { break; }
+        }
+        tasks.wait();
+    }
+
+    /**
+     * Like writeBlock, but the chunks which are completely covered by the
+     * block (and lie completely inside of the dataset) are compressed in
+     * parallel on 'pool', outside of the HDF5 library, and written as raw
+     * chunks. The dataset is locked only while writing.
+     *
+     * The remaining parts of the block (chunks at the border of the block
+     * or the dataset) are written via writeBlock. Falls back to writeBlock
+     * entirely under the same conditions as readBlockParallel.
+     */
+    template<class S>
+    void writeBlockParallel(V p, const vigra::MultiArrayView<N, T, S>& block, ThreadPool& pool) {
+        if(!canEncodeChunks()) {
+            writeBlock(p, block);
+            return;
+        }
+
+        V first, last;
+        for(int k=0; k<N; ++k) {
+            first[k] = p[k] / chunkShape_[k];
+            last[k]  = (p[k]+block.shape(k)-1) / chunkShape_[k];
+        }
+        TaskGroup tasks(pool);
+        V c = first;
+        while(true) {
+            tasks.run(boost::bind(&HDF5Dataset::template encodeChunk<S>, this, c*chunkShape_, p, block));
+            int k = 0;
+            for(; k<N; ++k) {
+                if(c[k] < last[k]) { ++c[k]; break; }
+                c[k] = first[k];
+            }
+            if(k == N) { break; }
+        }
+        tasks.wait();
+    }
+
+    /**
+     * whether readBlockParallel() can decode the chunks of this dataset
+     */
+    bool canDecodeChunks() const {
+        HDF5Lock lock;
+        openImpl(false);
+        inspectChunksImpl();
+        return rawChunks_;
+    }
+
+    /**
+     * whether writeBlockParallel() can encode the chunks of this dataset
+     * (opens the dataset for writing)
+     */
+    bool canEncodeChunks() {
+        HDF5Lock lock;
+        openImpl(true);
+        inspectChunksImpl();
+        return rawChunks_;
+    }
+
+    /**
+     * handles of the open file and dataset (opened for reading if necessary).
+     * The caller has to serialize accesses by locking mutex().
+     */
+    hid_t fileHandle() const { openImpl(false); return *file_; }
+    hid_t datasetHandle() const { openImpl(false); return *dataset_; }
+    boost::recursive_mutex& mutex() const { return hdf5Mutex(); }
+
+    private:
+
+    V shapeImpl() const {
+        vigra::HDF5Handle space(H5Dget_space(*dataset_), &H5Sclose, "HDF5Dataset: cannot get dataspace");
+        vigra_precondition(H5Sget_simple_extent_ndims(space) == N, "dataset shape is wrong");
+        hsize_t dims[N];
+        H5Sget_simple_extent_dims(space, dims, NULL);
+        V ret;
+        for(int k=0; k<N; ++k) {
+            ret[k] = dims[N-1-k];
+        }
+        return ret;
+    }
+
+    template<class S>
+    void writeBlockImpl(V p, const vigra::MultiArrayView<N, T, S>& block) {
+        HandlePtr fileSpace = selectFileSpace(p, block.shape());
+        HandlePtr memSpace = createMemSpace(block);
+        if(memSpace) {
+            check(H5Dwrite(*dataset_, vigra::detail::getH5DataType<T>(), *memSpace, *fileSpace, H5P_DEFAULT, block.data()));
+        }
+        else {
+            vigra::MultiArray<N, T> tmp(block);
+            memSpace = createMemSpace(tmp);
+            check(H5Dwrite(*dataset_, vigra::detail::getH5DataType<T>(), *memSpace, *fileSpace, H5P_DEFAULT, tmp.data()));
+        }
+    }
+
+    void openImpl(bool readWrite) const {
+        if(dataset_ && (readWrite_ || !readWrite)) {
+            return;
+        }
+        closeImpl();
+
+        file_.reset(new vigra::HDF5Handle(
+            H5Fopen(hdf5file_.c_str(), readWrite ? H5F_ACC_RDWR : H5F_ACC_RDONLY, H5P_DEFAULT),
+            &H5Fclose, ("HDF5Dataset: cannot open file " + hdf5file_).c_str()));
+
+        vigra::HDF5Handle dapl(H5Pcreate(H5P_DATASET_ACCESS), &H5Pclose, "HDF5Dataset: cannot create property list");
+        H5Pset_chunk_cache(dapl, cache_.nslots, cache_.nbytes, cache_.w0);
+        dataset_.reset(new vigra::HDF5Handle(
+            H5Dopen(*file_, hdf5group_.c_str(), dapl),
+            &H5Dclose, ("HDF5Dataset: cannot open dataset " + hdf5group_).c_str()));
+        readWrite_ = readWrite;
+    }
+
+    void closeImpl() const {
+        dataset_.reset();
+        file_.reset();
+        chunkInfoValid_ = false;
+    }
+
+    /**
+     * determine whether the chunks can be decoded by decodeChunk()
+     * and encoded by encodeChunk(), and the information needed to do so
+     */
+    void inspectChunksImpl() const {
+        if(chunkInfoValid_) { return; }
+        chunkInfoValid_ = true;
+        rawChunks_ = false;
+#ifdef BW_HAVE_H5D_CHUNK_IO
+        vigra::HDF5Handle plist(H5Dget_create_plist(*dataset_), &H5Pclose, "HDF5Dataset: cannot get property list");
+        if(H5Pget_layout(plist) != H5D_CHUNKED) { return; }
+        hsize_t dims[N];
+        if(H5Pget_chunk(plist, N, dims) != N) { return; }
+        for(int k=0; k<N; ++k) {
+            chunkShape_[k] = dims[N-1-k];
+        }
+
+        vigra::HDF5Handle type(H5Dget_type(*dataset_), &H5Tclose, "HDF5Dataset: cannot get data type");
+        if(H5Tequal(type, vigra::detail::getH5DataType<T>()) <= 0) { return; }
+
+        filters_.clear();
+        const int numFilters = H5Pget_nfilters(plist);
+        for(int i=0; i<numFilters; ++i) {
+            unsigned int flags, config;
+            unsigned int cdValues[8];
+            size_t numCdValues = 8;
+            char name[64];
+            H5Z_filter_t f = H5Pget_filter2(plist, i, &flags, &numCdValues, cdValues, sizeof(name), name, &config);
+            if(f != H5Z_FILTER_DEFLATE && f != H5Z_FILTER_SHUFFLE) { return; }
+            if(f == H5Z_FILTER_DEFLATE) {
+                deflateLevel_ = numCdValues > 0 ? (int)cdValues[0] : Z_DEFAULT_COMPRESSION;
+            }
+            filters_.push_back(f);
+        }
+
+        datasetShape_ = shapeImpl();
+        fillValue_ = T();
+        H5D_fill_value_t fillStatus;
+        if(H5Pfill_value_defined(plist, &fillStatus) >= 0 && fillStatus != H5D_FILL_VALUE_UNDEFINED) {
+            H5Pget_fill_value(plist, vigra::detail::getH5DataType<T>(), &fillValue_);
+        }
+        rawChunks_ = true;
+#endif
+    }
+
+    /**
+     * read the raw chunk starting at 'chunkStart' (with the lock held),
+     * decode it (without the lock) and copy its intersection with the
+     * block starting at 'p' into 'block'
+     */
+    template<class S>
+    void decodeChunk(V chunkStart, V p, vigra::MultiArrayView<N, T, S> block) const {
+#ifdef BW_HAVE_H5D_CHUNK_IO
+        std::vector<char> raw;
+        uint32_t filterMask = 0;
+        bool allocated = false;
+        {
+            HDF5Lock lock;
+            hsize_t offset[N];
+            for(int k=0; k<N; ++k) {
+                offset[k] = chunkStart[N-1-k];
+            }
+            //chunks which have not been written have no address
+            unsigned int mask = 0;
+            haddr_t address = HADDR_UNDEF;
+            hsize_t nbytes = 0;
+            check(H5Dget_chunk_info_by_coord(*dataset_, offset, &mask, &address, &nbytes));
+            allocated = address != HADDR_UNDEF && nbytes > 0;
+            if(allocated) {
+                raw.resize(nbytes);
+                check(H5Dread_chunk(*dataset_, H5P_DEFAULT, offset, &filterMask, &raw[0]));
+            }
+        }
+
+        Roi<N> isect;
+        Roi<N>(chunkStart, chunkStart+chunkShape_).intersect(Roi<N>(p, p+block.shape()), isect);
+        vigra::MultiArrayView<N, T, S> out = block.subarray(isect.p-p, isect.q-p);
+        if(!allocated) {
+            out.init(fillValue_);
+            return;
+        }
+
+        const size_t chunkBytes = Roi<N>(V(), chunkShape_).size()*sizeof(T);
+        std::vector<char> decoded;
+        //filters are undone in reverse order; bit i of 'filterMask'
+        //is set if filter i has been skipped for this chunk
+        for(int i=(int)filters_.size()-1; i>=0; --i) {
+            if(filterMask & (1u << i)) { continue; }
+            decoded.resize(chunkBytes);
+            if(filters_[i] == H5Z_FILTER_DEFLATE) {
+                uLongf destLen = chunkBytes;
+                if(uncompress(reinterpret_cast<Bytef*>(&decoded[0]), &destLen,
+                              reinterpret_cast<const Bytef*>(&raw[0]), raw.size()) != Z_OK || destLen != chunkBytes)
+                {
+                    throw std::runtime_error("HDF5Dataset: cannot inflate chunk");
+                }
+            }
+            else {
+                vigra_precondition(raw.size() == chunkBytes, "HDF5Dataset: wrong chunk size");
+                unshuffle(&raw[0], &decoded[0], chunkBytes);
+            }
+            raw.swap(decoded);
+        }
+        vigra_precondition(raw.size() == chunkBytes, "HDF5Dataset: wrong chunk size");
+
+        vigra::MultiArrayView<N, T> chunk(chunkShape_, reinterpret_cast<T*>(&raw[0]));
+        out.copy(chunk.subarray(isect.p-chunkStart, isect.q-chunkStart));
+#endif
+    }
+
+    /**
+     * Write the part of 'block' (starting at 'p') inside of the chunk
+     * starting at 'chunkStart'. If the block covers the whole chunk, it is
+     * encoded (without the lock) and written as a raw chunk, otherwise it
+     * is written through the HDF5 library.
+     */
+    template<class S>
+    void encodeChunk(V chunkStart, V p, vigra::MultiArrayView<N, T, S> block) {
+        Roi<N> chunkRoi(chunkStart, chunkStart+chunkShape_);
+        Roi<N> isect;
+        chunkRoi.intersect(Roi<N>(p, p+block.shape()), isect);
+        vigra::MultiArrayView<N, T, S> in = block.subarray(isect.p-p, isect.q-p);
+
+        bool full = isect == chunkRoi;
+        for(int k=0; k<N; ++k) {
+            full = full && chunkRoi.q[k] <= datasetShape_[k];
+        }
+#ifdef BW_HAVE_H5D_CHUNK_IO
+        if(full) {
+            const size_t chunkBytes = Roi<N>(V(), chunkShape_).size()*sizeof(T);
+            std::vector<char> raw(chunkBytes);
+            vigra::MultiArrayView<N, T> chunk(chunkShape_, reinterpret_cast<T*>(&raw[0]));
+            chunk.copy(in);
+
+            std::vector<char> encoded;
+            for(size_t i=0; i<filters_.size(); ++i) {
+                if(filters_[i] == H5Z_FILTER_DEFLATE) {
+                    uLongf destLen = compressBound(raw.size());
+                    encoded.resize(destLen);
+                    if(compress2(reinterpret_cast<Bytef*>(&encoded[0]), &destLen,
+                                 reinterpret_cast<const Bytef*>(&raw[0]), raw.size(), deflateLevel_) != Z_OK)
+                    {
+                        throw std::runtime_error("HDF5Dataset: cannot deflate chunk");
+                    }
+                    encoded.resize(destLen);
+                }
+                else {
+                    encoded.resize(raw.size());
+                    shuffle(&raw[0], &encoded[0], raw.size());
+                }
+                raw.swap(encoded);
+            }
+
+            hsize_t offset[N];
+            for(int k=0; k<N; ++k) {
+                offset[k] = chunkStart[N-1-k];
+            }
+            HDF5Lock lock;
+            openImpl(true);
+            check(H5Dwrite_chunk(*dataset_, H5P_DEFAULT, 0, offset, raw.size(), &raw[0]));
+            return;
+        }
+#endif
+        HDF5Lock lock;
+        openImpl(true);
+        writeBlockImpl(isect.p, in);
+    }
+
+    /**
+     * apply the HDF5 shuffle filter (the inverse of unshuffle())
+     */
+    static void shuffle(const char* in, char* out, size_t nbytes) {
+        const size_t n = nbytes / sizeof(T);
+        for(size_t b=0; b<sizeof(T); ++b) {
+            for(size_t j=0; j<n; ++j) {
+                out[b*n+j] = in[j*sizeof(T)+b];
+            }
+        }
+        std::copy(in+n*sizeof(T), in+nbytes, out+n*sizeof(T));
+    }
+
+    /**
+     * undo the HDF5 shuffle filter, which stores the k-th bytes
+     * of all elements contiguously
+     */
+    static void unshuffle(const char* in, char* out, size_t nbytes) {
+        const size_t n = nbytes / sizeof(T);
+        for(size_t b=0; b<sizeof(T); ++b) {
+            for(size_t j=0; j<n; ++j) {
+                out[j*sizeof(T)+b] = in[b*n+j];
+            }
+        }
+        //trailing bytes are not shuffled
+        std::copy(in+n*sizeof(T), in+nbytes, out+n*sizeof(T));
+    }
+
+    HandlePtr selectFileSpace(V p, V shape) const {
+        HandlePtr space(new vigra::HDF5Handle(H5Dget_space(*dataset_), &H5Sclose, "HDF5Dataset: cannot get dataspace"));
+        hsize_t start[N], count[N];
+        for(int k=0; k<N; ++k) {
+            start[k] = p[N-1-k];
+            count[k] = shape[N-1-k];
+        }
+        check(H5Sselect_hyperslab(*space, H5S_SELECT_SET, start, NULL, count, NULL));
+        return space;
+    }
+
+    /**
+     * Describes the memory layout of 'a' as a hyperslab of a dataspace, so
+     * that HDF5 can read into (and write from) strided views directly.
+     * This is possible if each stride is a multiple of the previous one
+     * (which is the case for subarrays and bound views of an array).
+     *
+     * returns: a null pointer if the layout of 'a' cannot be described
+     */
+    template<class S>
+    static HandlePtr createMemSpace(const vigra::MultiArrayView<N, T, S>& a) {
+        //dimension N is the innermost one (stride of the first axis)
+        hsize_t dims[N+1], count[N+1], start[N+1];
+        for(int k=0; k<N; ++k) {
+            if(a.stride(k) <= 0) { return HandlePtr(); }
+        }
+        dims[N] = a.stride(0);
+        for(int k=0; k<N; ++k) {
+            hsize_t extent = (k == N-1) ? a.shape(k) : a.stride(k+1)/a.stride(k);
+            if(k < N-1 && (a.stride(k+1) % a.stride(k) != 0 || extent < (hsize_t)a.shape(k))) {
+                return HandlePtr();
+            }
+            dims[N-1-k] = extent;
+            count[N-1-k] = a.shape(k);
+            start[N-1-k] = 0;
+        }
+        count[N] = 1;
+        start[N] = 0;
+        HandlePtr space(new vigra::HDF5Handle(H5Screate_simple(N+1, dims, NULL), &H5Sclose, "HDF5Dataset: cannot create dataspace"));
+        check(H5Sselect_hyperslab(*space, H5S_SELECT_SET, start, NULL, count, NULL));
+        return space;
+    }
+
+    static void check(herr_t status) {
+        if(status < 0) {
+            throw std::runtime_error("HDF5Dataset: HDF5 error");
+        }
+    }
+
+    std::string hdf5file_;
+    std::string hdf5group_;
+    HDF5ChunkCache cache_;
+
+    mutable HandlePtr file_;
+    mutable HandlePtr dataset_;
+    mutable bool readWrite_;
+
+    //information needed to decode and encode the chunks (see inspectChunksImpl())
+    mutable bool chunkInfoValid_;
+    mutable bool rawChunks_;
+    mutable V chunkShape_;
+    mutable V datasetShape_;
+    mutable std::vector<H5Z_filter_t> filters_;
+    mutable int deflateLevel_;
+    mutable T fillValue_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_HDF5DATASET_H */
@@ -0,0 +1,72 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef BW_HDF5MUTEX_H
+#define BW_HDF5MUTEX_H
+
+#include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+namespace BW {
+
+/**
+ * Process-wide mutex serializing all calls into the HDF5 library.
+ *
+ * Unless built with --enable-threadsafe, libhdf5 must not be entered from
+ * several threads at the same time, not even for different files. All
+ * classes of this library that call HDF5 hold this mutex while doing so:
+ * HDF5Dataset (and thus SourceHDF5 and SinkHDF5), HDF5RowWriter,
+ * HDF5OutputFile (and thus MeshExtractor), and the vigra::HDF5File output
+ * of ConnectedComponents and RegionFeatures. Code that calls HDF5 directly while
+ * these may be in use has to hold it as well (see HDF5Lock). It is
+ * recursive, so that it may be held while calling into these classes.
+ */
+inline boost::recursive_mutex& hdf5Mutex() {
+    static boost::recursive_mutex mutex;
+    return mutex;
+}
+
+/**
+ * holds hdf5Mutex() for the lifetime of the object
+ */
+class HDF5Lock {
+    public:
+    HDF5Lock() : lock_(hdf5Mutex()) {}
+
+    private:
+    HDF5Lock(const HDF5Lock&);
+    HDF5Lock& operator=(const HDF5Lock&);
+
+    boost::lock_guard<boost::recursive_mutex> lock_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_HDF5MUTEX_H */
@@ -0,0 +1,205 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef BW_HDF5ROWWRITER_H
+#define BW_HDF5ROWWRITER_H
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <vigra/hdf5impex.hxx>
+
+#include <bw/hdf5mutex.h>
+
+namespace BW {
+
+/**
+ * Writes a 2D HDF5 dataset of 'columns' values per row incrementally.
+ *
+ * The dataset is created extendable along the rows and chunked by
+ * 'chunkRows' rows. Appended rows are buffered until a chunk is full,
+ * so that memory is bounded by one chunk regardless of the number of rows.
+ *
+ * The layout is that of a (rows x columns) vigra::MultiArray written with
+ * vigra::HDF5File, i.e. the HDF5 dimensions are (columns, rows).
+ *
+ * All HDF5 calls hold hdf5Mutex(), so that rows can be written while
+ * e.g. a SourceHDF5 is read on another thread.
+ */
+template<class T>
+class HDF5RowWriter {
+    public:
+
+    /**
+     * create the dataset 'name' in 'location' (replacing an existing one)
+     */
+    HDF5RowWriter(hid_t location, const std::string& name, size_t columns,
+                  size_t chunkRows = 4096, int compression = 0)
+        : columns_(columns)
+        , chunkRows_(chunkRows)
+        , rows_(0)
+    {
+        vigra_precondition(columns > 0 && chunkRows > 0, "HDF5RowWriter: empty rows or chunks");
+
+        HDF5Lock lock;
+        if(H5Lexists(location, name.c_str(), H5P_DEFAULT) > 0) {
+            check(H5Ldelete(location, name.c_str(), H5P_DEFAULT));
+        }
+
+        hsize_t dims[2]    = {columns, 0};
+        hsize_t maxdims[2] = {columns, H5S_UNLIMITED};
+        hsize_t chunks[2]  = {columns, chunkRows};
+        vigra::HDF5Handle space(H5Screate_simple(2, dims, maxdims), &H5Sclose, "HDF5RowWriter: cannot create dataspace");
+        vigra::HDF5Handle dcpl(H5Pcreate(H5P_DATASET_CREATE), &H5Pclose, "HDF5RowWriter: cannot create property list");
+        check(H5Pset_chunk(dcpl, 2, chunks));
+        if(compression > 0) {
+            check(H5Pset_deflate(dcpl, compression));
+        }
+        vigra::HDF5Handle lcpl(H5Pcreate(H5P_LINK_CREATE), &H5Pclose, "HDF5RowWriter: cannot create property list");
+        check(H5Pset_create_intermediate_group(lcpl, 1));
+        dataset_.reset(new vigra::HDF5Handle(
+            H5Dcreate(location, name.c_str(), vigra::detail::getH5DataType<T>(), space, lcpl, dcpl, H5P_DEFAULT),
+            &H5Dclose, ("HDF5RowWriter: cannot create dataset " + name).c_str()));
+
+        buffer_.reserve(chunkRows_*columns_);
+    }
+
+    ~HDF5RowWriter() {
+        try { close(); } catch(...) {}
+    }
+
+    /**
+     * append one row of 'columns' values
+     */
+    void append(const T* row) {
+        buffer_.insert(buffer_.end(), row, row+columns_);
+        if(buffer_.size() == chunkRows_*columns_) {
+            flush();
+        }
+    }
+
+    /**
+     * write the buffered rows to the dataset
+     */
+    void flush() {
+        if(buffer_.empty() || !dataset_) { return; }
+        HDF5Lock lock;
+        const hsize_t n = buffer_.size()/columns_;
+
+        //the buffer holds whole rows, the file stores whole columns
+        std::vector<T> columns(buffer_.size());
+        for(size_t i=0; i<n; ++i) {
+            for(size_t j=0; j<columns_; ++j) {
+                columns[j*n+i] = buffer_[i*columns_+j];
+            }
+        }
+
+        hsize_t dims[2] = {columns_, rows_+n};
+        check(H5Dset_extent(*dataset_, dims));
+
+        hsize_t offset[2] = {0, rows_};
+        hsize_t count[2]  = {columns_, n};
+        vigra::HDF5Handle fileSpace(H5Dget_space(*dataset_), &H5Sclose, "HDF5RowWriter: cannot get dataspace");
+        check(H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, offset, NULL, count, NULL));
+        vigra::HDF5Handle memSpace(H5Screate_simple(2, count, NULL), &H5Sclose, "HDF5RowWriter: cannot create dataspace");
+        check(H5Dwrite(*dataset_, vigra::detail::getH5DataType<T>(), memSpace, fileSpace, H5P_DEFAULT, &columns[0]));
+
+        rows_ += n;
+        buffer_.clear();
+    }
+
+    /**
+     * flush and close the dataset
+     */
+    void close() {
+        flush();
+        HDF5Lock lock;
+        dataset_.reset();
+    }
+
+    /**
+     * number of rows appended so far (including buffered ones)
+     */
+    size_t rows() const { return rows_ + buffer_.size()/columns_; }
+
+    private:
+    HDF5RowWriter(const HDF5RowWriter&);
+    HDF5RowWriter& operator=(const HDF5RowWriter&);
+
+    static void check(herr_t status) {
+        if(status < 0) {
+            throw std::runtime_error("HDF5RowWriter: HDF5 error");
+        }
+    }
+
+    size_t columns_;
+    size_t chunkRows_;
+    hsize_t rows_;
+    std::vector<T> buffer_;
+    boost::shared_ptr<vigra::HDF5Handle> dataset_;
+};
+
+/**
+ * A vigra::HDF5File to be written with HDF5RowWriters while other
+ * threads use HDF5 as well: hdf5Mutex() is only held while the file is
+ * opened and closed, not in between.
+ */
+class HDF5OutputFile : boost::noncopyable {
+    public:
+    HDF5OutputFile(const std::string& filename) {
+        HDF5Lock lock;
+        file_.reset(new vigra::HDF5File(filename, vigra::HDF5File::Open));
+    }
+
+    ~HDF5OutputFile() {
+        close();
+    }
+
+    hid_t handle() const {
+        return file_->getFileHandle();
+    }
+
+    void close() {
+        HDF5Lock lock;
+        file_.reset();
+    }
+
+    private:
+    boost::scoped_ptr<vigra::HDF5File> file_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_HDF5ROWWRITER_H */
@@ -30,14 +30,24 @@
 #ifndef BW_MESHEXTRACTOR_H
 #define BW_MESHEXTRACTOR_H
 
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <limits>
+
 #include <boost/unordered_map.hpp>
 #include <boost/unordered_set.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
 
 #include <vigra/hdf5impex.hxx>
 
 #include <bw/source.h>
 #include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
+#include <bw/hdf5rowwriter.h>
 
 typedef vigra::TinyVector<vigra::MultiArrayIndex, 3> Coor;
 
@@ -75,6 +85,27 @@ typedef boost::unordered_set<std::pair<size_t, size_t> > LinesSet;
 short normalOrientation(Coor tc);
 void cartesianCorners(Coor tc, std::vector<Coor>& corners);
 
+/**
+ * vertex IDs of the 4 corners of the face with (doubled) center 'tc';
+ * corners not yet in 'h' get the next consecutive ID
+ */
+inline void faceVertices(Coor tc, CoorMap& h, std::vector<Coor>& cornerPoints, std::vector<size_t>& face) {
+    cartesianCorners(tc, cornerPoints);
+    for(size_t m=0; m<4; ++m) {
+        const Coor& coor = cornerPoints[m];
+        CoorMap::const_iterator it = h.find(coor);
+        if(it == h.end()) {
+            const size_t id = h.size();
+            it = h.insert(std::make_pair(coor, id)).first;
+        }
+        face[m] = it->second;
+    }
+}
+
+/**
+ * extract the faces of the boundary of 'label'; 'faces' receives
+ * 4 vertex IDs per face
+ */
 template<class T>
 void
 extractMesh(
@@ -83,13 +114,11 @@ extractMesh(
     T label,
     CoorMap& h,
     LinesSet& lines,
-    std::vector<std::vector<size_t> >& faces
+    std::vector<size_t>& faces
 ) {
     using namespace vigra;
     
-    size_t n = 0;
     std::vector<Coor> cornerPoints(4);
-    std::vector<size_t> cornerIds(4);
     std::vector<size_t> face(4);
     
     const Coor offsets[3] = { Coor(1,0,0), Coor(0,1,0), Coor(0,0,1) };
@@ -111,33 +140,71 @@ extractMesh(
                     if( ! ((labels[c] == label && labels[d] != label) || (labels[d] == label && labels[c] != label) ) ) { continue; }
                 
                     Coor tc = (2*(c+offset) + 2*(d+offset))/2;
-                    cartesianCorners(tc, cornerPoints);
-                    
-                    //assign unique, consecutive vertex IDs 
-                    //to the corner points
-                    for(size_t m=0; m<4; ++m) {
-                        const Coor& coor = cornerPoints[m];
-                        const CoorMap::const_iterator it = h.find(coor);
-                        if(it == h.end()) {
-                            h[coor] = h.size()-1;
-                        }
-                    }
-                    //build line and face structures by referencing
+                    faceVertices(tc, h, cornerPoints, face);
+
+                    //build line structures by referencing
                     //the vertex IDs
                     for(size_t m=0; m<4; ++m) {
-                        size_t n = (m+1) % 4;
-                        const Coor& coor0 = cornerPoints[m];
-                        const Coor& coor1 = cornerPoints[n];
-                        
-                        size_t id0 = h.at(coor0);
-                        size_t id1 = h.at(coor1);
-                        
-                        face[m] = id0;
-                        
+                        size_t id0 = face[m];
+                        size_t id1 = face[(m+1) % 4];
                         if(id0 > id1) { std::swap(id0, id1); }
                         lines.insert( std::make_pair(id0, id1) );
                     }
-                    faces.push_back(face);
+                    faces.insert(faces.end(), face.begin(), face.end());
+                }
+            }
+        }
+    }
+}
+
+/**
+ * extract the faces between all pairs of different labels in one sweep;
+ * 'faces' receives 4 vertex IDs and 'faceLabels' the labels on both sides
+ * of each face.
+ * Labels not in 'whitelist' (if given) are treated as background (0).
+ */
+template<class T>
+void
+extractMultiLabelMesh(
+    const vigra::MultiArrayView<3, T>& labels,
+    Coor offset,
+    const boost::unordered_set<T>* whitelist,
+    CoorMap& h,
+    std::vector<size_t>& faces,
+    std::vector<std::pair<T, T> >& faceLabels
+) {
+    using namespace vigra;
+
+    std::vector<Coor> cornerPoints(4);
+    std::vector<size_t> face(4);
+
+    const Coor offsets[3] = { Coor(1,0,0), Coor(0,1,0), Coor(0,0,1) };
+
+    Coor c(0,0,0);
+    Coor d;
+    for(MultiArrayIndex i=0; i<labels.shape(0)-1; ++i) {
+        c[0] = i;
+        for(MultiArrayIndex j=0; j<labels.shape(1)-1; ++j) {
+            c[1] = j;
+            for(MultiArrayIndex k=0; k<labels.shape(2)-1; ++k) {
+                c[2] = k;
+
+                for(MultiArrayIndex l=0; l<3; ++l) {
+                    d = c + offsets[l];
+
+                    T a = labels[c];
+                    T b = labels[d];
+                    if(a == b) { continue; }
+                    if(whitelist) {
+                        if(a != 0 && whitelist->find(a) == whitelist->end()) { a = 0; }
+                        if(b != 0 && whitelist->find(b) == whitelist->end()) { b = 0; }
+                        if(a == b) { continue; }
+                    }
+
+                    Coor tc = (2*(c+offset) + 2*(d+offset))/2;
+                    faceVertices(tc, h, cornerPoints, face);
+                    faces.insert(faces.end(), face.begin(), face.end());
+                    faceLabels.push_back(std::make_pair(a, b));
                 }
             }
         }
@@ -148,6 +215,16 @@ extractMesh(
 
 namespace BW {
 
+/**
+ * Output layout of MeshExtractor::runMultiLabel()
+ */
+enum MeshOutput {
+    /** one mesh for all objects; 'faceLabels' gives the two labels of each face */
+    SharedMesh,
+    /** one mesh per object, in the group named after its label */
+    PerObjectMeshes
+};
+
 /**
  *  extract the mesh of an object's boundary (not limited by RAM)
  */
@@ -160,6 +237,9 @@ class MeshExtractor {
         : blockShape_(blockShape)
         , shape_(source->shape())
         , source_(source)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
+        , minSize_(0)
+        , chunkSize_(4096)
     {
         vigra_precondition(shape_.size() == N, "dataset shape is wrong");
 
@@ -169,77 +249,596 @@ class MeshExtractor {
         blocking_ = bb;
     }
 
+    /**
+     * extract the boundary of 'object' and write it to 'filename'
+     * (datasets "verts", "faces" and "lines", chunked by setChunkSize()).
+     *
+     * The mesh of each block is appended to the datasets as soon as it is
+     * stitched, and only the vertices and lines on the border planes of
+     * blocks which have not been written yet are kept (in row-major
+     * order, about one slab of blocks), so that memory does not grow with
+     * the size of the mesh.
+     */
     void run(T object, const std::string& filename) {
-        using detail::CoorMap;
-        using detail::LinesSet;
-        using detail::extractMesh;
-        using namespace vigra;
-        
-        CoorMap h;
-        LinesSet lines;
-        std::vector<std::vector<size_t> > faces;
-
-        int blockNum = 0;
-        typename Blocking<N>::Pair p;
-        BOOST_FOREACH(p, blocking_.blocks()) {
-            std::cout << "  block " << blockNum+1 << "/" << blocking_.numBlocks()
-                      << " | verts = " << h.size() 
-                      << "  faces = " << faces.size()
-                      << "            \r" << std::flush;
-            Roi<N> roi = p.second;
-
-            MultiArray<N, T> inBlock(roi.shape());
-            source_->readBlock(roi, inBlock);
-            
-            extractMesh(inBlock, roi.p, object, h, lines, faces);
-
-            ++blockNum;
-        }
-        
-        std::cout << std::endl;
         std::cout << "writing mesh to file " << filename << std::endl;
-        
-        vigra::MultiArray<2, uint32_t> outVerts(vigra::Shape2(h.size(), 3));
-        vigra::MultiArray<2, uint32_t> outFaces(vigra::Shape2(faces.size(), 4));
-        vigra:MultiArray<2, uint32_t> outLines(vigra::Shape2(lines.size(), 2));
+        HDF5OutputFile f(filename);
         {
-            size_t i = 0;
-            for(CoorMap::const_iterator it = h.begin(); it != h.end(); ++it, ++i) {
-                for(size_t j=0; j<3; ++j) {
-                    outVerts(it->second, j) = it->first[j];
+            //the blocks are meshed in parallel (compute stage) and stitched
+            //together and written in block order (write stage)
+            MeshWriter mesh(f.handle(), "", shape_, blockShape_, blocking_, chunkSize_);
+            Op op(source_, object, mesh);
+            BlockwiseExecutor<N> executor(blocking_);
+            executor.setNumThreads(numThreads_);
+            executor.run(op);
+            mesh.close();
+        }
+        f.close();
+    }
+
+    /**
+     * extract the boundaries of all objects (labels != 0) in one sweep
+     * over the blocks and write them to 'filename' as laid out by 'output'
+     * (datasets "verts", "faces" and "lines", chunked by setChunkSize()).
+     *
+     * A face between two objects belongs to the meshes of both.
+     * Objects excluded by setLabelWhitelist() or setMinSize() are
+     * treated as background.
+     *
+     * Like run(), the meshes are appended to the datasets block by block.
+     * If setMinSize() or PerObjectMeshes is used, a first sweep counts the
+     * voxels of each object and finds the last block which contains it,
+     * so that the mesh of an object is closed after that block.
+     */
+    void runMultiLabel(const std::string& filename, MeshOutput output = SharedMesh) {
+        const boost::unordered_set<T>* labels = whitelist_.empty() ? 0 : &whitelist_;
+        boost::unordered_set<T> kept;
+        boost::unordered_map<T, size_t> lastBlocks;
+        if(minSize_ > 0 || output == PerObjectMeshes) {
+            boost::unordered_map<T, size_t> sizes;
+            CountOp count(source_, shape_, blockShape_, minSize_ > 0, sizes, lastBlocks);
+            BlockwiseExecutor<N> executor(blocking_);
+            executor.setNumThreads(numThreads_);
+            executor.run(count);
+
+            //apply the size filter
+            if(minSize_ > 0) {
+                for(typename boost::unordered_map<T, size_t>::const_iterator it = sizes.begin(); it != sizes.end(); ++it) {
+                    if(it->second >= minSize_ && (!labels || labels->count(it->first))) {
+                        kept.insert(it->first);
+                    }
                 }
+                labels = &kept;
             }
         }
+
+        std::cout << "writing mesh to file " << filename << std::endl;
+        HDF5OutputFile f(filename);
         {
-            size_t i = 0;
-            for(LinesSet::const_iterator l = lines.begin(); l != lines.end(); ++l) {
-                outLines(i,0) = l->first;
-                outLines(i,1) = l->second;
-                ++i;
+            boost::scoped_ptr<MeshWriter> shared;
+            boost::scoped_ptr<HDF5RowWriter<T> > faceLabels;
+            if(output == SharedMesh) {
+                shared.reset(new MeshWriter(f.handle(), "", shape_, blockShape_, blocking_, chunkSize_));
+                faceLabels.reset(new HDF5RowWriter<T>(f.handle(), "faceLabels", 2, chunkSize_));
+            }
+            MultiLabelOp op(source_, labels, f.handle(), shared.get(), faceLabels.get(), lastBlocks,
+                            shape_, blockShape_, blocking_, chunkSize_);
+            BlockwiseExecutor<N> executor(blocking_);
+            executor.setNumThreads(numThreads_);
+            executor.run(op);
+            if(output == PerObjectMeshes) {
+                std::cout << "  " << op.numObjects << " objects" << std::endl;
+            }
+            op.close();
+            if(shared) {
+                shared->close();
+                faceLabels->close();
+            }
+        }
+        f.close();
+    }
+
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
+    /**
+     * restrict runMultiLabel() to these labels (default: all labels)
+     */
+    void setLabelWhitelist(const std::vector<T>& labels) {
+        whitelist_ = boost::unordered_set<T>(labels.begin(), labels.end());
+    }
+
+    /**
+     * skip objects with fewer than 'minSize' voxels in runMultiLabel()
+     * (default: 0, no size filter)
+     */
+    void setMinSize(size_t minSize) { minSize_ = minSize; }
+
+    /**
+     * number of rows per chunk of the datasets written by run() and
+     * runMultiLabel() (default: 4096)
+     */
+    void setChunkSize(int chunkSize) {
+        vigra_precondition(chunkSize > 0, "chunk size must be positive");
+        chunkSize_ = chunkSize;
+    }
+
+    private:
+
+    /**
+     * vertex coordinates of a block-local vertex map, by ID
+     */
+    static void blockVertices(const ::detail::CoorMap& h, std::vector<Coor>& verts) {
+        verts.resize(h.size());
+        for(::detail::CoorMap::const_iterator it = h.begin(); it != h.end(); ++it) {
+            verts[it->second] = it->first;
+        }
+    }
+
+    /**
+     * the edges of the quadrilaterals 'faces' (4 vertex IDs each),
+     * without duplicates and sorted
+     */
+    static void faceLines(const std::vector<size_t>& faces, std::vector<std::pair<size_t, size_t> >& lines) {
+        ::detail::LinesSet h;
+        for(size_t i=0; i<faces.size(); i += 4) {
+            for(size_t j=0; j<4; ++j) {
+                size_t id0 = faces[i+j];
+                size_t id1 = faces[i+(j+1) % 4];
+                if(id0 > id1) { std::swap(id0, id1); }
+                h.insert(std::make_pair(id0, id1));
             }
         }
+        lines.assign(h.begin(), h.end());
+        std::sort(lines.begin(), lines.end());
+    }
+
+    /**
+     * Joins the meshes of the blocks, which have block-local vertex IDs,
+     * into one mesh.
+     *
+     * Vertices inside a block get the next global ID. Only vertices on
+     * the border of a block can be shared with other blocks; they are
+     * looked up by their linearized coordinate. Adding the blocks in a
+     * fixed order gives the same IDs regardless of the number of threads.
+     * A border vertex (or line) is forgotten once the last block which
+     * contains it has been added, so only the vertices on the border
+     * planes of blocks still to come are kept in memory.
+     */
+    class MeshStitcher {
+        public:
+        MeshStitcher(V shape, V blockShape, const Blocking<N>& blocking)
+            : shape_(shape), blockShape_(blockShape), blocking_(blocking), numVerts_(0)
+        {}
+
+        /**
+         * global IDs 'ids' of the vertices 'blockVerts' of the block 'roi';
+         * 'onBorder' tells which of them may be shared with other blocks,
+         * and 'newVerts' receives the vertices not seen before, in the
+         * order of their IDs
+         */
+        void add(const Roi<N>& roi, const std::vector<Coor>& blockVerts,
+                 std::vector<size_t>& ids, std::vector<bool>& onBorder,
+                 std::vector<Coor>& newVerts)
         {
+            ids.resize(blockVerts.size());
+            onBorder.resize(blockVerts.size());
+            newVerts.clear();
+            for(size_t i=0; i<blockVerts.size(); ++i) {
+                const Coor& v = blockVerts[i];
+                bool border = false;
+                for(int k=0; k<3; ++k) {
+                    //the corners of the faces of a block lie in [p, q-1]
+                    if(v[k] == roi.p[k] || v[k] == roi.q[k]-1) { border = true; }
+                }
+                onBorder[i] = border;
+                if(border) {
+                    const size_t key = v[0] + (shape_[0]+1)*(v[1] + (shape_[1]+1)*v[2]);
+                    std::pair<BorderMap::iterator, bool> it = border_.insert(std::make_pair(key, numVerts_));
+                    if(!it.second) {
+                        ids[i] = it.first->second;
+                        continue;
+                    }
+                    expiringVerts_[lastBlock(v, v)].push_back(key);
+                }
+                ids[i] = numVerts_++;
+                newVerts.push_back(v);
+            }
+            vigra_precondition(numVerts_ <= std::numeric_limits<uint32_t>::max(),
+                               "MeshStitcher: too many vertices for 32 bit IDs");
+        }
+
+        /**
+         * whether the line 'ids' between the border vertices 'a' and 'b'
+         * has not been added before
+         */
+        bool addBorderLine(const Coor& a, const Coor& b, std::pair<size_t, size_t> ids) {
+            if(!borderLines_.insert(ids).second) { return false; }
+            expiringLines_[lastBlock(a, b)].push_back(ids);
+            return true;
+        }
+
+        /**
+         * forget the border vertices and lines which no block after
+         * the i-th can share
+         */
+        void blockDone(size_t i) {
+            while(!expiringVerts_.empty() && expiringVerts_.begin()->first <= i) {
+                const std::vector<size_t>& keys = expiringVerts_.begin()->second;
+                for(size_t j=0; j<keys.size(); ++j) { border_.erase(keys[j]); }
+                expiringVerts_.erase(expiringVerts_.begin());
+            }
+            while(!expiringLines_.empty() && expiringLines_.begin()->first <= i) {
+                const std::vector<std::pair<size_t, size_t> >& lines = expiringLines_.begin()->second;
+                for(size_t j=0; j<lines.size(); ++j) { borderLines_.erase(lines[j]); }
+                expiringLines_.erase(expiringLines_.begin());
+            }
+        }
+
+        size_t numVerts() const { return numVerts_; }
+
+        /**
+         * number of border vertices kept in memory
+         */
+        size_t numBorderVerts() const { return border_.size(); }
+
+        private:
+        typedef boost::unordered_map<size_t, size_t> BorderMap;
+
+        /**
+         * index of the last block (in the order of the blocking) which
+         * contains both 'a' and 'b'
+         */
+        size_t lastBlock(const Coor& a, const Coor& b) const {
+            //along each axis, the blocks x with x*blockShape <= lo and
+            //hi <= (x+1)*blockShape contain both (their rois overlap by 1)
+            V first, last;
+            for(int k=0; k<N; ++k) {
+                const typename V::value_type lo = std::min(a[k], b[k]);
+                const typename V::value_type hi = std::max(a[k], b[k]);
+                first[k] = std::max<typename V::value_type>(0, (hi+blockShape_[k]-1)/blockShape_[k] - 1);
+                last[k]  = std::min(lo/blockShape_[k], blocking_.gridShape()[k]-1);
+            }
             size_t i = 0;
-            for(typename std::vector<std::vector<size_t> >::const_iterator face = faces.begin(); face != faces.end(); ++face) {
-                for(size_t j=0; j<4; ++j) {
-                    outFaces(i, j) = (*face)[j];
+            V x = first;
+            while(true) {
+                i = std::max(i, blocking_.indexOf(x));
+                int k = 0;
+                for(; k<N; ++k) {
+                    if(x[k] < last[k]) { ++x[k]; break; }
+                    x[k] = first[k];
                 }
-                ++i;
+                if(k == N) { break; }
             }
+            return i;
         }
-        
-        vigra::HDF5File f(filename, vigra::HDF5File::Open);
-        f.write("faces", outFaces);
-        f.write("lines", outLines);
-        f.write("verts", outVerts);
-        f.close();
-    }
 
-    private:
+        V shape_;
+        V blockShape_;
+        Blocking<N> blocking_;
+        size_t numVerts_;
+        BorderMap border_;
+        ::detail::LinesSet borderLines_;
+        std::map<size_t, std::vector<size_t> > expiringVerts_;
+        std::map<size_t, std::vector<std::pair<size_t, size_t> > > expiringLines_;
+    };
+
+    /**
+     * Stitches the meshes of the blocks with a MeshStitcher and appends
+     * them to the datasets 'prefix'verts, faces and lines.
+     */
+    class MeshWriter : boost::noncopyable {
+        public:
+        MeshWriter(hid_t location, const std::string& prefix,
+                   V shape, V blockShape, const Blocking<N>& blocking, int chunkSize)
+            : stitcher_(shape, blockShape, blocking)
+            , verts_(location, prefix+"verts", 3, chunkSize)
+            , faces_(location, prefix+"faces", 4, chunkSize)
+            , lines_(location, prefix+"lines", 2, chunkSize)
+        {}
+
+        /**
+         * append the mesh of the i-th block 'roi', given by block-local
+         * vertex IDs: 4 per face in 'faces', 2 per line in 'lines'
+         */
+        void add(size_t i, const Roi<N>& roi, const std::vector<Coor>& verts,
+                 const std::vector<size_t>& faces,
+                 const std::vector<std::pair<size_t, size_t> >& lines)
+        {
+            std::vector<size_t> ids;
+            std::vector<bool> onBorder;
+            std::vector<Coor> newVerts;
+            stitcher_.add(roi, verts, ids, onBorder, newVerts);
+
+            uint32_t row[4];
+            for(size_t k=0; k<newVerts.size(); ++k) {
+                for(size_t j=0; j<3; ++j) { row[j] = newVerts[k][j]; }
+                verts_.append(row);
+            }
+            for(size_t k=0; k<faces.size(); k += 4) {
+                for(size_t j=0; j<4; ++j) { row[j] = ids[faces[k+j]]; }
+                faces_.append(row);
+            }
+            //only lines between two border vertices can be shared with
+            //other blocks
+            for(size_t k=0; k<lines.size(); ++k) {
+                const size_t v0 = lines[k].first;
+                const size_t v1 = lines[k].second;
+                size_t id0 = ids[v0];
+                size_t id1 = ids[v1];
+                if(id0 > id1) { std::swap(id0, id1); }
+                if(onBorder[v0] && onBorder[v1]) {
+                    if(!stitcher_.addBorderLine(verts[v0], verts[v1], std::make_pair(id0, id1))) { continue; }
+                }
+                row[0] = id0;
+                row[1] = id1;
+                lines_.append(row);
+            }
+            stitcher_.blockDone(i);
+        }
+
+        void close() {
+            verts_.close();
+            faces_.close();
+            lines_.close();
+        }
+
+        private:
+        MeshStitcher stitcher_;
+        HDF5RowWriter<uint32_t> verts_;
+        HDF5RowWriter<uint32_t> faces_;
+        HDF5RowWriter<uint32_t> lines_;
+    };
+
+    /**
+     * meshes the boundary of one object per block in parallel, and
+     * stitches the blocks together and appends them to the output
+     * in the write stage
+     */
+    struct Op {
+        struct Data {
+            vigra::MultiArray<N, T> inBlock;
+            std::vector<Coor> verts;
+            std::vector<size_t> faces;
+            std::vector<std::pair<size_t, size_t> > lines;
+        };
+
+        Op(Source<N,T>* source, T object, MeshWriter& mesh)
+            : source(source), object(object), mesh(mesh)
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            d.inBlock.reshape(roi.shape());
+            source->readBlock(roi, d.inBlock);
+        }
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            ::detail::CoorMap h;
+            ::detail::LinesSet blockLines;
+            d.faces.clear();
+            ::detail::extractMesh(d.inBlock, roi.p, object, h, blockLines, d.faces);
+            blockVertices(h, d.verts);
+            d.lines.assign(blockLines.begin(), blockLines.end());
+            std::sort(d.lines.begin(), d.lines.end());
+        }
+
+        void write(size_t i, const Roi<N>& roi, Data& d) {
+            mesh.add(i, roi, d.verts, d.faces, d.lines);
+        }
+
+        Source<N,T>* source;
+        T object;
+        MeshWriter& mesh;
+    };
+
+    /**
+     * counts the voxels of each object (in the block cores) and finds
+     * the last block (with overlap) which contains it
+     */
+    struct CountOp {
+        struct Data {
+            vigra::MultiArray<N, T> inBlock;
+            boost::unordered_map<T, size_t> sizes;
+        };
+
+        CountOp(Source<N,T>* source, V shape, V blockShape, bool countSizes,
+                boost::unordered_map<T, size_t>& sizes,
+                boost::unordered_map<T, size_t>& lastBlocks)
+            : source(source), shape(shape), blockShape(blockShape), countSizes(countSizes)
+            , sizes(sizes), lastBlocks(lastBlocks)
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            d.inBlock.reshape(roi.shape());
+            source->readBlock(roi, d.inBlock);
+        }
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            d.sizes.clear();
+            typedef typename vigra::MultiArrayView<N, T>::iterator Iter;
+            for(Iter it = d.inBlock.begin(); it != d.inBlock.end(); ++it) {
+                if(*it != 0) { d.sizes[*it]; }
+            }
+            if(!countSizes) { return; }
+            //without the overlap, so that each voxel is counted once
+            V q;
+            for(int k=0; k<N; ++k) { q[k] = std::min(roi.p[k]+blockShape[k], shape[k]) - roi.p[k]; }
+            vigra::MultiArrayView<N, T> core = d.inBlock.subarray(V(), q);
+            for(Iter it = core.begin(); it != core.end(); ++it) {
+                if(*it != 0) { ++d.sizes[*it]; }
+            }
+        }
+
+        void write(size_t i, const Roi<N>&, Data& d) {
+            //the blocks are written in order
+            for(typename boost::unordered_map<T, size_t>::const_iterator it = d.sizes.begin(); it != d.sizes.end(); ++it) {
+                sizes[it->first] += it->second;
+                lastBlocks[it->first] = i;
+            }
+        }
+
+        Source<N,T>* source;
+        V shape;
+        V blockShape;
+        bool countSizes;
+        boost::unordered_map<T, size_t>& sizes;
+        boost::unordered_map<T, size_t>& lastBlocks;
+    };
+
+    /**
+     * meshes all objects per block in parallel, and stitches the blocks
+     * together in the write stage: into one mesh (if 'shared' is given)
+     * or into one mesh per object, which is closed after the last block
+     * containing the object (as given by 'lastBlocks')
+     */
+    struct MultiLabelOp {
+        /**
+         * the faces of one object in a block, with its own vertex IDs
+         */
+        struct ObjectMesh {
+            T label;
+            std::vector<Coor> verts;
+            std::vector<size_t> faces;
+            std::vector<std::pair<size_t, size_t> > lines;
+        };
+
+        struct Data {
+            vigra::MultiArray<N, T> inBlock;
+            std::vector<Coor> verts;
+            std::vector<size_t> faces;
+            std::vector<std::pair<size_t, size_t> > lines;
+            std::vector<std::pair<T, T> > faceLabels;
+            std::vector<ObjectMesh> objects;
+        };
+
+        typedef boost::unordered_map<T, boost::shared_ptr<MeshWriter> > ObjectWriters;
+
+        MultiLabelOp(Source<N,T>* source, const boost::unordered_set<T>* labels,
+                     hid_t location, MeshWriter* shared, HDF5RowWriter<T>* faceLabels,
+                     const boost::unordered_map<T, size_t>& lastBlocks,
+                     V shape, V blockShape, const Blocking<N>& blocking, int chunkSize)
+            : source(source), labels(labels), location(location)
+            , shared(shared), faceLabels(faceLabels), lastBlocks(lastBlocks)
+            , shape(shape), blockShape(blockShape), blocking(blocking), chunkSize(chunkSize)
+            , numObjects(0)
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            d.inBlock.reshape(roi.shape());
+            source->readBlock(roi, d.inBlock);
+        }
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            ::detail::CoorMap h;
+            d.faces.clear();
+            d.faceLabels.clear();
+            ::detail::extractMultiLabelMesh(d.inBlock, roi.p, labels, h, d.faces, d.faceLabels);
+            blockVertices(h, d.verts);
+            if(shared) {
+                faceLines(d.faces, d.lines);
+            }
+            else {
+                splitObjects(d);
+            }
+        }
+
+        void write(size_t i, const Roi<N>& roi, Data& d) {
+            if(shared) {
+                shared->add(i, roi, d.verts, d.faces, d.lines);
+                T row[2];
+                for(size_t k=0; k<d.faceLabels.size(); ++k) {
+                    row[0] = d.faceLabels[k].first;
+                    row[1] = d.faceLabels[k].second;
+                    faceLabels->append(row);
+                }
+                return;
+            }
+            for(size_t k=0; k<d.objects.size(); ++k) {
+                const ObjectMesh& m = d.objects[k];
+                boost::shared_ptr<MeshWriter>& w = objects[m.label];
+                if(!w) {
+                    std::ostringstream group;
+                    group << m.label << "/";
+                    w.reset(new MeshWriter(location, group.str(), shape, blockShape, blocking, chunkSize));
+                    ++numObjects;
+                }
+                w->add(i, roi, m.verts, m.faces, m.lines);
+                typename boost::unordered_map<T, size_t>::const_iterator last = lastBlocks.find(m.label);
+                if(last == lastBlocks.end() || last->second <= i) {
+                    w->close();
+                    objects.erase(m.label);
+                }
+            }
+        }
+
+        /**
+         * close the meshes of all objects
+         */
+        void close() {
+            for(typename ObjectWriters::iterator it = objects.begin(); it != objects.end(); ++it) {
+                it->second->close();
+            }
+            objects.clear();
+        }
+
+        /**
+         * split the faces of the block by object, renumbering the vertices
+         * of each object consecutively
+         */
+        static void splitObjects(Data& d) {
+            boost::unordered_map<T, size_t> index;
+            std::vector<boost::unordered_map<size_t, size_t> > vertexIds;
+            d.objects.clear();
+            for(size_t i=0; i<d.faceLabels.size(); ++i) {
+                const T ab[2] = { d.faceLabels[i].first, d.faceLabels[i].second };
+                for(int s=0; s<2; ++s) {
+                    if(ab[s] == 0) { continue; }
+                    std::pair<typename boost::unordered_map<T, size_t>::iterator, bool> o
+                        = index.insert(std::make_pair(ab[s], d.objects.size()));
+                    if(o.second) {
+                        d.objects.push_back(ObjectMesh());
+                        d.objects.back().label = ab[s];
+                        vertexIds.push_back(boost::unordered_map<size_t, size_t>());
+                    }
+                    ObjectMesh& m = d.objects[o.first->second];
+                    boost::unordered_map<size_t, size_t>& ids = vertexIds[o.first->second];
+                    for(size_t j=0; j<4; ++j) {
+                        const size_t v = d.faces[4*i+j];
+                        std::pair<boost::unordered_map<size_t, size_t>::iterator, bool> id
+                            = ids.insert(std::make_pair(v, m.verts.size()));
+                        if(id.second) { m.verts.push_back(d.verts[v]); }
+                        m.faces.push_back(id.first->second);
+                    }
+                }
+            }
+            for(size_t k=0; k<d.objects.size(); ++k) {
+                faceLines(d.objects[k].faces, d.objects[k].lines);
+            }
+        }
+
+        Source<N,T>* source;
+        const boost::unordered_set<T>* labels;
+        hid_t location;
+        MeshWriter* shared;
+        HDF5RowWriter<T>* faceLabels;
+        const boost::unordered_map<T, size_t>& lastBlocks;
+        V shape;
+        V blockShape;
+        Blocking<N> blocking;
+        int chunkSize;
+        ObjectWriters objects;
+        size_t numObjects;
+    };
+
     V shape_;
     V blockShape_;
     Blocking<N> blocking_;
     Source<N,T>* source_;
+    int numThreads_;
+    boost::unordered_set<T> whitelist_;
+    size_t minSize_;
+    int chunkSize_;
 };
 
 } /* namespace BW */
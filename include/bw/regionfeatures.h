@@ -30,12 +30,25 @@
 #ifndef BW_REGIONFEATURES2_H
 #define BW_REGIONFEATURES2_H
 
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
 #include <vigra/accumulator.hxx>
 #include <vigra/multi_array.hxx>
 
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
 #include <bw/source.h>
 #include <bw/sink.h>
 #include <bw/blocking.h>
+#include <bw/threadpool.h>
+#include <bw/hdf5mutex.h>
 
 namespace BW {
 
@@ -44,6 +57,19 @@ using namespace vigra::acc;
 static const int StaticHistogramSize = 0;
 static const int DynamicHistogramSize = 50;
 
+/**
+ * Computes features of the regions of 'labelsBlockSource' over
+ * 'dataSource' blockwise (not limited by RAM).
+ *
+ * The blocks are processed in parallel. Each thread merges the features
+ * of its blocks into its own accumulator chain as they complete, and the
+ * chains of the threads are merged pairwise at the end, so that only
+ * a few chains (one per thread and one per block in flight) are held in
+ * memory at any time.
+ *
+ * Only the features selected with setFeatures() are computed and written
+ * (by default, all of them; see allFeatures()).
+ */
 template<int N, class T, class U>
 class RegionFeatures {
     public:
@@ -71,7 +97,7 @@ class RegionFeatures {
                    DataArg<1>, WeightArg<1>, LabelArg<2>
                    > ScalarRegionAccumulatorsBW;
 
-    typedef vigra::acc::AccumulatorChainArray<
+    typedef vigra::acc::DynamicAccumulatorChainArray<
                 vigra::CoupledArrays<3, T, U>,
                 ScalarRegionAccumulatorsBW
             > AccChain;
@@ -81,6 +107,12 @@ class RegionFeatures {
         : blockShape_(blockShape)
         , dataSource_(dataSource)
         , labelsBlockSource_(labelsBlockSource)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
+        , hasHistogramRange_(false)
+        , histogramMin_(0)
+        , histogramMax_(0)
+        , rangeSampleBlocks_(16)
+        , features_(allFeatures())
     {
         vigra_precondition(dataSource_->shape() == labelsBlockSource_->shape(), "shapes do not match");
 
@@ -93,113 +125,84 @@ class RegionFeatures {
     void run(const std::string& filename) {
         using namespace vigra;
 
-        accumulators_.resize(blocking_.numBlocks());
-
-        typename Blocking<N>::Pair p;
-
-        T m = 0;
-        T M = vigra::NumericTraits<T>::min();
-        size_t i=0;
-
-        //MultiArray<N, T> dataBlock(blockShape_);
-
-        BOOST_FOREACH(p, blocking_.blocks()) {
-            std::cout << "  cc block " << i+1 << "/" << blocking_.numBlocks() << "        \r" << std::flush;
-            Roi<N> roi = p.second;
-            //if(dataBlock.shape() !=roi.shape()) {
-            //	dataBlock.reshape(roi.shape());
-            //}
-            MultiArray<N, T> dataBlock(roi.shape());
-            dataSource_->readBlock(roi, dataBlock);
-            M = std::max(M, *std::max_element(dataBlock.begin(), dataBlock.end()));
-            ++i;
+        T m = 0, M = 1;
+        if(hasFeature("histogram") || hasFeature("quantiles")) {
+            histogramRange(m, M);
         }
-	    std::cout << std::endl;
 
         vigra::HistogramOptions histogram_opt;
         histogram_opt = histogram_opt.setBinCount(DynamicHistogramSize);
         histogram_opt = histogram_opt.setMinMax(m,M);
 
-        i = 0;
-        BOOST_FOREACH(p, blocking_.blocks()) {
-            std::cout << "  block " << i+1 << "/" << blocking_.numBlocks() << "        \r" << std::flush;
-
-            Roi<N> roi = p.second;
-
-            MultiArray<N, T> dataBlock(roi.shape());
-            dataSource_->readBlock(roi, dataBlock);
-
-            MultiArray<N, U> labelsBlock(roi.shape());
-            labelsBlockSource_->readBlock(roi, labelsBlock);
-
-            accumulators_[i].ignoreLabel(0);
-            accumulators_[i].setHistogramOptions(histogram_opt);
-            accumulators_[i].setCoordinateOffset(roi.p);
-
-            extractFeatures(dataBlock, labelsBlock, accumulators_[i]);
-
-            ++i;
+        //one accumulator chain per thread
+        const size_t numChains = std::max<size_t>(1, std::min<size_t>(numThreads_, blocking_.numBlocks()));
+        std::vector<AccChain> chains(numChains);
+        for(size_t t=0; t<numChains; ++t) {
+            setupChain(chains[t], histogram_opt);
         }
-        std::cout << std::endl;
 
-        vigra::MultiArrayIndex maxRegionLabel = 0;
-        for(i=0; i<accumulators_.size(); ++i) {
-            maxRegionLabel = std::max(maxRegionLabel, accumulators_[i].maxRegionLabel());
+        ThreadPool pool(numChains);
+        {
+            std::cout << "  extract features" << std::endl;
+            WorkState state;
+            TaskGroup tasks(pool);
+            for(size_t t=0; t<numChains; ++t) {
+                tasks.run(boost::bind(&RegionFeatures::extract, this, boost::ref(chains[t]),
+                                      boost::cref(histogram_opt), boost::ref(state)));
+            }
+            tasks.wait();
+            std::cout << std::endl;
         }
 
-        AccChain a;
-        a.setMaxRegionLabel(maxRegionLabel);
-        a.setHistogramOptions(histogram_opt);
-        a.ignoreLabel(0);
-
-        for(i=0; i<accumulators_.size(); ++i) {
-            std::cout << "  acc " << i+1 << "/" << blocking_.numBlocks() << " has " << accumulators_[i].regionCount() << " regions          \r" << std::flush;
-
-            std::vector<size_t> relabeling(accumulators_[i].maxRegionLabel()+1);
-            vigra::linearSequence(relabeling.begin(), relabeling.end());
-            a.merge(accumulators_[i], relabeling);
-
+        //tree reduction of the chains of the threads into chains[0]
+        for(size_t step=1; step<numChains; step *= 2) {
+            TaskGroup tasks(pool);
+            for(size_t t=0; t+step<numChains; t += 2*step) {
+                tasks.run(boost::bind(&RegionFeatures::mergeChain, boost::ref(chains[t]), boost::cref(chains[t+step])));
+            }
+            tasks.wait();
         }
-        std::cout << std::endl;
+        AccChain& a = chains[0];
 
         std::cout << "write features to " << filename << std::endl;
+        HDF5Lock lock;
         vigra::HDF5File f(filename, vigra::HDF5File::Open);
-        {
+        if(hasFeature("count")) {
             vigra::MultiArray<1, float> count(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { count(i) = vigra::acc::get<vigra::acc::Count>(a, i); }
             f.write("count", count);
         }
-        {
+        if(hasFeature("mean")) {
             vigra::MultiArray<1, float> mean(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { mean(i) = vigra::acc::get<vigra::acc::Mean>(a, i); }
             f.write("mean", mean);
         }
-        {
+        if(hasFeature("variance")) {
             vigra::MultiArray<1, float> variance(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { variance(i) = vigra::acc::get<vigra::acc::Variance>(a, i); }
             f.write("variance", variance);
         }
-        {
+        if(hasFeature("skewness")) {
             vigra::MultiArray<1, float> skewness(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { skewness(i) = vigra::acc::get<vigra::acc::Skewness>(a, i); }
             f.write("skewness", skewness);
         }
-        {
+        if(hasFeature("kurtosis")) {
             vigra::MultiArray<1, float> kurtosis(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { kurtosis(i) = vigra::acc::get<vigra::acc::Kurtosis>(a, i); }
             f.write("kurtosis", kurtosis);
         }
-        {
+        if(hasFeature("minimum")) {
             vigra::MultiArray<1, float> minimum(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { minimum(i) = vigra::acc::get<vigra::acc::Minimum>(a, i); }
             f.write("minimum", minimum);
         }
-        {
+        if(hasFeature("maximum")) {
             vigra::MultiArray<1, float> maximum(vigra::Shape1(a.regionCount()));
             for(size_t i=0; i<a.regionCount(); ++i) { maximum(i) = vigra::acc::get<vigra::acc::Maximum>(a, i); }
             f.write("maximum", maximum);
         }
-        {
+        if(hasFeature("histogram")) {
             vigra::MultiArray<2, float> hist(vigra::Shape2(a.regionCount(), DynamicHistogramSize));
             for(size_t i=0; i<a.regionCount(); ++i) {
                 for(size_t j=0; j<DynamicHistogramSize; ++j) {
@@ -208,7 +211,7 @@ class RegionFeatures {
             }
             f.write("histogram", hist);
         }
-        {
+        if(hasFeature("quantiles")) {
             vigra::MultiArray<2, float> quantiles(vigra::Shape2(a.regionCount(), 7));
             for(size_t i=0; i<a.regionCount(); ++i) {
                 for(size_t j=0; j<7; ++j) {
@@ -217,7 +220,7 @@ class RegionFeatures {
             }
             f.write("quantiles", quantiles);
         }
-        {
+        if(hasFeature("regionCenter")) {
             vigra::MultiArray<2, float> regionCenter(vigra::Shape2(a.regionCount(), 3));
             for(size_t i=0; i<a.regionCount(); ++i) {
                 for(size_t j=0; j<3; ++j) {
@@ -226,8 +229,25 @@ class RegionFeatures {
             }
             f.write("regionCenter", regionCenter);
         }
-
-        {
+        if(hasFeature("boundingBoxMin")) {
+            vigra::MultiArray<2, float> boundingBoxMin(vigra::Shape2(a.regionCount(), N));
+            for(size_t i=0; i<a.regionCount(); ++i) {
+                for(size_t j=0; j<N; ++j) {
+                    boundingBoxMin(i, j) = vigra::acc::get<Coord<Minimum> >(a, i)[j];
+                }
+            }
+            f.write("boundingBoxMin", boundingBoxMin);
+        }
+        if(hasFeature("boundingBoxMax")) {
+            vigra::MultiArray<2, float> boundingBoxMax(vigra::Shape2(a.regionCount(), N));
+            for(size_t i=0; i<a.regionCount(); ++i) {
+                for(size_t j=0; j<N; ++j) {
+                    boundingBoxMax(i, j) = vigra::acc::get<Coord<Maximum> >(a, i)[j];
+                }
+            }
+            f.write("boundingBoxMax", boundingBoxMax);
+        }
+        if(hasFeature("regionRadii")) {
             vigra::MultiArray<2, float> regionRadii(vigra::Shape2(a.regionCount(), 3));
             for(size_t i=0; i<a.regionCount(); ++i) {
                 for(size_t j=0; j<3; ++j) {
@@ -236,8 +256,7 @@ class RegionFeatures {
             }
             f.write("regionRadii", regionRadii);
         }
-
-        {
+        if(hasFeature("regionAxes")) {
             vigra::MultiArray<3, float> regionAxes(vigra::Shape3(a.regionCount(), 3, 3));
             for(size_t i=0; i<a.regionCount(); ++i) {
                 for(size_t j=0; j<3; ++j) {
@@ -254,7 +273,170 @@ class RegionFeatures {
 
     }
 
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
+    /**
+     * range of the histograms (and quantiles); by default, it is estimated
+     * as 0 up to the maximum of a sample of the blocks (see
+     * setRangeSampleBlocks()), so values outside of the sample's range
+     * fall into the outermost bins
+     */
+    void setHistogramRange(T min, T max) {
+        vigra_precondition(min < max, "histogram range is empty");
+        hasHistogramRange_ = true;
+        histogramMin_ = min;
+        histogramMax_ = max;
+    }
+
+    /**
+     * number of blocks, spread evenly over the data, read to determine
+     * the histogram range if it is not given (default: 16)
+     */
+    void setRangeSampleBlocks(size_t n) {
+        vigra_precondition(n > 0, "need at least one block");
+        rangeSampleBlocks_ = n;
+    }
+
+    /**
+     * names of all features that can be computed; these are also the
+     * names of the datasets written by run()
+     */
+    static std::vector<std::string> allFeatures() {
+        const char* names[] = {"count", "mean", "variance", "skewness", "kurtosis",
+                               "minimum", "maximum", "histogram", "quantiles",
+                               "regionCenter", "boundingBoxMin", "boundingBoxMax",
+                               "regionRadii", "regionAxes"};
+        return std::vector<std::string>(names, names+sizeof(names)/sizeof(names[0]));
+    }
+
+    /**
+     * select the features to compute and write (see allFeatures()),
+     * e.g. only "count", "mean", "boundingBoxMin" and "boundingBoxMax"
+     */
+    void setFeatures(const std::vector<std::string>& features) {
+        const std::vector<std::string> all = allFeatures();
+        BOOST_FOREACH(const std::string& feature, features) {
+            if(std::find(all.begin(), all.end(), feature) == all.end()) {
+                throw std::runtime_error("RegionFeatures: unknown feature '"+feature+"'");
+            }
+        }
+        features_ = features;
+    }
+
+    const std::vector<std::string>& features() const { return features_; }
+
     private:
+
+    struct WorkState {
+        WorkState() : nextBlock(0), blocksDone(0) {}
+        boost::mutex mutex;
+        //reads are serialized, so that the Sources need not be thread safe
+        boost::mutex readMutex;
+        size_t nextBlock;
+        size_t blocksDone;
+    };
+
+    /**
+     * range of the histograms, from setHistogramRange() or estimated from
+     * a sample of the blocks (0 up to the sampled maximum)
+     */
+    void histogramRange(T& m, T& M) const {
+        if(hasHistogramRange_) {
+            m = histogramMin_;
+            M = histogramMax_;
+            return;
+        }
+        const size_t numBlocks = blocking_.numBlocks();
+        const size_t numSamples = std::min(rangeSampleBlocks_, numBlocks);
+        std::cout << "  estimate data range from " << numSamples << " of " << numBlocks << " blocks" << std::endl;
+        m = 0;
+        M = vigra::NumericTraits<T>::min();
+        for(size_t j=0; j<numSamples; ++j) {
+            const Roi<N> roi = blocking_.block(j*numBlocks/numSamples).second;
+            vigra::MultiArray<N, T> dataBlock(roi.shape());
+            dataSource_->readBlock(roi, dataBlock);
+            M = std::max(M, *std::max_element(dataBlock.data(), dataBlock.data()+dataBlock.size()));
+        }
+        if(!(m < M)) {
+            M = m+1;
+        }
+    }
+
+    /**
+     * worker: extract the features of the next block until all blocks are
+     * done, and merge them into 'chain'
+     */
+    void extract(AccChain& chain, const vigra::HistogramOptions& histogramOptions, WorkState& state) const {
+        while(true) {
+            size_t i;
+            {
+                boost::lock_guard<boost::mutex> lock(state.mutex);
+                if(state.nextBlock >= blocking_.numBlocks()) { return; }
+                i = state.nextBlock++;
+            }
+            const Roi<N> roi = blocking_.block(i).second;
+
+            vigra::MultiArray<N, T> dataBlock(roi.shape());
+            vigra::MultiArray<N, U> labelsBlock(roi.shape());
+            {
+                boost::lock_guard<boost::mutex> lock(state.readMutex);
+                dataSource_->readBlock(roi, dataBlock);
+                labelsBlockSource_->readBlock(roi, labelsBlock);
+            }
+
+            AccChain blockChain;
+            setupChain(blockChain, histogramOptions);
+            blockChain.setCoordinateOffset(roi.p);
+            vigra::acc::extractFeatures(dataBlock, labelsBlock, blockChain);
+            mergeChain(chain, blockChain);
+
+            boost::lock_guard<boost::mutex> lock(state.mutex);
+            ++state.blocksDone;
+            std::cout << "  block " << state.blocksDone << "/" << blocking_.numBlocks() << "        \r" << std::flush;
+        }
+    }
+
+    bool hasFeature(const std::string& feature) const {
+        return std::find(features_.begin(), features_.end(), feature) != features_.end();
+    }
+
+    /**
+     * activate the selected features in 'a'; all chains that are merged
+     * have to be set up the same way
+     */
+    void setupChain(AccChain& a, const vigra::HistogramOptions& histogramOptions) const {
+        a.ignoreLabel(0);
+        a.setHistogramOptions(histogramOptions);
+        if(hasFeature("count"))          { a.template activate<Count>(); }
+        if(hasFeature("mean"))           { a.template activate<Mean>(); }
+        if(hasFeature("variance"))       { a.template activate<Variance>(); }
+        if(hasFeature("skewness"))       { a.template activate<Skewness>(); }
+        if(hasFeature("kurtosis"))       { a.template activate<Kurtosis>(); }
+        if(hasFeature("minimum"))        { a.template activate<Minimum>(); }
+        if(hasFeature("maximum"))        { a.template activate<Maximum>(); }
+        if(hasFeature("histogram"))      { a.template activate<UserRangeHistogram<StaticHistogramSize> >(); }
+        if(hasFeature("quantiles"))      { a.template activate<StandardQuantiles<UserRangeHistogram<StaticHistogramSize> > >(); }
+        if(hasFeature("regionCenter"))   { a.template activate<RegionCenter>(); }
+        if(hasFeature("boundingBoxMin")) { a.template activate<Coord<Minimum> >(); }
+        if(hasFeature("boundingBoxMax")) { a.template activate<Coord<Maximum> >(); }
+        if(hasFeature("regionRadii"))    { a.template activate<RegionRadii>(); }
+        if(hasFeature("regionAxes"))     { a.template activate<RegionAxes>(); }
+    }
+
+    /**
+     * merge the regions of 'b' into those with the same labels of 'a'
+     */
+    static void mergeChain(AccChain& a, const AccChain& b) {
+        //nothing to merge if 'b' has seen no block or only background
+        if(b.regionCount() == 0 || b.maxRegionLabel() == 0) { return; }
+        std::vector<size_t> relabeling(b.maxRegionLabel()+1);
+        vigra::linearSequence(relabeling.begin(), relabeling.end());
+        a.merge(b, relabeling);
+    }
+
     V shape_;
     V blockShape_;
     Blocking<N> blocking_;
@@ -262,7 +444,12 @@ class RegionFeatures {
     Source<N,T>* dataSource_;
     Source<N,U>* labelsBlockSource_;
 
-    std::vector<AccChain> accumulators_;
+    int numThreads_;
+    bool hasHistogramRange_;
+    T histogramMin_;
+    T histogramMax_;
+    size_t rangeSampleBlocks_;
+    std::vector<std::string> features_;
 };
 
 } /* namespace BW */
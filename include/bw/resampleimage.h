@@ -33,6 +33,7 @@
 #include <bw/source.h>
 #include <bw/sink.h>
 #include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
 
 #include <vigra/multi_resize.hxx>
 #include <vigra/timing.hxx>
@@ -66,6 +67,7 @@ class ResampleImage {
         : blockShape_(blockShape)
         , shape_(source->shape())
         , source_(source)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
     {
         vigra_precondition(shape_.size() == N, "dataset shape is wrong");
 
@@ -76,56 +78,61 @@ class ResampleImage {
     }
 
     void run(double factor, Sink<N,T>* sink, V blockShape) {
-        using namespace vigra;
-        USETICTOC;
-        
-        double timeRead = 0.0;
-        double timeResample = 0.0;
-        double timeWrite = 0.0;
-
         V newShape = factor < 1.0 ? vigra::ceil(factor*source_->shape()) : vigra::floor(factor*source_->shape());
-        
+
         sink->setShape(newShape);
 
-        int blockNum = 0;
-        typename Blocking<N>::Pair p;
-        BOOST_FOREACH(p, blocking_.blocks()) {
-            std::cout << "  block " << blockNum+1 << "/" << blocking_.numBlocks();
-            if(blockNum != 0) {
-                std::cout << " read: " << timeRead/((double)blockNum);
-                std::cout << ", resample: " << timeResample/((double)blockNum);
-                std::cout << ", write: " << timeWrite/((double)blockNum);
-            }
-            std::cout << "        \r" << std::flush;
-            Roi<N> roi = p.second;
-
-            TIC;
-            MultiArray<N, T> inBlock(roi.shape());
-            source_->readBlock(roi, inBlock);
-            timeRead += TOCN;
-
-            TIC;
-            V outBlockShape = factor < 1.0 ? vigra::ceil(factor*inBlock.shape()) : vigra::floor(factor*inBlock.shape());
-            MultiArray<N, T> outBlock(outBlockShape);
-            //vigra::resizeMultiArraySplineInterpolation(inBlock, outBlock, vigra::BSpline<0, T>());
-            resample<N,T>(inBlock, outBlock, factor);
-            timeResample+= TOCN;
-           
-            TIC;
-            Roi<N> outRoi(factor < 1.0 ? vigra::ceil(factor*roi.p) : vigra::floor(factor*roi.p), V());
-            outRoi.q = outRoi.p + outBlock.shape();
-            sink->writeBlock(outRoi, outBlock);
-            timeWrite+= TOCN;
-            
-            ++blockNum;
-        }
+        Op op(source_, sink, factor);
+        BlockwiseExecutor<N> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
     }
 
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
     private:
+
+    struct Op {
+        struct Data {
+            vigra::MultiArray<N, T> inBlock;
+            vigra::MultiArray<N, T> outBlock;
+        };
+
+        Op(Source<N,T>* source, Sink<N,T>* sink, double factor)
+            : source(source), sink(sink), factor(factor)
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            d.inBlock.reshape(roi.shape());
+            source->readBlock(roi, d.inBlock);
+        }
+
+        void compute(size_t, const Roi<N>&, Data& d) {
+            V outBlockShape = factor < 1.0 ? vigra::ceil(factor*d.inBlock.shape()) : vigra::floor(factor*d.inBlock.shape());
+            d.outBlock.reshape(outBlockShape);
+            //vigra::resizeMultiArraySplineInterpolation(d.inBlock, d.outBlock, vigra::BSpline<0, T>());
+            resample<N,T>(d.inBlock, d.outBlock, factor);
+        }
+
+        void write(size_t, const Roi<N>& roi, Data& d) {
+            Roi<N> outRoi(factor < 1.0 ? vigra::ceil(factor*roi.p) : vigra::floor(factor*roi.p), V());
+            outRoi.q = outRoi.p + d.outBlock.shape();
+            sink->writeBlock(outRoi, d.outBlock);
+        }
+
+        Source<N,T>* source;
+        Sink<N,T>* sink;
+        double factor;
+    };
+
     V shape_;
     V blockShape_;
     Blocking<N> blocking_;
     Source<N,T>* source_;
+    int numThreads_;
 };
 
 } /* namespace BW */
@@ -0,0 +1,253 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef BW_RUNLABELLING_H
+#define BW_RUNLABELLING_H
+
+#include <vector>
+#include <algorithm>
+
+#include <vigra/multi_array.hxx>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define BW_HAVE_SSE2
+#  include <emmintrin.h>
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  endif
+#endif
+
+namespace BW {
+
+namespace detail {
+
+/**
+ * a maximal run [begin, end) of pixels with the same, non-zero value
+ * within a row along the first axis
+ */
+struct LabelRun {
+    LabelRun(vigra::MultiArrayIndex begin, vigra::UInt8 value)
+        : begin(begin), end(begin), value(value)
+    {}
+
+    vigra::MultiArrayIndex begin;
+    vigra::MultiArrayIndex end;
+    vigra::UInt8 value;
+};
+
+#ifdef BW_HAVE_SSE2
+inline int countTrailingZeros(unsigned int x) {
+#  if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#  else
+    return __builtin_ctz(x);
+#  endif
+}
+#endif
+
+/**
+ * pixel 'x' of 'row' differs from pixel x-1 (or is the first one):
+ * close the run ending before it and open one starting at it
+ */
+inline void runBoundary(const vigra::UInt8* row, vigra::MultiArrayIndex x,
+                        vigra::MultiArrayIndex stride, std::vector<LabelRun>& runs)
+{
+    if(x > 0 && row[(x-1)*stride] != 0) {
+        runs.back().end = x;
+    }
+    const vigra::UInt8 v = row[x*stride];
+    if(v != 0) {
+        runs.push_back(LabelRun(x, v));
+    }
+}
+
+/**
+ * append the runs of the row starting at 'row' with 'n' pixels
+ * 'stride' bytes apart to 'runs'
+ *
+ * For contiguous rows, 16 pixels are compared with their predecessors at
+ * once, and only the positions where the value changes are visited.
+ */
+inline void findRuns(const vigra::UInt8* row, vigra::MultiArrayIndex n,
+                     vigra::MultiArrayIndex stride, std::vector<LabelRun>& runs)
+{
+    vigra::MultiArrayIndex x = 0;
+#ifdef BW_HAVE_SSE2
+    if(stride == 1) {
+        int prev = 0;
+        for(; x+16 <= n; x += 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row+x));
+            const __m128i shifted = _mm_or_si128(_mm_slli_si128(v, 1), _mm_cvtsi32_si128(prev));
+            unsigned int changed = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v, shifted)) & 0xFFFF;
+            while(changed) {
+                runBoundary(row, x+countTrailingZeros(changed), 1, runs);
+                changed &= changed-1;
+            }
+            prev = row[x+15];
+        }
+    }
+#endif
+    for(; x<n; ++x) {
+        const vigra::UInt8 prev = x > 0 ? row[(x-1)*stride] : 0;
+        if(row[x*stride] != prev) {
+            runBoundary(row, x, stride, runs);
+        }
+    }
+    if(n > 0 && row[(n-1)*stride] != 0) {
+        runs.back().end = n;
+    }
+}
+
+template<class LabelType>
+LabelType findRun(std::vector<LabelType>& parent, LabelType i) {
+    while(parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/**
+ * union the overlapping runs with equal values of two adjacent rows,
+ * runs [a, aEnd) and [b, bEnd). The smaller run index becomes the root.
+ */
+template<class LabelType>
+void mergeRuns(const std::vector<LabelRun>& runs, std::vector<LabelType>& parent,
+               size_t a, size_t aEnd, size_t b, size_t bEnd)
+{
+    while(a < aEnd && b < bEnd) {
+        const LabelRun& ra = runs[a];
+        const LabelRun& rb = runs[b];
+        if(ra.begin < rb.end && rb.begin < ra.end && ra.value == rb.value) {
+            LabelType x = findRun(parent, (LabelType)a);
+            LabelType y = findRun(parent, (LabelType)b);
+            if(x < y) { parent[y] = x; } else { parent[x] = y; }
+        }
+        if(ra.end < rb.end) { ++a; } else { ++b; }
+    }
+}
+
+} /* namespace detail */
+
+/**
+ * Connected components of the non-zero pixels of 'in' with the direct
+ * neighbourhood (4 in 2D, 6 in 3D): adjacent pixels with the same value
+ * are connected. Labels start at 1 in scan order, 0 is background; the
+ * result is the same as that of vigra::labelImageWithBackground and
+ * vigra::labelVolumeWithBackground. Returns the largest label.
+ *
+ * Each row along the first axis is split into runs of equal values, the
+ * runs of adjacent rows are merged with a union find structure, and the
+ * labels are written run by run.
+ */
+template<int N, class S1, class LabelType, class S2>
+LabelType labelRuns(const vigra::MultiArrayView<N, vigra::UInt8, S1>& in,
+                    vigra::MultiArrayView<N, LabelType, S2> out)
+{
+    using detail::LabelRun;
+    typedef typename vigra::MultiArrayShape<N>::type V;
+
+    vigra_precondition(in.shape() == out.shape(), "labelRuns: shapes differ");
+    if(in.size() == 0) { return 0; }
+
+    const vigra::MultiArrayIndex n = in.shape(0);
+    const size_t numRows = in.size() / n;
+
+    //row r-rowStride[k] is the predecessor of row r along axis k
+    V rowStride;
+    size_t s = 1;
+    for(int k=1; k<N; ++k) {
+        rowStride[k] = s;
+        s *= in.shape(k);
+    }
+
+    //
+    // find the runs of all rows and merge them with those of the
+    // preceding rows
+    //
+    std::vector<LabelRun> runs;
+    std::vector<size_t> rowBegin(numRows+1);
+    std::vector<LabelType> parent;
+    V c;
+    for(size_t r=0; r<numRows; ++r) {
+        rowBegin[r] = runs.size();
+        detail::findRuns(&in[c], n, in.stride(0), runs);
+        for(size_t i=rowBegin[r]; i<runs.size(); ++i) {
+            parent.push_back((LabelType)i);
+        }
+        for(int k=1; k<N; ++k) {
+            if(c[k] > 0) {
+                const size_t p = r - rowStride[k];
+                detail::mergeRuns(runs, parent, rowBegin[r], runs.size(), rowBegin[p], rowBegin[p+1]);
+            }
+        }
+        for(int k=1; k<N; ++k) {
+            if(++c[k] < in.shape(k)) { break; }
+            c[k] = 0;
+        }
+    }
+    rowBegin[numRows] = runs.size();
+
+    //
+    // the roots are the first runs of their components in scan order
+    //
+    std::vector<LabelType> label(runs.size());
+    LabelType maxLabel = 0;
+    for(size_t i=0; i<runs.size(); ++i) {
+        const LabelType root = detail::findRun(parent, (LabelType)i);
+        label[i] = root == (LabelType)i ? ++maxLabel : label[root];
+    }
+
+    //
+    // write the labels row by row
+    //
+    const vigra::MultiArrayIndex os = out.stride(0);
+    c = V();
+    for(size_t r=0; r<numRows; ++r) {
+        LabelType* row = &out[c];
+        vigra::MultiArrayIndex x = 0;
+        for(size_t i=rowBegin[r]; i<rowBegin[r+1]; ++i) {
+            for(; x<runs[i].begin; ++x) { row[x*os] = 0; }
+            for(; x<runs[i].end; ++x)   { row[x*os] = label[i]; }
+        }
+        for(; x<n; ++x) { row[x*os] = 0; }
+        for(int k=1; k<N; ++k) {
+            if(++c[k] < in.shape(k)) { break; }
+            c[k] = 0;
+        }
+    }
+    return maxLabel;
+}
+
+} /* namespace BW */
+
+#endif /* BW_RUNLABELLING_H */
@@ -47,11 +47,11 @@ class Sink {
     Sink() {}
     virtual ~Sink() {};
 
-    void setShape(V shape) {
+    virtual void setShape(V shape) {
         shape_ = shape;
     }
 
-    void setBlockShape(V shape) {
+    virtual void setBlockShape(V shape) {
         blockShape_ = shape;
     }
 
@@ -33,11 +33,15 @@
 #include <vigra/hdf5impex.hxx>
 
 #include <bw/sink.h>
+#include <bw/hdf5dataset.h>
 
 namespace BW {
 
 /**
  * Write a block of data to a HDF5File
+ *
+ * The dataset is created on the first write and the file is kept open
+ * until close() is called or this object is destroyed.
  */
 template<int N, class T>
 class SinkHDF5 : public Sink<N,T> {
@@ -46,16 +50,38 @@ class SinkHDF5 : public Sink<N,T> {
 
     SinkHDF5(const std::string& hdf5file, const std::string& hdf5group, int compression = 1)
         : Sink<N,T>()
-        , hdf5file_(hdf5file)
-        , hdf5group_(hdf5group)
+        , dataset_(hdf5file, hdf5group)
         , compression_(compression)
         , fileCreated_(false)
     {
         vigra_precondition(compression >= 0 && compression <= 9, "compression must be >= 0 and <= 9");
     }
 
+    /**
+     * configure the raw data chunk cache of the dataset
+     */
+    void setChunkCache(const HDF5ChunkCache& cache) {
+        dataset_.setChunkCache(cache);
+    }
+
+    /**
+     * If enabled, chunks completely covered by a written block are
+     * compressed on 'numThreads' threads (0: one per core) and written raw
+     * instead of being compressed by the HDF5 library. This is most
+     * effective if the blocks are aligned to the chunks, i.e. if the blocks
+     * written have the shape set by setBlockShape. Partial chunks at the
+     * border of the blocks or the dataset are written normally.
+     */
+    void setParallelCompression(bool enable, int numThreads = 0) {
+        if(enable) {
+            pool_.reset(new ThreadPool(numThreads));
+        }
+        else {
+            pool_.reset();
+        }
+    }
+
     virtual bool writeBlock(Roi<N> roi, const vigra::MultiArrayView<N,T>& block) {
-        using namespace vigra;
         if(!fileCreated_) {
             if(this->shape() == V()) {
                 throw std::runtime_error("SinkHDF5: unknown shape");
@@ -63,26 +89,32 @@ class SinkHDF5 : public Sink<N,T> {
             if(this->blockShape() == V()) {
                 this->setBlockShape(this->shape());
             }
-            std::cout << "* write " << hdf5file_ << "/" << hdf5group_ << std::endl;
-            HDF5File out(hdf5file_, HDF5File::Open);
-            out.createDataset<N, T>(hdf5group_, this->shape(), 0, this->blockShape(), compression_);
-            out.close();
+            std::cout << "* write " << dataset_.filename() << "/" << dataset_.path() << std::endl;
+            dataset_.create(this->shape(), this->blockShape(), compression_);
             fileCreated_ = true;
         }
 
-        HDF5File out(hdf5file_, HDF5File::Open);
-        out.writeBlock(hdf5group_, roi.p, block);
-        out.close();
-
+        if(pool_) {
+            dataset_.writeBlockParallel(roi.p, block, *pool_);
+        }
+        else {
+            dataset_.writeBlock(roi.p, block);
+        }
         return true;
     }
 
+    /**
+     * write all cached data and close the file
+     */
+    void close() {
+        dataset_.close();
+    }
+
     private:
-    std::string hdf5file_;
-    std::string hdf5group_;
+    HDF5Dataset<N,T> dataset_;
     int compression_;
-    V shape_;
     bool fileCreated_;
+    boost::shared_ptr<ThreadPool> pool_;
 };
 
 } /* namespace BW */
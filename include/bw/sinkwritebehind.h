@@ -0,0 +1,241 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_SINKWRITEBEHIND_H
+#define BW_SINKWRITEBEHIND_H
+
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
+#include <bw/sink.h>
+
+namespace BW {
+
+/**
+ * Sink which queues the written blocks and writes them to 'sink'
+ * on a background thread, in the order in which they were written.
+ *
+ * writeBlock() blocks while 'maxQueued' blocks are waiting to be written.
+ * Once writing a block to 'sink' has failed (by an exception or by
+ * returning false), the remaining blocks are dropped and every later
+ * call of writeBlock(), flush() and close() throws the error. Call
+ * close() before reading the result: as a destructor must not throw, a
+ * write error which is first noticed by the destructor is only printed
+ * to std::cerr.
+ */
+template<int N, class T>
+class SinkWriteBehind : public Sink<N,T> {
+    public:
+    typedef typename Sink<N,T>::V V;
+
+    SinkWriteBehind(Sink<N,T>* sink, size_t maxQueued = 4)
+        : Sink<N,T>()
+        , sink_(sink)
+        , maxQueued_(maxQueued)
+        , writing_(false)
+        , stop_(false)
+        , failed_(false)
+        , reported_(false)
+    {
+        vigra_precondition(maxQueued > 0, "maxQueued must be > 0");
+    }
+
+    virtual ~SinkWriteBehind() {
+        bool reported;
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            reported = reported_;
+        }
+        try {
+            close();
+        }
+        catch(const std::exception& e) {
+            //a destructor must not throw; while unwinding, the caller
+            //already sees another error
+            if(!reported && !std::uncaught_exception()) {
+                std::cerr << "SinkWriteBehind: unreported write error: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    virtual void setShape(V shape) {
+        flush();
+        Sink<N,T>::setShape(shape);
+        sink_->setShape(shape);
+    }
+
+    virtual void setBlockShape(V shape) {
+        flush();
+        Sink<N,T>::setBlockShape(shape);
+        sink_->setBlockShape(shape);
+    }
+
+    virtual bool writeBlock(Roi<N> roi, const vigra::MultiArrayView<N,T>& block) {
+        Item item;
+        item.roi = roi;
+        item.block.reset(new vigra::MultiArray<N,T>(block));
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if(!thread_) {
+                thread_.reset(new boost::thread(boost::bind(&SinkWriteBehind::write, this)));
+            }
+            while(!failed_ && queue_.size() >= maxQueued_) {
+                changed_.wait(lock);
+            }
+            throwIfFailed();
+            queue_.push_back(item);
+        }
+        changed_.notify_all();
+        return true;
+    }
+
+    /**
+     * wait until all queued blocks have been written
+     */
+    void flush() {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(!failed_ && (!queue_.empty() || writing_)) {
+            changed_.wait(lock);
+        }
+        throwIfFailed();
+    }
+
+    /**
+     * write all queued blocks and stop the background thread
+     * (it is started again by the next writeBlock())
+     */
+    void close() {
+        try {
+            flush();
+        }
+        catch(...) {
+            stop();
+            throw;
+        }
+        stop();
+    }
+
+    private:
+    struct Item {
+        Roi<N> roi;
+        boost::shared_ptr<vigra::MultiArray<N,T> > block;
+    };
+
+    void write() {
+        while(true) {
+            Item item;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex_);
+                while(!stop_ && queue_.empty()) {
+                    changed_.wait(lock);
+                }
+                if(queue_.empty()) { return; }
+                item = queue_.front();
+                queue_.pop_front();
+                writing_ = true;
+            }
+            changed_.notify_all();
+
+            std::string error;
+            try {
+                if(!sink_->writeBlock(item.roi, *item.block)) {
+                    error = "SinkWriteBehind: write failed";
+                }
+            }
+            catch(const std::exception& e) {
+                error = e.what();
+                if(error.empty()) { error = "SinkWriteBehind: write failed"; }
+            }
+            catch(...) {
+                error = "SinkWriteBehind: write failed";
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                writing_ = false;
+                if(!error.empty()) {
+                    failed_ = true;
+                    error_ = error;
+                    queue_.clear();
+                }
+            }
+            changed_.notify_all();
+        }
+    }
+
+    void stop() {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        changed_.notify_all();
+        if(thread_) {
+            thread_->join();
+            thread_.reset();
+        }
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        stop_ = false;
+    }
+
+    /**
+     * rethrows an error of the background thread; the failure is kept,
+     * so that all later calls throw it as well. 'mutex_' must be locked
+     */
+    void throwIfFailed() {
+        if(failed_) {
+            reported_ = true;
+            throw std::runtime_error(error_);
+        }
+    }
+
+    Sink<N,T>* sink_;
+    size_t maxQueued_;
+
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    boost::shared_ptr<boost::thread> thread_;
+    std::deque<Item> queue_;
+    bool writing_;
+    bool stop_;
+    bool failed_;
+    //whether the failure was thrown to the caller at least once
+    bool reported_;
+    std::string error_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_SINKWRITEBEHIND_H */
@@ -0,0 +1,242 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#ifndef BW_SIZEFILTER_H
+#define BW_SIZEFILTER_H
+
+#include <vector>
+#include <algorithm>
+
+#include <bw/source.h>
+#include <bw/sink.h>
+#include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
+#include <bw/connectedcomponents.h>
+
+namespace BW {
+
+/**
+ * Removes the objects with less than 'minSize' or more than 'maxSize'
+ * pixels from the result of ConnectedComponents (not limited by RAM).
+ *
+ * The first pass determines the size of each object: from the statistics
+ * of 'cc' if it accumulated them (see ConnectedComponents::setStatistics()),
+ * otherwise by counting the labels of each block. The second pass writes
+ * the filtered labels (or a mask) to a Sink. Both passes work on the
+ * blocks in parallel; besides the blocks in flight, only one size and one
+ * new label per object are kept in memory.
+ */
+template<int N, class LabelType>
+class SizeFilter {
+    public:
+    typedef typename Roi<N>::V V;
+
+    SizeFilter(ConnectedComponents<N, LabelType>* cc, V blockShape)
+        : cc_(cc)
+        , blockShape_(blockShape)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
+        , numObjects_(0)
+    {
+        blocking_ = Blocking<N>(Roi<N>(V(), cc->shape()), blockShape, V());
+        std::cout << "* SizeFilter with " << blocking_.numBlocks() << " blocks" << std::endl;
+    }
+
+    /**
+     * Write the labels of the objects with 'minSize' <= size <= 'maxSize'
+     * to 'sink', renumbered to 1..numObjects() in the order of their old
+     * labels; all other pixels become 0.
+     */
+    void run(size_t minSize, size_t maxSize, Sink<N, LabelType>* sink) {
+        const std::vector<size_t>& s = sizes();
+        std::vector<LabelType> table(s.size(), 0);
+        numObjects_ = 0;
+        for(size_t l=1; l<s.size(); ++l) {
+            if(s[l] >= minSize && s[l] <= maxSize) {
+                table[l] = ++numObjects_;
+            }
+        }
+        std::cout << "* keep " << numObjects_ << " of " << s.size()-1 << " objects" << std::endl;
+        write(table, sink);
+    }
+
+    /**
+     * Write 1 for the pixels of the objects with 'minSize' <= size <= 'maxSize'
+     * to 'sink', 0 otherwise.
+     */
+    void runMask(size_t minSize, size_t maxSize, Sink<N, vigra::UInt8>* sink) {
+        const std::vector<size_t>& s = sizes();
+        std::vector<vigra::UInt8> table(s.size(), 0);
+        numObjects_ = 0;
+        for(size_t l=1; l<s.size(); ++l) {
+            if(s[l] >= minSize && s[l] <= maxSize) {
+                table[l] = 1;
+                ++numObjects_;
+            }
+        }
+        std::cout << "* keep " << numObjects_ << " of " << s.size()-1 << " objects" << std::endl;
+        write(table, sink);
+    }
+
+    /**
+     * number of objects kept by the last run() or runMask()
+     */
+    LabelType numObjects() const { return numObjects_; }
+
+    /**
+     * size of each object, indexed by label (entry 0 is unused)
+     *
+     * The sizes are determined anew on each call (and each run()), as
+     * ConnectedComponents::update() may have changed the labels since.
+     */
+    const std::vector<size_t>& sizes() {
+        const LabelType maxLabel = cc_->maxLabel();
+        sizes_.assign(maxLabel+1, 0);
+        if(cc_->statisticsEnabled()) {
+            const std::vector<ObjectStatistics<N> >& stats = cc_->statistics();
+            for(size_t l=1; l<stats.size(); ++l) {
+                sizes_[l] = stats[l].count;
+            }
+            return sizes_;
+        }
+
+        std::cout << "  count object sizes" << std::endl;
+        CountOp op(cc_, sizes_);
+        BlockwiseExecutor<N> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
+        return sizes_;
+    }
+
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
+    private:
+
+    template<class OutT>
+    void write(const std::vector<OutT>& table, Sink<N, OutT>* sink) {
+        sink->setShape(cc_->shape());
+        if(sink->blockShape() == V()) {
+            sink->setBlockShape(blockShape_);
+        }
+        FilterOp<OutT> op(cc_, table, sink);
+        BlockwiseExecutor<N> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
+    }
+
+    /**
+     * counts the pixels of each label in a block and adds them to 'sizes'
+     *
+     * The labels are read in compute(), as reading from ConnectedComponents
+     * (decompressing and relabelling) is thread safe.
+     */
+    struct CountOp {
+        struct Data {
+            std::vector<std::pair<LabelType, size_t> > counts;
+        };
+
+        CountOp(ConnectedComponents<N, LabelType>* cc, std::vector<size_t>& sizes)
+            : cc(cc), sizes(sizes)
+        {}
+
+        void read(size_t, const Roi<N>&, Data&) {}
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            vigra::MultiArray<N, LabelType> labels(roi.shape());
+            cc->readBlock(roi, labels);
+            LabelType* begin = labels.data();
+            LabelType* end = begin + labels.size();
+            std::sort(begin, end);
+            LabelType* it = begin;
+            while(it != end) {
+                LabelType* next = std::upper_bound(it, end, *it);
+                if(*it != 0) {
+                    d.counts.push_back(std::make_pair(*it, (size_t)(next-it)));
+                }
+                it = next;
+            }
+        }
+
+        void write(size_t, const Roi<N>&, Data& d) {
+            for(size_t k=0; k<d.counts.size(); ++k) {
+                sizes[d.counts[k].first] += d.counts[k].second;
+            }
+        }
+
+        ConnectedComponents<N, LabelType>* cc;
+        std::vector<size_t>& sizes;
+    };
+
+    /**
+     * maps the labels of a block through 'table' and writes them to 'sink'
+     */
+    template<class OutT>
+    struct FilterOp {
+        struct Data {
+            vigra::MultiArray<N, OutT> out;
+        };
+
+        FilterOp(ConnectedComponents<N, LabelType>* cc, const std::vector<OutT>& table, Sink<N, OutT>* sink)
+            : cc(cc), table(table), sink(sink)
+        {}
+
+        void read(size_t, const Roi<N>&, Data&) {}
+
+        void compute(size_t, const Roi<N>& roi, Data& d) {
+            vigra::MultiArray<N, LabelType> labels(roi.shape());
+            cc->readBlock(roi, labels);
+            d.out.reshape(roi.shape());
+            for(vigra::MultiArrayIndex k=0; k<labels.size(); ++k) {
+                d.out[k] = table[labels[k]];
+            }
+        }
+
+        void write(size_t, const Roi<N>& roi, Data& d) {
+            sink->writeBlock(roi, d.out);
+        }
+
+        ConnectedComponents<N, LabelType>* cc;
+        const std::vector<OutT>& table;
+        Sink<N, OutT>* sink;
+    };
+
+    ConnectedComponents<N, LabelType>* cc_;
+    V blockShape_;
+    Blocking<N> blocking_;
+    int numThreads_;
+    std::vector<size_t> sizes_;
+    LabelType numObjects_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_SIZEFILTER_H */
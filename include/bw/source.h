@@ -55,6 +55,13 @@ class Source {
     virtual void setRoi(Roi<N> roi) {};
 
     virtual V shape() const { return V(); };
+
+    /**
+     * shape of the chunks in which the data is stored natively,
+     * or V() if unknown. Reading blocks aligned to multiples of the
+     * chunk shape avoids decoding chunks more than once.
+     */
+    virtual V chunkShape() const { return V(); };
     virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const { return true; };
 };
 
@@ -33,11 +33,14 @@
 #include <vigra/hdf5impex.hxx>
 
 #include <bw/source.h>
+#include <bw/hdf5dataset.h>
 
 namespace BW {
 
 /**
  * Read a block of data from a HDF5File
+ *
+ * The file is kept open for the lifetime of this object.
  */
 template<int N, class T>
 class SourceHDF5 : public Source<N,T> {
@@ -46,24 +49,38 @@ class SourceHDF5 : public Source<N,T> {
 
     SourceHDF5(const std::string& hdf5file, const std::string& hdf5group)
         : Source<N,T>()
-        , hdf5file_(hdf5file)
-        , hdf5group_(hdf5group)
+        , dataset_(hdf5file, hdf5group)
     {
     }
 
+    /**
+     * configure the raw data chunk cache of the dataset
+     */
+    void setChunkCache(const HDF5ChunkCache& cache) {
+        dataset_.setChunkCache(cache);
+    }
+
+    /**
+     * If enabled, compressed chunks are read raw and decompressed on
+     * 'numThreads' threads (0: one per core) instead of by the HDF5 library.
+     * Only datasets compressed with deflate (and optionally shuffle)
+     * are decoded this way, others are read normally.
+     */
+    void setParallelDecoding(bool enable, int numThreads = 0) {
+        if(enable) {
+            pool_.reset(new ThreadPool(numThreads));
+        }
+        else {
+            pool_.reset();
+        }
+    }
+
     virtual void setRoi(Roi<N> roi) {
        roi_ = roi;
     }
 
     virtual V shape() const {
-        using namespace vigra;
-
-        V ret;
-        HDF5File f(hdf5file_, HDF5File::OpenReadOnly);
-        vigra::ArrayVector<hsize_t> sh = f.getDatasetShape(hdf5group_);
-        f.close();
-        vigra_precondition(sh.size() == N, "dataset shape is wrong");
-        std::copy(sh.begin(), sh.end(), ret.begin());
+        V ret = dataset_.shape();
         if(roi_ != Roi<N>()) {
             Roi<N> in(V(), ret);
             Roi<N> out;
@@ -73,10 +90,14 @@ class SourceHDF5 : public Source<N,T> {
         return ret;
     }
 
-    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
-        using namespace vigra;
+    /**
+     * chunk shape of the dataset (from its creation property list)
+     */
+    virtual V chunkShape() const {
+        return dataset_.chunkShape();
+    }
 
-        HDF5File in(hdf5file_, HDF5File::OpenReadOnly);
+    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
         if(roi_ != Roi<N>()) {
             roi += roi_.p;
             Roi<N> newRoi;
@@ -85,15 +106,19 @@ class SourceHDF5 : public Source<N,T> {
         }
         vigra_precondition(roi.shape() == block.shape(), "shapes differ");
 
-        in.readBlock(hdf5group_, roi.p, roi.q-roi.p, block);
-        in.close();
+        if(pool_) {
+            dataset_.readBlockParallel(roi.p, block, *pool_);
+        }
+        else {
+            dataset_.readBlock(roi.p, block);
+        }
         return true;
     }
 
     private:
-    std::string hdf5file_;
-    std::string hdf5group_;
+    HDF5Dataset<N,T> dataset_;
     Roi<N> roi_;
+    boost::shared_ptr<ThreadPool> pool_;
 };
 
 } /* namespace BW */
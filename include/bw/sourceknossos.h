@@ -109,6 +109,15 @@ class SourceKnossos : public Source<N,T> {
         return V();
     }
 
+    /**
+     * knossos cubes are 128^3 pixels
+     */
+    virtual V chunkShape() const {
+        V ret;
+        for(int i=0; i<N; ++i) { ret[i] = 128; }
+        return ret;
+    }
+
     virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
         vigra_precondition(roi.shape() == block.shape(), "shapes differ");
 
@@ -0,0 +1,227 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_SOURCEPREFETCHING_H
+#define BW_SOURCEPREFETCHING_H
+
+#include <map>
+#include <string>
+#include <stdexcept>
+
+#include <boost/thread.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+
+#include <bw/source.h>
+#include <bw/blocking.h>
+
+namespace BW {
+
+/**
+ * Source which reads the blocks of a Blocking from 'source' ahead of time
+ * on a background thread.
+ *
+ * Blocks are expected to be requested in the order of the Blocking.
+ * At most 'maxPrefetched' blocks are read ahead of the last requested one.
+ * Requests for blocks which are not part of the blocking (or have already
+ * been discarded) are read synchronously. All accesses to 'source' are
+ * serialized. Blocks for which 'source' returns false are not kept, so
+ * that their request reads them again and returns false as well.
+ */
+template<int N, class T>
+class SourcePrefetching : public Source<N,T> {
+    public:
+    typedef typename Source<N,T>::V V;
+
+    SourcePrefetching(Source<N,T>* source, const Blocking<N>& blocking, size_t maxPrefetched = 4)
+        : Source<N,T>()
+        , source_(source)
+        , blocking_(blocking)
+        , maxPrefetched_(maxPrefetched)
+        , nextFetch_(0)
+        , nextConsumed_(0)
+        , fetching_(NotFetching)
+        , stop_(false)
+        , failed_(false)
+    {
+        vigra_precondition(maxPrefetched > 0, "maxPrefetched must be > 0");
+    }
+
+    virtual ~SourcePrefetching() {
+        stopThread();
+    }
+
+    /**
+     * discards all prefetched blocks
+     */
+    virtual void setRoi(Roi<N> roi) {
+        stopThread();
+        boost::lock_guard<boost::mutex> lock(sourceMutex_);
+        source_->setRoi(roi);
+    }
+
+    virtual V shape() const {
+        boost::lock_guard<boost::mutex> lock(sourceMutex_);
+        return source_->shape();
+    }
+
+    virtual V chunkShape() const {
+        boost::lock_guard<boost::mutex> lock(sourceMutex_);
+        return source_->chunkShape();
+    }
+
+    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
+        vigra_precondition(roi.shape() == block.shape(), "shapes differ");
+
+        const size_t i = blocking_.find(roi);
+        if(i == blocking_.numBlocks()) {
+            return readSynchronously(roi, block);
+        }
+
+        BlockPtr b;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            if(!thread_) {
+                thread_.reset(new boost::thread(boost::bind(&SourcePrefetching::prefetch, this)));
+            }
+            if(i >= nextFetch_) {
+                //requested block lies ahead of the prefetcher
+                nextFetch_ = i+1;
+            }
+            else {
+                while(!failed_ && buffer_.find(i) == buffer_.end() && fetching_ == i) {
+                    changed_.wait(lock);
+                }
+                if(failed_) {
+                    throw std::runtime_error(error_);
+                }
+                typename std::map<size_t, BlockPtr>::iterator b_it = buffer_.find(i);
+                if(b_it != buffer_.end()) {
+                    b = b_it->second;
+                }
+            }
+            //blocks before 'i' will not be requested any more
+            nextConsumed_ = std::max(nextConsumed_, i+1);
+            buffer_.erase(buffer_.begin(), buffer_.lower_bound(i+1));
+        }
+        changed_.notify_all();
+
+        if(!b) {
+            return readSynchronously(roi, block);
+        }
+        block.copy(*b);
+        return true;
+    }
+
+    private:
+    typedef boost::shared_ptr<vigra::MultiArray<N,T> > BlockPtr;
+    static const size_t NotFetching = size_t(-1);
+
+    bool readSynchronously(const Roi<N>& roi, vigra::MultiArrayView<N,T>& block) const {
+        boost::lock_guard<boost::mutex> lock(sourceMutex_);
+        return source_->readBlock(roi, block);
+    }
+
+    void prefetch() const {
+        while(true) {
+            size_t i;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex_);
+                while(!stop_ && (nextFetch_ >= blocking_.numBlocks() || nextFetch_ >= nextConsumed_+maxPrefetched_)) {
+                    changed_.wait(lock);
+                }
+                if(stop_) { return; }
+                i = nextFetch_++;
+                fetching_ = i;
+            }
+
+            const Roi<N> roi = blocking_.block(i).second;
+            BlockPtr b(new vigra::MultiArray<N,T>(roi.shape()));
+            bool ok;
+            try {
+                ok = readSynchronously(roi, *b);
+            }
+            catch(const std::exception& e) {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                failed_ = true;
+                error_ = e.what();
+                fetching_ = NotFetching;
+                changed_.notify_all();
+                return;
+            }
+
+            {
+                boost::lock_guard<boost::mutex> lock(mutex_);
+                fetching_ = NotFetching;
+                if(ok && i >= nextConsumed_) {
+                    buffer_[i] = b;
+                }
+            }
+            changed_.notify_all();
+        }
+    }
+
+    void stopThread() {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        changed_.notify_all();
+        if(thread_) {
+            thread_->join();
+            thread_.reset();
+        }
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        buffer_.clear();
+        nextFetch_ = 0;
+        nextConsumed_ = 0;
+        stop_ = false;
+        failed_ = false;
+    }
+
+    Source<N,T>* source_;
+    Blocking<N> blocking_;
+    size_t maxPrefetched_;
+
+    mutable boost::mutex sourceMutex_;
+    mutable boost::mutex mutex_;
+    mutable boost::condition_variable changed_;
+    mutable boost::shared_ptr<boost::thread> thread_;
+    mutable std::map<size_t, BlockPtr> buffer_;
+    mutable size_t nextFetch_;
+    mutable size_t nextConsumed_;
+    mutable size_t fetching_;
+    mutable bool stop_;
+    mutable bool failed_;
+    mutable std::string error_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_SOURCEPREFETCHING_H */
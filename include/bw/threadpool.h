@@ -0,0 +1,196 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#ifndef BW_THREADPOOL_H
+#define BW_THREADPOOL_H
+
+#include <deque>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace BW {
+
+/**
+ * A fixed number of worker threads executing submitted tasks
+ * in the order of submission.
+ *
+ * Use a TaskGroup to wait for a set of tasks.
+ */
+class ThreadPool : boost::noncopyable {
+    public:
+    typedef boost::function<void ()> Task;
+
+    /**
+     * start 'numThreads' worker threads (0: one per core)
+     */
+    explicit ThreadPool(int numThreads = 0)
+        : stop_(false)
+    {
+        if(numThreads <= 0) {
+            numThreads = std::max(1u, boost::thread::hardware_concurrency());
+        }
+        for(int i=0; i<numThreads; ++i) {
+            threads_.create_thread(boost::bind(&ThreadPool::work, this));
+        }
+        numThreads_ = numThreads;
+    }
+
+    /**
+     * waits for all submitted tasks to finish
+     */
+    ~ThreadPool() {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        changed_.notify_all();
+        threads_.join_all();
+    }
+
+    int numThreads() const { return numThreads_; }
+
+    /**
+     * 'task' must not throw
+     */
+    void submit(const Task& task) {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            tasks_.push_back(task);
+        }
+        changed_.notify_one();
+    }
+
+    private:
+
+    void work() {
+        while(true) {
+            Task task;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex_);
+                while(!stop_ && tasks_.empty()) {
+                    changed_.wait(lock);
+                }
+                if(tasks_.empty()) { return; }
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    boost::thread_group threads_;
+    int numThreads_;
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    std::deque<Task> tasks_;
+    bool stop_;
+};
+
+/**
+ * A set of tasks run on a ThreadPool.
+ *
+ * wait() blocks until all tasks of this group have finished and
+ * rethrows the first error raised by any of them.
+ */
+class TaskGroup : boost::noncopyable {
+    public:
+    TaskGroup(ThreadPool& pool)
+        : pool_(pool)
+        , pending_(0)
+        , failed_(false)
+    {}
+
+    ~TaskGroup() {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(pending_ > 0) {
+            changed_.wait(lock);
+        }
+    }
+
+    void run(const ThreadPool::Task& task) {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            ++pending_;
+        }
+        pool_.submit(boost::bind(&TaskGroup::execute, this, task));
+    }
+
+    void wait() {
+        boost::unique_lock<boost::mutex> lock(mutex_);
+        while(pending_ > 0) {
+            changed_.wait(lock);
+        }
+        if(failed_) {
+            failed_ = false;
+            throw std::runtime_error(error_);
+        }
+    }
+
+    private:
+
+    void execute(const ThreadPool::Task& task) {
+        std::string error;
+        bool failed = false;
+        try {
+            task();
+        }
+        catch(const std::exception& e) {
+            failed = true;
+            error = e.what();
+        }
+        catch(...) {
+            failed = true;
+            error = "unknown error";
+        }
+        boost::lock_guard<boost::mutex> lock(mutex_);
+        if(failed && !failed_) {
+            failed_ = true;
+            error_ = error;
+        }
+        --pending_;
+        changed_.notify_all();
+    }
+
+    ThreadPool& pool_;
+    boost::mutex mutex_;
+    boost::condition_variable changed_;
+    size_t pending_;
+    bool failed_;
+    std::string error_;
+};
+
+} /* namespace BW */
+
+#endif /* BW_THREADPOOL_H */
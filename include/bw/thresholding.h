@@ -33,9 +33,74 @@
 #include <bw/source.h>
 #include <bw/sink.h>
 #include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
 
 namespace BW {
 
+/**
+ * If a pixel value of 'in' is greater than 'threshold', the corresponding
+ * pixel of 'out' is assigned the 'ifHigher' value, otherwise the 'ifLower' value.
+ */
+template<int N, class T, class S1, class S2>
+void threshold(const vigra::MultiArrayView<N, T, S1>& in,
+               vigra::MultiArrayView<N, vigra::UInt8, S2> out,
+               T threshold, vigra::UInt8 ifLower, vigra::UInt8 ifHigher)
+{
+    vigra_precondition(in.shape() == out.shape(), "shapes differ");
+    typename vigra::MultiArrayView<N, T, S1>::const_iterator a = in.begin();
+    typename vigra::MultiArrayView<N, vigra::UInt8, S2>::iterator b = out.begin();
+    for(; a != in.end(); ++a, ++b) {
+        *b = (*a > threshold) ? ifHigher : ifLower;
+    }
+}
+
+/**
+ * Source which thresholds the blocks read from 'source' on demand
+ * (see Thresholding::run for the meaning of the parameters).
+ */
+template<int N, class T>
+class ThresholdingSource : public Source<N, vigra::UInt8> {
+    public:
+    typedef typename Source<N, vigra::UInt8>::V V;
+
+    ThresholdingSource(Source<N,T>* source, T threshold, vigra::UInt8 ifLower, vigra::UInt8 ifHigher)
+        : Source<N, vigra::UInt8>()
+        , source_(source)
+        , threshold_(threshold)
+        , ifLower_(ifLower)
+        , ifHigher_(ifHigher)
+    {
+    }
+
+    virtual void setRoi(Roi<N> roi) {
+        source_->setRoi(roi);
+    }
+
+    virtual V shape() const {
+        return source_->shape();
+    }
+
+    virtual V chunkShape() const {
+        return source_->chunkShape();
+    }
+
+    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N, vigra::UInt8>& block) const {
+        vigra_precondition(roi.shape() == block.shape(), "shapes differ");
+        vigra::MultiArray<N, T> inBlock(roi.shape());
+        if(!source_->readBlock(roi, inBlock)) {
+            return false;
+        }
+        threshold(inBlock, block, threshold_, ifLower_, ifHigher_);
+        return true;
+    }
+
+    private:
+    Source<N,T>* source_;
+    T threshold_;
+    vigra::UInt8 ifLower_;
+    vigra::UInt8 ifHigher_;
+};
+
 /**
  *  thresholding (not limited by RAM)
  *
@@ -51,6 +116,7 @@ class Thresholding {
         : blockShape_(blockShape)
         , shape_(source->shape())
         , source_(source)
+        , numThreads_(std::max(1u, boost::thread::hardware_concurrency()))
     {
         vigra_precondition(shape_.size() == N, "dataset shape is wrong");
 
@@ -65,36 +131,57 @@ class Thresholding {
      * it is assigned the 'ifLower' value, otherwise the 'ifHigher' value.
      */
     void run(T threshold, vigra::UInt8 ifLower, vigra::UInt8 ifHigher, Sink<N,vigra::UInt8>* sink) {
-        using namespace vigra;
-
         sink->setShape(shape_);
 
-        int blockNum = 0;
-        typename Blocking<N>::Pair p;
-        BOOST_FOREACH(p, blocking_.blocks()) {
-            std::cout << "  block " << blockNum+1 << "/" << blocking_.numBlocks() << "        \r" << std::flush;
-            Roi<N> roi = p.second;
-
-            MultiArray<N, T> inBlock(roi.shape());
-            source_->readBlock(roi, inBlock);
-
-            MultiArray<N, UInt8> outBlock(inBlock.shape());
-            T* a     = inBlock.data();
-            UInt8* b = outBlock.data();
-            for(size_t k=0; k<inBlock.size(); ++k) {
-                *b = (*a > threshold) ? ifHigher : ifLower;
-                ++a; ++b;
-            }
-            sink->writeBlock(roi, outBlock);
-            ++blockNum;
-        }
+        Op op(source_, sink, threshold, ifLower, ifHigher);
+        BlockwiseExecutor<N> executor(blocking_);
+        executor.setNumThreads(numThreads_);
+        executor.run(op);
     }
 
+    /**
+     * number of threads used by run() (default: number of cores)
+     */
+    void setNumThreads(int n) { numThreads_ = n; }
+
     private:
+
+    struct Op {
+        struct Data {
+            vigra::MultiArray<N, T> in;
+            vigra::MultiArray<N, vigra::UInt8> out;
+        };
+
+        Op(Source<N,T>* source, Sink<N,vigra::UInt8>* sink, T threshold, vigra::UInt8 ifLower, vigra::UInt8 ifHigher)
+            : source(source), sink(sink), threshold(threshold), ifLower(ifLower), ifHigher(ifHigher)
+        {}
+
+        void read(size_t, const Roi<N>& roi, Data& d) {
+            d.in.reshape(roi.shape());
+            source->readBlock(roi, d.in);
+        }
+
+        void compute(size_t, const Roi<N>&, Data& d) {
+            d.out.reshape(d.in.shape());
+            BW::threshold(d.in, d.out, threshold, ifLower, ifHigher);
+        }
+
+        void write(size_t, const Roi<N>& roi, Data& d) {
+            sink->writeBlock(roi, d.out);
+        }
+
+        Source<N,T>* source;
+        Sink<N,vigra::UInt8>* sink;
+        T threshold;
+        vigra::UInt8 ifLower;
+        vigra::UInt8 ifHigher;
+    };
+
     V shape_;
     V blockShape_;
     Blocking<N> blocking_;
     Source<N,T>* source_;
+    int numThreads_;
 };
 
 } /* namespace BW */
@@ -0,0 +1,335 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <signal.h>
+
+#include <iostream>
+
+#include <vigra/multi_array.hxx>
+#include <vigra/unittest.hxx>
+
+#include <bw/array.h>
+#include <bw/arrayserver.h>
+#include <bw/arrayclient.h>
+
+#include "test_utils.h"
+
+using namespace BW;
+
+//the server of the forked process, stopped by SIGTERM
+static ArrayServer<3, vigra::UInt32>* serverToStop = 0;
+
+static void stopOnSignal(int) {
+    if(serverToStop) { serverToStop->stop(); }
+}
+
+struct ArrayServerTest {
+    typedef Array<3, vigra::UInt32> BA;
+    typedef BA::V V;
+    typedef vigra::MultiArray<3, vigra::UInt32> A;
+
+    static std::string socketPath() {
+        std::stringstream s;
+        s << "/tmp/test_arrayserver-" << getpid() << ".sock";
+        return s.str();
+    }
+
+    /**
+     * fork a server process which serves 'data' blocked with 'blockShape'
+     * until it receives SIGTERM
+     */
+    static pid_t startServer(const std::string& path, const A& data, V blockShape, size_t maxRequestBytes = 0) {
+        int p[2];
+        shouldEqual(pipe(p), 0);
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(p[0]);
+            {
+                BA ba(blockShape, data);
+                ArrayServer<3, vigra::UInt32> server(ba, path);
+                if(maxRequestBytes > 0) {
+                    server.setMaxRequestBytes(maxRequestBytes);
+                }
+                serverToStop = &server;
+                struct sigaction sa;
+                std::memset(&sa, 0, sizeof(sa));
+                sa.sa_handler = stopOnSignal;
+                sigaction(SIGTERM, &sa, 0);
+                char ready = 1;
+                write(p[1], &ready, 1);
+                close(p[1]);
+                server.run();
+                serverToStop = 0;
+            }
+            //the server has removed its socket when it went out of scope
+            _exit(0);
+        }
+        close(p[1]);
+        char ready = 0;
+        read(p[0], &ready, 1);
+        close(p[0]);
+        should(ready == 1);
+        return pid;
+    }
+
+    /**
+     * stop the server and check that it has exited cleanly and removed
+     * its socket
+     */
+    static void stopServer(pid_t pid, const std::string& path) {
+        kill(pid, SIGTERM);
+        int status;
+        waitpid(pid, &status, 0);
+        should(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        struct stat st;
+        should(stat(path.c_str(), &st) != 0);
+    }
+
+    static A createData(V sh) {
+        A data(sh);
+        FillRandom<vigra::UInt32, A::iterator>::fillRandom(data.begin(), data.end());
+        return data;
+    }
+
+    void testRead() {
+        std::string path = socketPath();
+        V sh(60,45,33);
+        V blockShape(16,16,8);
+        A data = createData(sh);
+        pid_t pid = startServer(path, data, blockShape);
+
+        {
+            ArrayClient<3, vigra::UInt32> client(path);
+            shouldEqual(client.blockShape(), blockShape);
+
+            V p(3,5,7), q(51,40,29);
+            A ref(data.subarray(p,q));
+
+            //plain reads
+            A out(q-p);
+            client.readSubarray(p, q, out);
+            should(arraysEqual(out, ref));
+
+            //pipelined reads of the individual slices
+            client.setMaxPending(4);
+            std::vector<A> slices(q[2]-p[2], A(V(q[0]-p[0], q[1]-p[1], 1)));
+            for(int z=p[2]; z<q[2]; ++z) {
+                client.submitRead(V(p[0],p[1],z), V(q[0],q[1],z+1), slices[z-p[2]]);
+            }
+            client.waitAll();
+            shouldEqual(client.numPending(), 0);
+            for(int z=p[2]; z<q[2]; ++z) {
+                A s(data.subarray(V(p[0],p[1],z), V(q[0],q[1],z+1)));
+                should(arraysEqual(slices[z-p[2]], s));
+            }
+
+            //reads via shared memory
+            client.setSharedMemoryThreshold(1);
+            out.init(0);
+            client.readSubarray(p, q, out);
+            should(arraysEqual(out, ref));
+            client.setSharedMemoryThreshold(0);
+
+            //reads of the compressed blocks
+            client.setTransferCompressedBlocks(true);
+            out.init(0);
+            client.readSubarray(p, q, out);
+            should(arraysEqual(out, ref));
+            client.setTransferCompressedBlocks(false);
+
+            //errors are reported, the connection remains usable
+            bool thrown = false;
+            try {
+                client.deleteSubarray(V(5,5,5), V(5,6,6)); //empty roi
+            }
+            catch(const std::runtime_error&) {
+                thrown = true;
+            }
+            should(thrown);
+            client.readSubarray(p, q, out);
+            should(arraysEqual(out, ref));
+        }
+
+        stopServer(pid, path);
+        std::cout << "... passed testRead" << std::endl;
+    }
+
+    void testWrite() {
+        std::string path = socketPath();
+        V sh(40,40,20);
+        V blockShape(10,10,10);
+        A data = createData(sh);
+        pid_t pid = startServer(path, data, blockShape);
+
+        {
+            ArrayClient<3, vigra::UInt32> client(path);
+
+            V p(5,5,5), q(25,30,15);
+            A w(q-p, 42);
+            client.writeSubarray(p, q, w);
+            data.subarray(p,q) = w;
+
+            A out(sh);
+            client.readSubarray(V(0,0,0), sh, out);
+            should(arraysEqual(out, data));
+
+            client.setTransferCompressedBlocks(true);
+            out.init(0);
+            client.readSubarray(V(0,0,0), sh, out);
+            should(arraysEqual(out, data));
+
+            //deletes whole blocks; missing blocks read as zero
+            client.deleteSubarray(V(0,0,0), V(10,10,10));
+            data.subarray(V(0,0,0), V(10,10,10)) = 0;
+            out.init(1);
+            client.readSubarray(V(0,0,0), sh, out);
+            should(arraysEqual(out, data));
+
+            client.setTransferCompressedBlocks(false);
+            out.init(1);
+            client.readSubarray(V(0,0,0), sh, out);
+            should(arraysEqual(out, data));
+        }
+
+        stopServer(pid, path);
+        std::cout << "... passed testWrite" << std::endl;
+    }
+
+    void testMaxRequestBytes() {
+        std::string path = socketPath();
+        V sh(40,40,20);
+        A data = createData(sh);
+        pid_t pid = startServer(path, data, V(10,10,10), 10*10*10*sizeof(vigra::UInt32));
+
+        {
+            ArrayClient<3, vigra::UInt32> client(path);
+            A out(V(10,10,10));
+            client.readSubarray(V(0,0,0), V(10,10,10), out);
+            A ref(data.subarray(V(0,0,0), V(10,10,10)));
+            should(arraysEqual(out, ref));
+
+            //a larger roi is rejected, the connection remains usable
+            bool thrown = false;
+            try {
+                A big(V(10,10,11));
+                client.readSubarray(V(0,0,0), V(10,10,11), big);
+            }
+            catch(const std::runtime_error&) {
+                thrown = true;
+            }
+            should(thrown);
+            out.init(0);
+            client.readSubarray(V(0,0,0), V(10,10,10), out);
+            should(arraysEqual(out, ref));
+        }
+
+        stopServer(pid, path);
+        std::cout << "... passed testMaxRequestBytes" << std::endl;
+    }
+
+    void testMaxQueuedBytes() {
+        std::string path = socketPath();
+        V sh(40,40,20);
+        A data = createData(sh);
+        BA ba(V(10,10,10), data);
+        ArrayServer<3, vigra::UInt32> server(ba, path);
+        const size_t responseBytes = sizeof(ArrayResponseHeader) + data.size()*sizeof(vigra::UInt32);
+        server.setMaxQueuedBytes(2*responseBytes);
+
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        shouldEqual(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+
+        //send many requests for the whole array without reading the responses
+        const int numRequests = 64;
+        for(int i=0; i<numRequests; ++i) {
+            ArrayRequestHeader h;
+            std::memset(&h, 0, sizeof(h));
+            h.magic = ArrayProtocolMagic;
+            h.opcode = OpRead;
+            h.requestId = i;
+            h.ndim = 3;
+            h.dtypeSize = sizeof(vigra::UInt32);
+            std::copy(sh.begin(), sh.end(), h.q);
+            protocol::sendAll(fd, &h, sizeof(h));
+        }
+        for(int i=0; i<100; ++i) {
+            server.processEvents(1);
+            should(server.queuedBytes() <= 3*responseBytes);
+        }
+
+        //once the client reads, all requests are answered
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        std::vector<char> received;
+        char tmp[65536];
+        while(received.size() < numRequests*responseBytes) {
+            server.processEvents(1);
+            should(server.queuedBytes() <= 3*responseBytes);
+            ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+            if(n > 0) {
+                received.insert(received.end(), tmp, tmp+n);
+            }
+        }
+        for(int i=0; i<numRequests; ++i) {
+            ArrayResponseHeader r;
+            std::memcpy(&r, &received[i*responseBytes], sizeof(r));
+            shouldEqual(r.requestId, (uint64_t)i);
+            shouldEqual(r.status, (uint32_t)StatusOk);
+            A out(sh);
+            std::memcpy(out.data(), &received[i*responseBytes+sizeof(r)], out.size()*sizeof(vigra::UInt32));
+            should(arraysEqual(out, data));
+        }
+        close(fd);
+
+        std::cout << "... passed testMaxQueuedBytes" << std::endl;
+    }
+};
+
+struct ArrayServerTestSuite : public vigra::test_suite {
+    ArrayServerTestSuite()
+        : vigra::test_suite("ArrayServerTestSuite")
+    {
+        add( testCase(&ArrayServerTest::testRead));
+        add( testCase(&ArrayServerTest::testWrite));
+        add( testCase(&ArrayServerTest::testMaxRequestBytes));
+        add( testCase(&ArrayServerTest::testMaxQueuedBytes));
+    }
+};
+
+int main(int argc, char ** argv) {
+    ArrayServerTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
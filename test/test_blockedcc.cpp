@@ -74,11 +74,6 @@ int main() {
     A a(vigra::Shape2(20,20));
     A b(vigra::Shape2(20,20));
 
-    UnionFindArray<int> ufd;
-
-    //blockMerge<2,int>(ufd, R(V(1,1), V(10,20)), a,
-    //                       R(V(5,6), V(30,40)), b);
-
     Blocking<2> bb( R(V(0,0), V(50,50)), V(10,20), V(1,1) );
     bb.pprint();
 
@@ -28,6 +28,8 @@
 /************************************************************************/
 
 #include <iostream>
+#include <set>
+#include <cstdlib>
 
 #include <bw/blocking.h>
 
@@ -46,6 +48,98 @@ void testConstruction() {
     Blocking<2> bb(Roi<2>(V(0,0), V(100,200)), V(50,25), V());
     shouldEqual(bb.numBlocks(), 2*8);
 }
+
+void testRowMajor() {
+    typedef Blocking<2>::V V;
+
+    Blocking<2> bb(Roi<2>(V(0,0), V(25,30)), V(10,10), V(1,1));
+    shouldEqual(bb.numBlocks(), 3*3);
+    size_t i = 0;
+    Blocking<2>::Pair b;
+    BOOST_FOREACH(b, bb) {
+        //the last axis varies fastest
+        shouldEqual(b.first, V(i/3, i%3));
+        shouldEqual(b.second.p, V(10*(i/3), 10*(i%3)));
+        shouldEqual(b.second.q, V(std::min<int>(10*(i/3)+11, 25), std::min<int>(10*(i%3)+11, 30)));
+        shouldEqual(bb.indexOf(b.first), i);
+        shouldEqual(bb.find(b.second), i);
+        ++i;
+    }
+    shouldEqual(i, bb.numBlocks());
+    shouldEqual(bb.find(Roi<2>(V(1,0), V(11,11))), bb.numBlocks());
+    shouldEqual(bb.end() - bb.begin(), 9);
+    shouldEqual((*(bb.begin()+4)).first, V(1,1));
+}
+
+template<int N>
+void checkOrder(typename Blocking<N>::V shape, BlockOrder order, bool neighbours) {
+    typedef typename Blocking<N>::V V;
+
+    Blocking<N> bb(Roi<N>(V(), shape), V(1), V(), order);
+    size_t n = Roi<N>(V(), shape).size();
+    shouldEqual(bb.numBlocks(), n);
+
+    std::set<V> seen;
+    for(size_t i=0; i<n; ++i) {
+        V x = bb.block(i).first;
+        for(int k=0; k<N; ++k) {
+            should(x[k] >= 0 && x[k] < shape[k]);
+        }
+        should(seen.insert(x).second);
+        shouldEqual(bb.indexOf(x), i);
+        if(neighbours && i > 0) {
+            V diff = x - bb.block(i-1).first;
+            int dist = 0;
+            for(int k=0; k<N; ++k) { dist += std::abs((int)diff[k]); }
+            shouldEqual(dist, 1);
+        }
+    }
+}
+
+void testCurveOrders() {
+    //all blocks are enumerated exactly once, also for grids which are
+    //not powers of two
+    checkOrder<3>(Blocking<3>::V(5,3,7), MortonOrder, false);
+    checkOrder<3>(Blocking<3>::V(5,3,7), HilbertOrder, false);
+    checkOrder<2>(Blocking<2>::V(1,9), HilbertOrder, false);
+
+    //Hilbert curve: consecutive blocks are neighbours
+    checkOrder<2>(Blocking<2>::V(16,16), HilbertOrder, true);
+    checkOrder<3>(Blocking<3>::V(8,8,8), HilbertOrder, true);
+    checkOrder<4>(Blocking<4>::V(4,4,4,4), HilbertOrder, true);
+
+    //Morton order of a 2x2 grid
+    typedef Blocking<2>::V V;
+    Blocking<2> bb(Roi<2>(V(0,0), V(20,20)), V(10,10), V(), MortonOrder);
+    shouldEqual(bb.block(0).first, V(0,0));
+    shouldEqual(bb.block(1).first, V(1,0));
+    shouldEqual(bb.block(2).first, V(0,1));
+    shouldEqual(bb.block(3).first, V(1,1));
+}
+
+void testChunkAlignedBlockShape() {
+    typedef Blocking<3>::V V;
+
+    //grows along the shortest axis in multiples of the chunk shape
+    V b = Blocking<3>::chunkAlignedBlockShape(V(1000,1000,1000), V(64,64,32), 128*128*128);
+    shouldEqual(b, V(128,128,128));
+    b = Blocking<3>::chunkAlignedBlockShape(V(1000,1000,1000), V(64,64,64), 100*100*100);
+    shouldEqual(b, V(192,64,64));
+
+    //blocks do not exceed the data
+    b = Blocking<3>::chunkAlignedBlockShape(V(100,1000,1000), V(64,64,64), 128*128*128);
+    shouldEqual(b, V(100,128,128));
+    b = Blocking<3>::chunkAlignedBlockShape(V(10,20,30), V(64,64,64), 128*128*128);
+    shouldEqual(b, V(10,20,30));
+
+    //at least one chunk
+    b = Blocking<3>::chunkAlignedBlockShape(V(1000,1000,1000), V(64,64,64), 10);
+    shouldEqual(b, V(64,64,64));
+
+    //unknown chunk shape
+    b = Blocking<3>::chunkAlignedBlockShape(V(1000,1000,1000), V(), 1000);
+    shouldEqual(b, V(10,10,10));
+}
 }; /* struct BlockingTest */
 
 struct BlockingTestSuite : public vigra::test_suite {
@@ -53,6 +147,9 @@ struct BlockingTestSuite : public vigra::test_suite {
         : vigra::test_suite("BlockingTestSuite")
     {
         add( testCase(&BlockingTest::testConstruction));
+        add( testCase(&BlockingTest::testRowMajor));
+        add( testCase(&BlockingTest::testCurveOrders));
+        add( testCase(&BlockingTest::testChunkAlignedBlockShape));
     }
 };
 
@@ -107,6 +107,37 @@ void testRoi() {
     shouldEqualSequence(r.begin(), r.end(), shouldResult.begin());
 }
 
+void testSource() {
+    using namespace vigra;
+    typedef ChannelSelector<4, float>::V V;
+
+    MultiArray<4, float> data(vigra::TinyVector<int, 4>(10,20,30,2));
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    {
+        HDF5File f("test.h5", HDF5File::Open);
+        f.write("test", data);
+    }
+
+    SourceHDF5<4, float> source("test.h5", "test");
+    for(int ch=0; ch<=1; ++ch) {
+        ChannelSelectorSource<4, float> cs(&source, 3, ch);
+        shouldEqual(cs.shape(), V(10,20,30));
+
+        MultiArray<3, float> r(V(4,7,9));
+        cs.readBlock(Roi<3>(V(2,3,4), V(6,10,13)), r);
+        MultiArrayView<3, float> shouldResult = data.bind<3>(ch).subarray(V(2,3,4), V(6,10,13));
+        shouldEqualSequence(r.begin(), r.end(), shouldResult.begin());
+
+        //region of interest is relative to the selected one
+        cs.setRoi(Roi<3>(V(1,3,5), V(7,9,30)));
+        shouldEqual(cs.shape(), V(6,6,25));
+        MultiArray<3, float> r2(V(6,6,25));
+        cs.readBlock(Roi<3>(V(), V(6,6,25)), r2);
+        MultiArrayView<3, float> shouldResult2 = data.bind<3>(ch).subarray(V(1,3,5), V(7,9,30));
+        shouldEqualSequence(r2.begin(), r2.end(), shouldResult2.begin());
+    }
+}
+
 }; /* struct ChannelSelectorTest */
 
 struct ChannelSelectorTestSuite : public vigra::test_suite {
@@ -115,6 +146,7 @@ struct ChannelSelectorTestSuite : public vigra::test_suite {
     {
         add( testCase(&ChannelSelectorTest::test) );
         add( testCase(&ChannelSelectorTest::testRoi) );
+        add( testCase(&ChannelSelectorTest::testSource) );
     }
 };
 
@@ -0,0 +1,168 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <iostream>
+
+#include <bw/blockwiseexecutor.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+/**
+ * records the order of the read and write calls,
+ * and the maximal number of blocks in flight
+ */
+struct RecordingOp {
+    struct Data {
+        size_t i;
+        size_t value;
+    };
+
+    RecordingOp() : inFlight(0), maxInFlight(0), failAt(size_t(-1)), readDelay(0) {}
+
+    void read(size_t i, const Roi<2>& roi, Data& d) {
+        if(readDelay > 0) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(readDelay));
+        }
+        reads.push_back(i);
+        d.i = i;
+        d.value = roi.p[0]*1000 + roi.p[1];
+        boost::lock_guard<boost::mutex> lock(mutex);
+        ++inFlight;
+        maxInFlight = std::max(maxInFlight, inFlight);
+    }
+
+    void compute(size_t i, const Roi<2>&, Data& d) {
+        if(i == failAt) {
+            throw std::runtime_error("compute failed");
+        }
+        d.value *= 2;
+    }
+
+    void write(size_t i, const Roi<2>& roi, Data& d) {
+        shouldEqual(d.i, i);
+        shouldEqual(d.value, 2*(roi.p[0]*1000 + roi.p[1]));
+        writes.push_back(i);
+        boost::lock_guard<boost::mutex> lock(mutex);
+        --inFlight;
+    }
+
+    std::vector<size_t> reads;
+    std::vector<size_t> writes;
+    boost::mutex mutex;
+    size_t inFlight;
+    size_t maxInFlight;
+    size_t failAt;
+    int readDelay; //milliseconds
+};
+
+struct BlockwiseExecutorTest {
+    typedef Blocking<2>::V V;
+
+    void testOrder() {
+        Blocking<2> bb(Roi<2>(V(0,0), V(100,200)), V(10,10), V());
+        for(int t=1; t<=8; t*=2) {
+            RecordingOp op;
+            BlockwiseExecutor<2> executor(bb);
+            executor.setVerbose(false);
+            executor.setNumThreads(t);
+            executor.setMaxInFlight(3);
+            executor.run(op);
+
+            shouldEqual(op.reads.size(), bb.numBlocks());
+            shouldEqual(op.writes.size(), bb.numBlocks());
+            for(size_t i=0; i<bb.numBlocks(); ++i) {
+                shouldEqual(op.reads[i], i);
+                shouldEqual(op.writes[i], i);
+            }
+            should(op.maxInFlight <= 3);
+        }
+    }
+
+    void testSlowRead() {
+        //while one thread reads the last block, the others must not
+        //claim blocks past the end
+        Blocking<2> bb(Roi<2>(V(0,0), V(30,30)), V(10,10), V());
+        for(int run=0; run<3; ++run) {
+            RecordingOp op;
+            op.readDelay = 20;
+            BlockwiseExecutor<2> executor(bb);
+            executor.setVerbose(false);
+            executor.setNumThreads(4);
+            executor.run(op);
+
+            shouldEqual(op.reads.size(), bb.numBlocks());
+            shouldEqual(op.writes.size(), bb.numBlocks());
+            for(size_t i=0; i<bb.numBlocks(); ++i) {
+                shouldEqual(op.reads[i], i);
+                shouldEqual(op.writes[i], i);
+            }
+        }
+    }
+
+    void testException() {
+        Blocking<2> bb(Roi<2>(V(0,0), V(100,200)), V(10,10), V());
+        RecordingOp op;
+        op.failAt = 17;
+        BlockwiseExecutor<2> executor(bb);
+        executor.setVerbose(false);
+        executor.setNumThreads(4);
+        bool thrown = false;
+        try {
+            executor.run(op);
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        should(thrown);
+        should(op.writes.size() <= 17);
+    }
+};
+
+struct BlockwiseExecutorTestSuite : public vigra::test_suite {
+    BlockwiseExecutorTestSuite()
+        : vigra::test_suite("BlockwiseExecutorTestSuite")
+    {
+        add( testCase(&BlockwiseExecutorTest::testOrder));
+        add( testCase(&BlockwiseExecutorTest::testSlowRead));
+        add( testCase(&BlockwiseExecutorTest::testException));
+    }
+};
+
+int main(int argc, char ** argv) {
+    BlockwiseExecutorTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -0,0 +1,144 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#include <iostream>
+
+#include <bw/filters.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/multi_convolution.hxx>
+#include <vigra/multi_tensorutilities.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+struct FiltersTest {
+    typedef vigra::MultiArray<3, float> A;
+    typedef A::difference_type V;
+
+    A data;
+
+    FiltersTest()
+        : data(V(30,21,17))
+    {
+        FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    }
+
+    /**
+     * filter 'data' blockwise with blocks much smaller than the halo
+     */
+    vigra::MultiArray<4, float> filterBlockwise(FilterType filter, double scale) {
+        SourceArray<3, float> source(data);
+        SinkArray<4, float> sink;
+        Filters<3, float> f(&source, V(8,7,5));
+        f.setNumThreads(3);
+        f.run(filter, scale, &sink);
+        typedef SinkArray<4, float>::V V1;
+        shouldEqual(sink.blockShape(), V1(8,7,5,Filters<3, float>::numChannels(filter)));
+        return sink.a_;
+    }
+
+    template<int M>
+    void checkChannels(const vigra::MultiArray<3, vigra::TinyVector<float, M> >& expected,
+                       const vigra::MultiArray<4, float>& r)
+    {
+        shouldEqual(r.shape(3), M);
+        for(int c=0; c<M; ++c) {
+            vigra::MultiArrayView<3, float, vigra::StridedArrayTag> channel = r.bindOuter(c);
+            vigra::MultiArrayView<3, float, vigra::StridedArrayTag>::iterator o = channel.begin();
+            for(int i=0; i<expected.size(); ++i, ++o) {
+                shouldEqualTolerance(*o, expected[i][c], 1e-4);
+            }
+        }
+    }
+
+    void testGaussianSmoothing() {
+        vigra::MultiArray<4, float> r = filterBlockwise(GaussianSmoothing, 2.0);
+        A expected(data.shape());
+        vigra::gaussianSmoothMultiArray(data, expected, 2.0);
+
+        shouldEqual(r.shape(3), 1);
+        vigra::MultiArrayView<3, float, vigra::StridedArrayTag> channel = r.bindOuter(0);
+        vigra::MultiArrayView<3, float, vigra::StridedArrayTag>::iterator o = channel.begin();
+        for(int i=0; i<expected.size(); ++i, ++o) {
+            shouldEqualTolerance(*o, expected[i], 1e-4);
+        }
+    }
+
+    void testGradientMagnitude() {
+        vigra::MultiArray<4, float> r = filterBlockwise(GaussianGradientMagnitude, 1.5);
+        vigra::MultiArray<3, vigra::TinyVector<float, 3> > gradient(data.shape());
+        vigra::gaussianGradientMultiArray(data, gradient, 1.5);
+        vigra::MultiArray<3, vigra::TinyVector<float, 1> > expected(data.shape());
+        for(int i=0; i<expected.size(); ++i) {
+            expected[i][0] = std::sqrt(vigra::squaredNorm(gradient[i]));
+        }
+        checkChannels(expected, r);
+    }
+
+    void testHessianEigenvalues() {
+        vigra::MultiArray<4, float> r = filterBlockwise(HessianOfGaussianEigenvalues, 1.0);
+        vigra::MultiArray<3, vigra::TinyVector<float, 6> > hessian(data.shape());
+        vigra::hessianOfGaussianMultiArray(data, hessian, 1.0);
+        vigra::MultiArray<3, vigra::TinyVector<float, 3> > expected(data.shape());
+        vigra::tensorEigenvaluesMultiArray(hessian, expected);
+        checkChannels(expected, r);
+    }
+
+    void testStructureTensorEigenvalues() {
+        vigra::MultiArray<4, float> r = filterBlockwise(StructureTensorEigenvalues, 1.0);
+        vigra::MultiArray<3, vigra::TinyVector<float, 6> > tensor(data.shape());
+        vigra::structureTensorMultiArray(data, tensor, 1.0, 2.0);
+        vigra::MultiArray<3, vigra::TinyVector<float, 3> > expected(data.shape());
+        vigra::tensorEigenvaluesMultiArray(tensor, expected);
+        checkChannels(expected, r);
+    }
+}; /* struct FiltersTest */
+
+struct FiltersTestSuite : public vigra::test_suite {
+    FiltersTestSuite()
+        : vigra::test_suite("FiltersTestSuite")
+    {
+        add( testCase(&FiltersTest::testGaussianSmoothing) );
+        add( testCase(&FiltersTest::testGradientMagnitude) );
+        add( testCase(&FiltersTest::testHessianEigenvalues) );
+        add( testCase(&FiltersTest::testStructureTensorEigenvalues) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    FiltersTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -71,6 +71,36 @@ void test() {
     shouldEqual(t.shape(), r.shape());
     shouldEqualSequence(r.begin(), r.end(), t.begin());
 }
+void testSource() {
+    using namespace vigra;
+    typedef Thresholding<3, float>::V V;
+
+    MultiArray<3, float> data(V(24,33,40));
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    {
+        HDF5File f("test.h5", HDF5File::Open);
+        f.write("test", data);
+    }
+
+    SourceHDF5<3, float> source("test.h5", "test");
+    ThresholdingSource<3, float> thresh(&source, 0.5, 0, 1);
+    shouldEqual(thresh.shape(), data.shape());
+
+    //a thresholding source can be the input of further operators
+    SinkHDF5<3, vigra::UInt8> sink("thresh.h5", "thresh");
+    sink.setBlockShape(V(10,10,10));
+    Thresholding<3, vigra::UInt8> bs(&thresh, V(6,4,7));
+    bs.run(0, 0, 1, &sink);
+
+    HDF5File f("thresh.h5", HDF5File::Open);
+    MultiArray<3, UInt8> r;
+    f.readAndResize("thresh", r);
+
+    MultiArray<3, UInt8> t(data.shape());
+    transformMultiArray(srcMultiArrayRange(data), destMultiArray(t), Threshold<float, UInt8>(-std::numeric_limits<float>::max(), 0.5, 1, 0));
+    shouldEqual(t.shape(), r.shape());
+    shouldEqualSequence(r.begin(), r.end(), t.begin());
+}
 }; /* struct ThresholdingTest */
 
 struct ThresholdingTestSuite : public vigra::test_suite {
@@ -78,6 +108,7 @@ struct ThresholdingTestSuite : public vigra::test_suite {
         : vigra::test_suite("ThresholdingTestSuite")
     {
         add( testCase(&ThresholdingTest::test) );
+        add( testCase(&ThresholdingTest::testSource) );
     }
 };
 
@@ -0,0 +1,467 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#include <iostream>
+#include <map>
+#include <cmath>
+
+#include <bw/connectedcomponents.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/hdf5impex.hxx>
+#include <vigra/labelvolume.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+/**
+ * source counting the blocks read from 'source'
+ */
+template<int N, class T>
+class CountingSource : public Source<N,T> {
+    public:
+    typedef typename Source<N,T>::V V;
+
+    CountingSource(Source<N,T>* source) : source_(source), numReads_(0) {}
+
+    virtual V shape() const { return source_->shape(); }
+
+    virtual bool readBlock(Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            ++numReads_;
+        }
+        return source_->readBlock(roi, block);
+    }
+
+    Source<N,T>* source_;
+    mutable int numReads_;
+    mutable boost::mutex mutex_;
+};
+
+struct ConnectedComponentsTest {
+    typedef vigra::MultiArray<3, vigra::UInt8> A;
+    typedef A::difference_type V;
+
+    /**
+     * whether 'a' and 'b' are the same labelling up to a renaming of the
+     * labels, with 0 (background) in the same places
+     */
+    template<class L1, class L2>
+    static bool sameLabelling(const vigra::MultiArrayView<3, L1>& a, const vigra::MultiArrayView<3, L2>& b) {
+        std::map<L1, L2> ab;
+        std::map<L2, L1> ba;
+        for(int i=0; i<a.size(); ++i) {
+            if((a[i] == 0) != (b[i] == 0)) { return false; }
+            typename std::map<L1, L2>::iterator it = ab.find(a[i]);
+            if(it == ab.end()) {
+                if(ba.count(b[i])) { return false; }
+                ab[a[i]] = b[i];
+                ba[b[i]] = a[i];
+            }
+            else if(it->second != b[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void testMatchesGlobalLabelling() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        MultiArray<3, int> expected(data.shape());
+        labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3> cc(&source, V(10,8,7), 3);
+        cc.writeResult("cc.h5", "cc");
+
+        HDF5File f("cc.h5", HDF5File::OpenReadOnly);
+        MultiArray<3, UInt32> r;
+        f.readAndResize("cc", r);
+        shouldEqual(r.shape(), data.shape());
+        should(sameLabelling(r, expected));
+    }
+
+    void testSource() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        MultiArray<3, int> expected(data.shape());
+        int numComponents = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        shouldEqual(cc.shape(), data.shape());
+        shouldEqual(cc.chunkShape(), V(10,8,7));
+        shouldEqual(cc.maxLabel(), numComponents);
+
+        MultiArray<3, UInt32> all(data.shape());
+        cc.readBlock(Roi<3>(V(), data.shape()), all);
+        should(sameLabelling(all, expected));
+
+        //regions not aligned to the blocks
+        Roi<3> rois[2] = { Roi<3>(V(3,5,7), V(29,17,20)), Roi<3>(V(9,7,6), V(11,9,8)) };
+        for(int i=0; i<2; ++i) {
+            MultiArray<3, UInt32> r(rois[i].shape());
+            cc.readBlock(rois[i], r);
+            MultiArray<3, UInt32> ref(all.subarray(rois[i].p, rois[i].q));
+            shouldEqualSequence(r.begin(), r.end(), ref.begin());
+        }
+
+        cc.setRoi(rois[0]);
+        shouldEqual(cc.shape(), rois[0].shape());
+        MultiArray<3, UInt32> r(rois[0].shape());
+        cc.readBlock(Roi<3>(V(), rois[0].shape()), r);
+        MultiArray<3, UInt32> ref(all.subarray(rois[0].p, rois[0].q));
+        shouldEqualSequence(r.begin(), r.end(), ref.begin());
+    }
+
+    void testScratchFile() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        MultiArray<3, int> expected(data.shape());
+        int numComponents = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        cc.setScratchFile("scratch.h5", "scratch");
+        cc.run();
+        shouldEqual(cc.maxLabel(), numComponents);
+
+        SinkArray<3, UInt32> sink;
+        cc.writeResult(&sink);
+        shouldEqual(sink.shape(), data.shape());
+        shouldEqual(sink.blockShape(), V(10,8,7));
+        for(int i=0; i<sink.count_.size(); ++i) {
+            shouldEqual(sink.count_[i], 1);
+        }
+        should(sameLabelling(sink.a_, expected));
+
+        //regions not aligned to the blocks
+        Roi<3> roi(V(3,5,7), V(29,17,20));
+        MultiArray<3, UInt32> r(roi.shape());
+        cc.readBlock(roi, r);
+        MultiArray<3, UInt32> ref(sink.a_.subarray(roi.p, roi.q));
+        shouldEqualSequence(r.begin(), r.end(), ref.begin());
+    }
+
+    void testLabelType64() {
+        using namespace vigra;
+
+        //small blobs, most of them inside a single block, and blocks
+        //without background on their faces
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 20 ? 1 : 0;
+        }
+        data.subarray(V(0,8,0), V(30,16,20)) = 1;
+        MultiArray<3, int> expected(data.shape());
+        int numComponents = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3, UInt64> cc(&source, V(10,8,7), 2);
+        shouldEqual(cc.maxLabel(), (UInt64)numComponents);
+
+        SinkHDF5<3, UInt64> sink("cc.h5", "cc64");
+        cc.writeResult(&sink);
+        sink.close();
+
+        HDF5File f("cc.h5", HDF5File::OpenReadOnly);
+        MultiArray<3, UInt64> r;
+        f.readAndResize("cc64", r);
+        shouldEqual(r.shape(), data.shape());
+        should(sameLabelling(r, expected));
+        shouldEqual(*std::max_element(r.begin(), r.end()), (UInt64)numComponents);
+    }
+
+    void testNumThreads() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        SourceArray<3, UInt8> source(data);
+
+        //the labels do not depend on the order in which the blocks are labelled
+        ConnectedComponents<3> cc1(&source, V(10,8,7), 1);
+        MultiArray<3, UInt32> r1(data.shape());
+        cc1.readBlock(Roi<3>(V(), data.shape()), r1);
+        for(int numThreads=2; numThreads<=8; numThreads *= 2) {
+            ConnectedComponents<3> cc(&source, V(10,8,7), numThreads);
+            MultiArray<3, UInt32> r(data.shape());
+            cc.readBlock(Roi<3>(V(), data.shape()), r);
+            shouldEqualSequence(r.begin(), r.end(), r1.begin());
+        }
+    }
+
+    void testIncremental() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        SourceArray<3, UInt8> array(data);
+        CountingSource<3, UInt8> source(&array);
+
+        for(int scratch=0; scratch<2; ++scratch) {
+            ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+            cc.setIncremental(true);
+            if(scratch) {
+                cc.setScratchFile("scratch.h5", "scratch");
+            }
+            cc.run();
+
+            //edits which cut through components, join them and fill whole blocks
+            Roi<3> edits[4] = { Roi<3>(V(0,0,9), V(30,25,10)),
+                                Roi<3>(V(3,2,1), V(25,4,19)),
+                                Roi<3>(V(12,10,8), V(18,14,12)),
+                                Roi<3>(V(10,8,7), V(20,16,14)) };
+            UInt8 values[4] = { 0, 1, 0, 1 };
+            for(int e=0; e<4; ++e) {
+                data.subarray(edits[e].p, edits[e].q) = values[e];
+
+                source.numReads_ = 0;
+                cc.update(edits[e]);
+                //only the blocks touching the edit are read again
+                int numTouched = 1;
+                for(int k=0; k<3; ++k) {
+                    const int bs = cc.chunkShape()[k];
+                    const int first = edits[e].p[k] > 0 ? (edits[e].p[k]-1)/bs : 0;
+                    const int last = (edits[e].q[k]-1)/bs;
+                    numTouched *= last-first+1;
+                }
+                shouldEqual(source.numReads_, numTouched);
+
+                MultiArray<3, int> expected(data.shape());
+                int numComponents = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+                shouldEqual(cc.maxLabel(), (UInt32)numComponents);
+
+                MultiArray<3, UInt32> r(data.shape());
+                cc.readBlock(Roi<3>(V(), data.shape()), r);
+                should(sameLabelling(r, expected));
+            }
+        }
+    }
+
+    /**
+     * reads the whole result of 'cc' 'n' times
+     */
+    struct Reader {
+        Reader(const ConnectedComponents<3>* cc, int n) : cc(cc), results(n) {}
+        void operator()() {
+            for(size_t k=0; k<results.size(); ++k) {
+                results[k].reshape(cc->shape());
+                cc->readBlock(Roi<3>(V(), cc->shape()), results[k]);
+            }
+        }
+        const ConnectedComponents<3>* cc;
+        std::vector<vigra::MultiArray<3, vigra::UInt32> > results;
+    };
+
+    void testReadDuringUpdate() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+        }
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        cc.setIncremental(true);
+        cc.run();
+
+        MultiArray<3, int> before(data.shape());
+        labelVolumeWithBackground(data, before, NeighborCode3DSix(), (UInt8)0);
+        Roi<3> edit(V(0,0,9), V(30,25,10));
+        data.subarray(edit.p, edit.q) = 0;
+        MultiArray<3, int> after(data.shape());
+        labelVolumeWithBackground(data, after, NeighborCode3DSix(), (UInt8)0);
+
+        //every read sees the result either before or after the update
+        Reader reader(&cc, 20);
+        boost::thread t(boost::ref(reader));
+        cc.update(edit);
+        t.join();
+        for(size_t k=0; k<reader.results.size(); ++k) {
+            should(sameLabelling(reader.results[k], before) || sameLabelling(reader.results[k], after));
+        }
+    }
+
+    /**
+     * whether 'stats' are the statistics of the objects 'labels' with
+     * 'intensities'
+     */
+    static bool statisticsMatch(const std::vector<ObjectStatistics<3> >& stats,
+                                const vigra::MultiArrayView<3, vigra::UInt32>& labels,
+                                const vigra::MultiArrayView<3, float>& intensities)
+    {
+        std::vector<ObjectStatistics<3> > expected(stats.size());
+        for(int i=0; i<labels.size(); ++i) {
+            if(labels[i] == 0) { continue; }
+            if(labels[i] >= expected.size()) { return false; }
+            expected[labels[i]].add(labels.scanOrderIndexToCoordinate(i), intensities[i]);
+        }
+        for(size_t l=1; l<stats.size(); ++l) {
+            if(stats[l].count != expected[l].count ||
+               stats[l].boundingBox.p != expected[l].boundingBox.p ||
+               stats[l].boundingBox.q != expected[l].boundingBox.q ||
+               stats[l].coordinateSum != expected[l].coordinateSum ||
+               std::abs(stats[l].intensitySum - expected[l].intensitySum) > 1e-3)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void testStatistics() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        MultiArray<3, float> intensities(data.shape());
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 45 ? 1 : 0;
+            intensities[i] = (std::rand() % 1000) / 100.0f;
+        }
+        SourceArray<3, UInt8> source(data);
+        SourceArray<3, float> intensitySource(intensities);
+
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        cc.setIncremental(true);
+        cc.setStatistics(true, &intensitySource);
+        shouldEqual(cc.statistics().size(), (size_t)cc.maxLabel()+1);
+
+        MultiArray<3, UInt32> r(data.shape());
+        cc.readBlock(Roi<3>(V(), data.shape()), r);
+        should(statisticsMatch(cc.statistics(), r, intensities));
+
+        //the statistics follow updates
+        Roi<3> edit(V(5,3,2), V(27,12,9));
+        data.subarray(edit.p, edit.q) = 1;
+        cc.update(edit);
+        shouldEqual(cc.statistics().size(), (size_t)cc.maxLabel()+1);
+        cc.readBlock(Roi<3>(V(), data.shape()), r);
+        should(statisticsMatch(cc.statistics(), r, intensities));
+
+        cc.writeStatistics("statistics.h5");
+        HDF5File f("statistics.h5", HDF5File::OpenReadOnly);
+        MultiArray<1, UInt64> count;
+        f.readAndResize("count", count);
+        shouldEqual(count.size(), cc.maxLabel()+1);
+        for(int l=0; l<count.size(); ++l) {
+            shouldEqual(count[l], (UInt64)cc.statistics()[l].count);
+        }
+    }
+
+    void testManyUpdates() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        MultiArray<3, float> intensities(data.shape());
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 25 ? 1 : 0;
+            intensities[i] = (std::rand() % 1000) / 100.0f;
+        }
+        SourceArray<3, UInt8> source(data);
+        SourceArray<3, float> intensitySource(intensities);
+
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        cc.setIncremental(true);
+        cc.setStatistics(true, &intensitySource);
+        cc.run();
+
+        //small edits which split, join, remove and create components, so
+        //that labels are reused and the union find structure is compacted
+        MultiArray<3, UInt32> r(data.shape());
+        for(int e=0; e<20; ++e) {
+            V p, q;
+            for(int k=0; k<3; ++k) {
+                p[k] = std::rand() % data.shape(k);
+                q[k] = std::min(p[k] + 1 + std::rand() % 6, data.shape(k));
+            }
+            const Roi<3> edit(p, q);
+            data.subarray(edit.p, edit.q) = (UInt8)(e % 3 == 0 ? 1 : 0);
+            for(int z=p[2]; z<q[2]; ++z) {
+                for(int y=p[1]; y<q[1]; y+=2) {
+                    data(p[0], y, z) = 1 - data(p[0], y, z);
+                }
+            }
+            cc.update(edit);
+
+            MultiArray<3, int> expected(data.shape());
+            int numComponents = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+            shouldEqual(cc.maxLabel(), (UInt32)numComponents);
+            cc.readBlock(Roi<3>(V(), data.shape()), r);
+            should(sameLabelling(r, expected));
+            shouldEqual(cc.statistics().size(), (size_t)cc.maxLabel()+1);
+            should(statisticsMatch(cc.statistics(), r, intensities));
+        }
+    }
+}; /* struct ConnectedComponentsTest */
+
+struct ConnectedComponentsTestSuite : public vigra::test_suite {
+    ConnectedComponentsTestSuite()
+        : vigra::test_suite("ConnectedComponentsTestSuite")
+    {
+        add( testCase(&ConnectedComponentsTest::testMatchesGlobalLabelling) );
+        add( testCase(&ConnectedComponentsTest::testSource) );
+        add( testCase(&ConnectedComponentsTest::testScratchFile) );
+        add( testCase(&ConnectedComponentsTest::testLabelType64) );
+        add( testCase(&ConnectedComponentsTest::testNumThreads) );
+        add( testCase(&ConnectedComponentsTest::testIncremental) );
+        add( testCase(&ConnectedComponentsTest::testStatistics) );
+        add( testCase(&ConnectedComponentsTest::testManyUpdates) );
+        add( testCase(&ConnectedComponentsTest::testReadDuringUpdate) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    ConnectedComponentsTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
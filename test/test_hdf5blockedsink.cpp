@@ -29,7 +29,12 @@
 
 #include <iostream>
 
+#include <boost/foreach.hpp>
+
 #include <bw/sinkhdf5.h>
+#include <bw/sourcehdf5.h>
+#include <bw/blocking.h>
+#include <bw/blockwiseexecutor.h>
 
 #include "test_utils.h"
 
@@ -40,6 +45,30 @@
 
 using namespace BW;
 
+/**
+ * copies a SourceHDF5 to a SinkHDF5; the executor reads and writes
+ * on different threads at the same time
+ */
+struct CopyOp {
+    typedef vigra::MultiArray<3, float> Data;
+
+    CopyOp(SourceHDF5<3, float>& source, SinkHDF5<3, float>& sink)
+        : source(source), sink(sink)
+    {}
+
+    void read(size_t, const Roi<3>& roi, Data& d) {
+        d.reshape(roi.shape());
+        source.readBlock(roi, d);
+    }
+    void compute(size_t, const Roi<3>&, Data&) {}
+    void write(size_t, const Roi<3>& roi, Data& d) {
+        sink.writeBlock(roi, d);
+    }
+
+    SourceHDF5<3, float>& source;
+    SinkHDF5<3, float>& sink;
+};
+
 struct SinkHDF5Test {
 void test() {
     using namespace vigra;
@@ -59,6 +88,71 @@ void test() {
     shouldEqual(r.shape(), data.shape());
     shouldEqualSequence(data.begin(), data.end(), r.begin());
 }
+
+void testParallelCompression() {
+    using namespace vigra;
+    typedef SinkHDF5<3, int>::V V;
+
+    MultiArray<3, int> data(V(25,20,30));
+    for(size_t i=0; i<data.size(); ++i) {
+        data[i] = i % 101;
+    }
+
+    SinkHDF5<3, int> bs("test.h5", "test", 5);
+    bs.setShape(data.shape());
+    bs.setBlockShape(V(10,10,10));
+    bs.setParallelCompression(true, 3);
+
+    //blocks aligned to the chunks (including partial chunks at the border)
+    Blocking<3> blocking(Roi<3>(V(), data.shape()), V(10,10,10));
+    typedef std::pair<V, Roi<3> > Block;
+    BOOST_FOREACH(const Block& b, blocking) {
+        bs.writeBlock(b.second, data.subarray(b.second.p, b.second.q));
+    }
+    //overwrite an unaligned block
+    Roi<3> unaligned(V(3,5,7), V(17,20,23));
+    MultiArray<3, int> update(unaligned.shape(), 7);
+    bs.writeBlock(unaligned, update);
+    data.subarray(unaligned.p, unaligned.q) = update;
+    bs.close();
+
+    HDF5File f("test.h5", HDF5File::OpenReadOnly);
+    MultiArray<3, int> r;
+    f.readAndResize("test", r);
+    shouldEqual(r.shape(), data.shape());
+    shouldEqualSequence(data.begin(), data.end(), r.begin());
+}
+
+void testConcurrentSourceAndSink() {
+    using namespace vigra;
+    typedef SinkHDF5<3, float>::V V;
+
+    MultiArray<3, float> data(V(40,30,50));
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    {
+        HDF5File f("test_in.h5", HDF5File::New);
+        f.write("in", data);
+    }
+
+    SourceHDF5<3, float> source("test_in.h5", "in");
+    SinkHDF5<3, float> sink("test.h5", "test", 1);
+    sink.setShape(data.shape());
+    sink.setBlockShape(V(8,8,8));
+
+    Blocking<3> blocking(Roi<3>(V(), data.shape()), V(8,8,8));
+    BlockwiseExecutor<3> executor(blocking);
+    executor.setVerbose(false);
+    executor.setNumThreads(4);
+    CopyOp op(source, sink);
+    executor.run(op);
+    sink.close();
+
+    HDF5File f("test.h5", HDF5File::OpenReadOnly);
+    MultiArray<3, float> r;
+    f.readAndResize("test", r);
+    shouldEqual(r.shape(), data.shape());
+    shouldEqualSequence(data.begin(), data.end(), r.begin());
+}
 }; /* struct SinkHDF5Test */
 
 struct SinkHDF5TestSuite : public vigra::test_suite {
@@ -66,6 +160,8 @@ struct SinkHDF5TestSuite : public vigra::test_suite {
         : vigra::test_suite("SinkHDF5TestSuite")
     {
         add( testCase(&SinkHDF5Test::test) );
+        add( testCase(&SinkHDF5Test::testParallelCompression) );
+        add( testCase(&SinkHDF5Test::testConcurrentSourceAndSink) );
     }
 };
 
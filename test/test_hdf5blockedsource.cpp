@@ -59,6 +59,89 @@ void test() {
     should(ret);
     shouldEqualSequence(data.begin(), data.end(), r.begin());
 }
+
+void testStrided() {
+    using namespace vigra;
+    typedef SourceHDF5<3, float>::V V;
+
+    HDF5File f("test.h5", HDF5File::Open);
+    MultiArray<3, float> data(V(10,20,30));
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    f.write<3, float>("test", data);
+    f.close();
+
+    SourceHDF5<3, float> bs("test.h5", "test");
+    bs.setChunkCache(HDF5ChunkCache(1024*1024, 521, 1.0));
+
+    //read directly into a subarray of a larger array
+    MultiArray<3, float> r(V(14,25,31), -1.0f);
+    MultiArrayView<3, float> v = r.subarray(V(2,3,1), V(12,23,31));
+    bs.readBlock(Roi<3>(V(), data.shape()), v);
+    shouldEqualSequence(data.begin(), data.end(), v.begin());
+    shouldEqual(r(0,0,0), -1.0f);
+    shouldEqual(r(12,23,0), -1.0f);
+
+    //read into a view with a stride along the first axis
+    MultiArray<4, float> c(Shape4(3,5,6,7), -1.0f);
+    MultiArrayView<3, float> w = c.bindAt(0, 1);
+    bs.readBlock(Roi<3>(V(2,3,4), V(7,9,11)), w);
+    MultiArrayView<3, float> ref = data.subarray(V(2,3,4), V(7,9,11));
+    shouldEqualSequence(ref.begin(), ref.end(), w.begin());
+    MultiArrayView<3, float> untouched = c.bindAt(0, 0);
+    for(MultiArrayView<3, float>::iterator it = untouched.begin(); it != untouched.end(); ++it) {
+        shouldEqual(*it, -1.0f);
+    }
+}
+
+void testParallelDecoding() {
+    using namespace vigra;
+    typedef SourceHDF5<3, float>::V V;
+
+    MultiArray<3, float> data(V(50,41,33));
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+
+    for(int shuffle=0; shuffle<=1; ++shuffle) {
+        //dataset with shuffle and deflate, of which only a part is written
+        hid_t file = H5Fcreate("test.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        hsize_t dims[3]  = {33, 41, 50};
+        hsize_t chunk[3] = {8, 10, 12};
+        hid_t space = H5Screate_simple(3, dims, NULL);
+        hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(plist, 3, chunk);
+        if(shuffle) {
+            H5Pset_shuffle(plist);
+        }
+        H5Pset_deflate(plist, 4);
+        float fill = 42.0f;
+        H5Pset_fill_value(plist, H5T_NATIVE_FLOAT, &fill);
+        hid_t dataset = H5Dcreate(file, "test", H5T_NATIVE_FLOAT, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+        hsize_t start[3] = {0, 0, 0};
+        hsize_t count[3] = {20, 41, 50};
+        H5Sselect_hyperslab(space, H5S_SELECT_SET, start, NULL, count, NULL);
+        hid_t memspace = H5Screate_simple(3, count, NULL);
+        H5Dwrite(dataset, H5T_NATIVE_FLOAT, memspace, space, H5P_DEFAULT, data.data());
+        H5Sclose(memspace);
+        H5Dclose(dataset);
+        H5Pclose(plist);
+        H5Sclose(space);
+        H5Fclose(file);
+
+        MultiArray<3, float> expected(data.shape(), 42.0f);
+        expected.subarray(V(0,0,0), V(50,41,20)) = data.subarray(V(0,0,0), V(50,41,20));
+
+        SourceHDF5<3, float> bs("test.h5", "test");
+        bs.setParallelDecoding(true, 3);
+        shouldEqual(bs.chunkShape(), V(12,10,8));
+
+        Roi<3> rois[3] = { Roi<3>(V(), data.shape()), Roi<3>(V(3,5,7), V(49,40,31)), Roi<3>(V(13,11,9), V(14,12,10)) };
+        for(int i=0; i<3; ++i) {
+            MultiArray<3, float> r(rois[i].shape());
+            bs.readBlock(rois[i], r);
+            MultiArrayView<3, float> ref = expected.subarray(rois[i].p, rois[i].q);
+            shouldEqualSequence(ref.begin(), ref.end(), r.begin());
+        }
+    }
+}
 }; /* struct SourceHDF5Test */
 
 struct SourceHDF5TestSuite : public vigra::test_suite {
@@ -66,6 +149,8 @@ struct SourceHDF5TestSuite : public vigra::test_suite {
         : vigra::test_suite("SourceHDF5TestSuite")
     {
         add( testCase(&SourceHDF5Test::test) );
+        add( testCase(&SourceHDF5Test::testStrided) );
+        add( testCase(&SourceHDF5Test::testParallelDecoding) );
     }
 };
 
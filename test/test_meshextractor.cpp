@@ -0,0 +1,300 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <bw/meshextractor.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/hdf5impex.hxx>
+
+using namespace BW;
+
+typedef std::set<std::vector<vigra::UInt32> > FaceSet;
+
+/**
+ * the faces of the mesh in group 'prefix', as vertex coordinates
+ */
+FaceSet readFaces(const std::string& filename, const std::string& prefix) {
+    vigra::HDF5File f(filename, vigra::HDF5File::OpenReadOnly);
+    vigra::MultiArray<2, vigra::UInt32> verts, faces;
+    f.readAndResize(prefix+"verts", verts);
+    f.readAndResize(prefix+"faces", faces);
+    FaceSet s;
+    for(int i=0; i<faces.shape(0); ++i) {
+        std::vector<vigra::UInt32> face;
+        for(int j=0; j<4; ++j) {
+            for(int k=0; k<3; ++k) {
+                face.push_back(verts(faces(i, j), k));
+            }
+        }
+        s.insert(face);
+    }
+    return s;
+}
+
+struct MeshExtractorTest {
+    typedef vigra::TinyVector<vigra::MultiArrayIndex, 3> V;
+
+    MeshExtractorTest()
+        : labels(V(40,37,29))
+    {
+        //objects away from the volume border; 1 and 2 touch
+        labels.subarray(V(3,3,3), V(20,15,12))    = 1;
+        labels.subarray(V(20,5,4), V(30,25,20))   = 2;
+        labels.subarray(V(10,20,15), V(13,24,18)) = 5;
+        labels.subarray(V(32,30,22), V(34,31,23)) = 7; //2 voxels
+    }
+
+    /**
+     * number of faces between voxels whose labels differ after
+     * mapping those not in 'objects' to 0
+     */
+    size_t countFaces(const std::set<vigra::UInt32>& objects) {
+        size_t n = 0;
+        for(int i=0; i<labels.shape(0); ++i)
+        for(int j=0; j<labels.shape(1); ++j)
+        for(int k=0; k<labels.shape(2); ++k) {
+            const V c(i,j,k);
+            for(int l=0; l<3; ++l) {
+                V d = c;
+                d[l] += 1;
+                if(d[l] >= labels.shape(l)) { continue; }
+                vigra::UInt32 a = objects.count(labels[c]) ? labels[c] : 0;
+                vigra::UInt32 b = objects.count(labels[d]) ? labels[d] : 0;
+                if(a != b) { ++n; }
+            }
+        }
+        return n;
+    }
+
+    void testPerObject() {
+        SourceArray<3, vigra::UInt32> source(labels);
+        MeshExtractor<3, vigra::UInt32> me(&source, V(16,16,16));
+        me.setNumThreads(3);
+        me.runMultiLabel("test_mesh_objects.h5", PerObjectMeshes);
+
+        const vigra::UInt32 objects[] = {1, 2, 5, 7};
+        for(int i=0; i<4; ++i) {
+            std::ostringstream single;
+            single << "test_mesh_" << objects[i] << ".h5";
+            me.run(objects[i], single.str());
+
+            std::ostringstream group;
+            group << objects[i] << "/";
+            FaceSet expected = readFaces(single.str(), "");
+            FaceSet actual = readFaces("test_mesh_objects.h5", group.str());
+            shouldEqual(actual.size(), countFaces(std::set<vigra::UInt32>(objects+i, objects+i+1)));
+            should(actual == expected);
+        }
+    }
+
+    void testShared() {
+        SourceArray<3, vigra::UInt32> source(labels);
+        MeshExtractor<3, vigra::UInt32> me(&source, V(16,16,16));
+        me.runMultiLabel("test_mesh_shared.h5", SharedMesh);
+
+        std::set<vigra::UInt32> all;
+        all.insert(1); all.insert(2); all.insert(5); all.insert(7);
+        FaceSet faces = readFaces("test_mesh_shared.h5", "");
+        shouldEqual(faces.size(), countFaces(all));
+
+        vigra::HDF5File f("test_mesh_shared.h5", vigra::HDF5File::OpenReadOnly);
+        vigra::MultiArray<2, vigra::UInt32> faceLabels, verts;
+        f.readAndResize("faceLabels", faceLabels);
+        f.readAndResize("verts", verts);
+        shouldEqual(faceLabels.shape(0), (vigra::MultiArrayIndex)faces.size());
+        size_t between12 = 0;
+        for(int i=0; i<faceLabels.shape(0); ++i) {
+            should(faceLabels(i, 0) != faceLabels(i, 1));
+            if(faceLabels(i, 0) + faceLabels(i, 1) == 3 && faceLabels(i, 0) != 0 && faceLabels(i, 1) != 0) { ++between12; }
+        }
+        //contact area of objects 1 and 2
+        shouldEqual(between12, (size_t)(10*8));
+        //every vertex is used
+        std::set<std::vector<vigra::UInt32> > vertexSet;
+        for(int i=0; i<verts.shape(0); ++i) {
+            std::vector<vigra::UInt32> v(3);
+            for(int k=0; k<3; ++k) { v[k] = verts(i, k); }
+            vertexSet.insert(v);
+        }
+        shouldEqual(vertexSet.size(), (size_t)verts.shape(0));
+    }
+
+    /**
+     * the datasets 'names' of both files have the same contents
+     */
+    void compareFiles(const std::string& file0, const std::string& file1, const std::vector<std::string>& names) {
+        vigra::HDF5File f0(file0, vigra::HDF5File::OpenReadOnly);
+        vigra::HDF5File f1(file1, vigra::HDF5File::OpenReadOnly);
+        for(size_t i=0; i<names.size(); ++i) {
+            vigra::MultiArray<2, vigra::UInt32> a0, a1;
+            f0.readAndResize(names[i], a0);
+            f1.readAndResize(names[i], a1);
+            should(a0.shape() == a1.shape());
+            should(a0 == a1);
+        }
+    }
+
+    void testDeterministic() {
+        SourceArray<3, vigra::UInt32> source(labels);
+        const int threads[] = {1, 4};
+        for(int i=0; i<2; ++i) {
+            MeshExtractor<3, vigra::UInt32> me(&source, V(16,16,16));
+            me.setNumThreads(threads[i]);
+            std::ostringstream single, shared;
+            single << "test_mesh_threads_single_" << threads[i] << ".h5";
+            shared << "test_mesh_threads_shared_" << threads[i] << ".h5";
+            me.run(2, single.str());
+            me.runMultiLabel(shared.str(), SharedMesh);
+        }
+        std::vector<std::string> names;
+        names.push_back("verts");
+        names.push_back("faces");
+        names.push_back("lines");
+        compareFiles("test_mesh_threads_single_1.h5", "test_mesh_threads_single_4.h5", names);
+
+        //the mesh is streamed to the file; many small chunks give the same result
+        {
+            MeshExtractor<3, vigra::UInt32> me(&source, V(16,16,16));
+            me.setChunkSize(7);
+            me.run(2, "test_mesh_threads_single_chunks.h5");
+        }
+        compareFiles("test_mesh_threads_single_1.h5", "test_mesh_threads_single_chunks.h5", names);
+        names.push_back("faceLabels");
+        compareFiles("test_mesh_threads_shared_1.h5", "test_mesh_threads_shared_4.h5", names);
+
+        //the blocks are stitched: no vertex or line occurs twice, and
+        //every line is the edge of a face
+        vigra::HDF5File f("test_mesh_threads_single_4.h5", vigra::HDF5File::OpenReadOnly);
+        vigra::MultiArray<2, vigra::UInt32> verts, faces, lines;
+        f.readAndResize("verts", verts);
+        f.readAndResize("faces", faces);
+        f.readAndResize("lines", lines);
+        std::set<std::vector<vigra::UInt32> > vertexSet;
+        for(int i=0; i<verts.shape(0); ++i) {
+            std::vector<vigra::UInt32> v(3);
+            for(int k=0; k<3; ++k) { v[k] = verts(i, k); }
+            vertexSet.insert(v);
+        }
+        shouldEqual(vertexSet.size(), (size_t)verts.shape(0));
+        std::set<std::pair<vigra::UInt32, vigra::UInt32> > edges, lineSet;
+        for(int i=0; i<faces.shape(0); ++i) {
+            for(int j=0; j<4; ++j) {
+                vigra::UInt32 a = faces(i, j), b = faces(i, (j+1)%4);
+                edges.insert(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        for(int i=0; i<lines.shape(0); ++i) {
+            lineSet.insert(std::make_pair(lines(i, 0), lines(i, 1)));
+        }
+        shouldEqual(lineSet.size(), (size_t)lines.shape(0));
+        should(lineSet == edges);
+    }
+
+    void testSmallBlocks() {
+        //many blocks, whose border vertices are dropped by the stitcher
+        //once all blocks sharing them are written, and objects whose
+        //meshes are finished before the last block
+        SourceArray<3, vigra::UInt32> source(labels);
+        const V blockShapes[] = { V(16,16,16), V(5,7,6) };
+        for(int i=0; i<2; ++i) {
+            MeshExtractor<3, vigra::UInt32> me(&source, blockShapes[i]);
+            std::ostringstream single, objects;
+            single << "test_mesh_blocks_" << i << ".h5";
+            objects << "test_mesh_blocks_objects_" << i << ".h5";
+            me.run(2, single.str());
+            me.runMultiLabel(objects.str(), PerObjectMeshes);
+        }
+        const char* prefixes[] = { "", "1/", "2/", "5/", "7/" };
+        for(int i=0; i<5; ++i) {
+            const std::string file0 = i == 0 ? "test_mesh_blocks_0.h5" : "test_mesh_blocks_objects_0.h5";
+            const std::string file1 = i == 0 ? "test_mesh_blocks_1.h5" : "test_mesh_blocks_objects_1.h5";
+            const std::string prefix(prefixes[i]);
+            should(readFaces(file0, prefix) == readFaces(file1, prefix));
+
+            //each vertex and line is written once
+            vigra::HDF5File f0(file0, vigra::HDF5File::OpenReadOnly);
+            vigra::HDF5File f1(file1, vigra::HDF5File::OpenReadOnly);
+            shouldEqual(f0.getDatasetShape(prefix+"verts")[0], f1.getDatasetShape(prefix+"verts")[0]);
+            shouldEqual(f0.getDatasetShape(prefix+"lines")[0], f1.getDatasetShape(prefix+"lines")[0]);
+        }
+    }
+
+    void testFilters() {
+        SourceArray<3, vigra::UInt32> source(labels);
+        MeshExtractor<3, vigra::UInt32> me(&source, V(16,16,16));
+        std::vector<vigra::UInt32> whitelist;
+        whitelist.push_back(2);
+        whitelist.push_back(5);
+        whitelist.push_back(7);
+        me.setLabelWhitelist(whitelist);
+        me.setMinSize(3);
+        me.runMultiLabel("test_mesh_filtered.h5", PerObjectMeshes);
+
+        vigra::HDF5File f("test_mesh_filtered.h5", vigra::HDF5File::OpenReadOnly);
+        should(!f.existsDataset("1/faces"));
+        should(f.existsDataset("2/faces"));
+        should(f.existsDataset("5/faces"));
+        should(!f.existsDataset("7/faces"));
+        f.close();
+
+        std::set<vigra::UInt32> two;
+        two.insert(2);
+        shouldEqual(readFaces("test_mesh_filtered.h5", "2/").size(), countFaces(two));
+    }
+
+    vigra::MultiArray<3, vigra::UInt32> labels;
+}; /* struct MeshExtractorTest */
+
+struct MeshExtractorTestSuite : public vigra::test_suite {
+    MeshExtractorTestSuite()
+        : vigra::test_suite("MeshExtractorTestSuite")
+    {
+        add( testCase(&MeshExtractorTest::testPerObject) );
+        add( testCase(&MeshExtractorTest::testShared) );
+        add( testCase(&MeshExtractorTest::testDeterministic) );
+        add( testCase(&MeshExtractorTest::testSmallBlocks) );
+        add( testCase(&MeshExtractorTest::testFilters) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    MeshExtractorTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
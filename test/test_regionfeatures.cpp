@@ -31,7 +31,11 @@
 #pragma warning (disable:4503)
 #endif
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <bw/sourcehdf5.h>
 #include <bw/sinkhdf5.h>
@@ -73,6 +77,117 @@ void test() {
     RegionFeatures<3, float, uint32_t> bs(&dataSource, &labelsSource, V(75,75,75));
 
     bs.run("test_result.h5");
+
+    checkCountAndMean(data, labels, "test_result.h5");
+}
+
+void testParallel() {
+    using namespace vigra;
+    typedef RegionFeatures<3, float, uint32_t>::V V;
+
+    MultiArray<3, float> data(V(90,100,110), 1.0);
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    {
+        HDF5File f("test_data_parallel.h5", HDF5File::Open);
+        f.write("data", data);
+    }
+
+    //regions spanning several blocks, and a label missing entirely
+    MultiArray<3, uint32_t> labels(data.shape());
+    labels.subarray(V(0,0,0), V(50,60,70))       = 1;
+    labels.subarray(V(40,70,30), V(90,100,110))  = 2;
+    labels.subarray(V(10,80,5), V(20,90,15))     = 4;
+    {
+        HDF5File f("test_labels_parallel.h5", HDF5File::Open);
+        f.write("labels", labels);
+    }
+
+    SourceHDF5<3, float> dataSource("test_data_parallel.h5", "data");
+    SourceHDF5<3, uint32_t> labelsSource("test_labels_parallel.h5", "labels");
+
+    RegionFeatures<3, float, uint32_t> bs(&dataSource, &labelsSource, V(32,32,32));
+    bs.setNumThreads(5);
+    bs.setHistogramRange(0.0f, 1.0f);
+    bs.run("test_result_parallel.h5");
+
+    checkCountAndMean(data, labels, "test_result_parallel.h5");
+}
+
+void testFeatureSelection() {
+    using namespace vigra;
+    typedef RegionFeatures<3, float, uint32_t> RF;
+    typedef RF::V V;
+
+    MultiArray<3, float> data(V(40,50,60), 1.0);
+    FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+    {
+        HDF5File f("test_data_selection.h5", HDF5File::Open);
+        f.write("data", data);
+    }
+    MultiArray<3, uint32_t> labels(data.shape());
+    labels.subarray(V(5,5,5), V(30,40,50)) = 1;
+    labels.subarray(V(35,0,0), V(40,50,60)) = 2;
+    {
+        HDF5File f("test_labels_selection.h5", HDF5File::Open);
+        f.write("labels", labels);
+    }
+
+    SourceHDF5<3, float> dataSource("test_data_selection.h5", "data");
+    SourceHDF5<3, uint32_t> labelsSource("test_labels_selection.h5", "labels");
+
+    RF bs(&dataSource, &labelsSource, V(16,16,16));
+
+    std::vector<std::string> unknown(1, "volume");
+    try {
+        bs.setFeatures(unknown);
+        failTest("unknown feature accepted");
+    }
+    catch(std::runtime_error&) {}
+    shouldEqual(bs.features().size(), RF::allFeatures().size());
+
+    std::vector<std::string> features;
+    features.push_back("count");
+    features.push_back("mean");
+    features.push_back("boundingBoxMin");
+    features.push_back("boundingBoxMax");
+    bs.setFeatures(features);
+    bs.setNumThreads(2);
+    bs.run("test_result_selection.h5");
+
+    checkCountAndMean(data, labels, "test_result_selection.h5");
+    HDF5File f("test_result_selection.h5", HDF5File::OpenReadOnly);
+    should(f.existsDataset("boundingBoxMin"));
+    should(f.existsDataset("boundingBoxMax"));
+    should(!f.existsDataset("variance"));
+    should(!f.existsDataset("histogram"));
+    should(!f.existsDataset("regionAxes"));
+}
+
+void checkCountAndMean(const vigra::MultiArray<3, float>& data,
+                       const vigra::MultiArray<3, uint32_t>& labels,
+                       const std::string& filename)
+{
+    using namespace vigra;
+
+    const uint32_t maxLabel = *std::max_element(labels.data(), labels.data()+labels.size());
+    std::vector<double> count(maxLabel+1, 0.0);
+    std::vector<double> sum(maxLabel+1, 0.0);
+    for(size_t i=0; i<labels.size(); ++i) {
+        count[labels.data()[i]] += 1.0;
+        sum[labels.data()[i]] += data.data()[i];
+    }
+
+    HDF5File f(filename, HDF5File::OpenReadOnly);
+    MultiArray<1, float> c, m;
+    f.readAndResize("count", c);
+    f.readAndResize("mean", m);
+    shouldEqual(c.size(), maxLabel+1);
+    for(uint32_t l=1; l<=maxLabel; ++l) {
+        shouldEqual(c(l), count[l]);
+        if(count[l] > 0) {
+            shouldEqualTolerance(m(l), sum[l]/count[l], 1e-4);
+        }
+    }
 }
 }; /* struct RegionFeaturesTest */
 
@@ -81,6 +196,8 @@ struct RegionFeaturesTestSuite : public vigra::test_suite {
         : vigra::test_suite("RegionFeaturesTestSuite")
     {
         add( testCase(&RegionFeaturesTest::test) );
+        add( testCase(&RegionFeaturesTest::testParallel) );
+        add( testCase(&RegionFeaturesTest::testFeatureSelection) );
     }
 };
 
@@ -0,0 +1,144 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#include <iostream>
+#include <cstdlib>
+
+#include <bw/runlabelling.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/labelimage.hxx>
+#include <vigra/labelvolume.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+struct RunLabellingTest {
+
+    /**
+     * random data with values in 0..'numValues'-1, where 'percentZero'
+     * percent of the pixels are 0
+     */
+    template<int N>
+    static void fillRandom(vigra::MultiArrayView<N, vigra::UInt8> a, int percentZero, int numValues) {
+        for(int i=0; i<a.size(); ++i) {
+            a[i] = (std::rand() % 100) < percentZero ? 0 : 1 + std::rand() % (numValues-1);
+        }
+    }
+
+    void test2D() {
+        using namespace vigra;
+        typedef MultiArrayShape<2>::type V;
+
+        //row lengths around multiples of 16
+        V shapes[5] = { V(1,1), V(15,7), V(16,9), V(33,20), V(100,41) };
+        int percentZero[3] = { 0, 40, 70 };
+        for(int s=0; s<5; ++s) {
+            for(int z=0; z<3; ++z) {
+                for(int numValues=2; numValues<=3; ++numValues) {
+                    MultiArray<2, UInt8> data(shapes[s]);
+                    fillRandom(data, percentZero[z], numValues);
+
+                    MultiArray<2, UInt32> expected(data.shape());
+                    UInt32 maxExpected = labelImageWithBackground(data, expected, false, (UInt8)0);
+                    MultiArray<2, UInt32> r(data.shape());
+                    UInt32 maxLabel = labelRuns(data, r);
+
+                    shouldEqual(maxLabel, maxExpected);
+                    shouldEqualSequence(r.begin(), r.end(), expected.begin());
+                }
+            }
+        }
+    }
+
+    void test3D() {
+        using namespace vigra;
+        typedef MultiArrayShape<3>::type V;
+
+        V shapes[3] = { V(17,5,3), V(40,30,20), V(64,10,12) };
+        int percentZero[3] = { 20, 50, 70 };
+        for(int s=0; s<3; ++s) {
+            for(int z=0; z<3; ++z) {
+                for(int numValues=2; numValues<=3; ++numValues) {
+                    MultiArray<3, UInt8> data(shapes[s]);
+                    fillRandom(data, percentZero[z], numValues);
+
+                    MultiArray<3, UInt32> expected(data.shape());
+                    UInt32 maxExpected = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+                    MultiArray<3, UInt32> r(data.shape());
+                    UInt32 maxLabel = labelRuns(data, r);
+
+                    shouldEqual(maxLabel, maxExpected);
+                    shouldEqualSequence(r.begin(), r.end(), expected.begin());
+                }
+            }
+        }
+    }
+
+    void testStrided() {
+        using namespace vigra;
+        typedef MultiArrayShape<3>::type V;
+
+        //neither the input nor the output rows are contiguous
+        MultiArray<3, UInt8> data(V(20,35,18));
+        fillRandom(data, 50, 2);
+        MultiArrayView<3, UInt8, StridedArrayTag> in = data.transpose();
+
+        MultiArray<3, UInt32> expected(in.shape());
+        UInt32 maxExpected = labelVolumeWithBackground(in, expected, NeighborCode3DSix(), (UInt8)0);
+
+        MultiArray<3, UInt32> out(data.shape());
+        UInt32 maxLabel = labelRuns(in, out.transpose());
+
+        shouldEqual(maxLabel, maxExpected);
+        MultiArray<3, UInt32> r(out.transpose());
+        shouldEqualSequence(r.begin(), r.end(), expected.begin());
+    }
+}; /* struct RunLabellingTest */
+
+struct RunLabellingTestSuite : public vigra::test_suite {
+    RunLabellingTestSuite()
+        : vigra::test_suite("RunLabellingTestSuite")
+    {
+        add( testCase(&RunLabellingTest::test2D) );
+        add( testCase(&RunLabellingTest::test3D) );
+        add( testCase(&RunLabellingTest::testStrided) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    RunLabellingTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -0,0 +1,167 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <iostream>
+
+#include <bw/sinkwritebehind.h>
+#include <bw/sourcehdf5.h>
+#include <bw/sinkhdf5.h>
+#include <bw/thresholding.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/hdf5impex.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+/**
+ * sink which fails when writing a given block, by throwing or (if not
+ * 'throws_') by returning false
+ */
+template<int N, class T>
+class SinkFailing : public Sink<N,T> {
+    public:
+    typedef typename Sink<N,T>::V V;
+
+    SinkFailing(V failAt, bool throws = true) : failAt_(failAt), throws_(throws), numWrites_(0) {}
+
+    virtual bool writeBlock(Roi<N> roi, const vigra::MultiArrayView<N,T>& block) {
+        ++numWrites_;
+        if(roi.p == failAt_) {
+            if(!throws_) { return false; }
+            throw std::runtime_error("write failed");
+        }
+        return true;
+    }
+
+    V failAt_;
+    bool throws_;
+    int numWrites_;
+};
+
+struct SinkWriteBehindTest {
+    typedef vigra::MultiArray<3, float> A;
+    typedef A::difference_type V;
+
+    void test() {
+        using namespace vigra;
+
+        MultiArray<3, float> data(V(24,33,40));
+        FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+        {
+            HDF5File f("test.h5", HDF5File::Open);
+            f.write("test", data);
+        }
+
+        SourceHDF5<3, float> source("test.h5", "test");
+        SinkHDF5<3, vigra::UInt8> sinkHDF5("thresh.h5", "thresh");
+        {
+            SinkWriteBehind<3, vigra::UInt8> sink(&sinkHDF5, 2);
+            sink.setBlockShape(V(10,10,10));
+
+            Thresholding<3, float> bs(&source, V(6,4,7));
+            bs.run(0.5, 0, 1, &sink);
+            sink.flush();
+
+            //shape and block shape are forwarded
+            shouldEqual(sinkHDF5.shape(), data.shape());
+            shouldEqual(sinkHDF5.blockShape(), V(10,10,10));
+        }
+
+        HDF5File f("thresh.h5", HDF5File::Open);
+        MultiArray<3, UInt8> r;
+        f.readAndResize("thresh", r);
+
+        MultiArray<3, UInt8> t(data.shape());
+        transformMultiArray(srcMultiArrayRange(data), destMultiArray(t), Threshold<float, UInt8>(-std::numeric_limits<float>::max(), 0.5, 1, 0));
+        shouldEqual(t.shape(), r.shape());
+        shouldEqualSequence(r.begin(), r.end(), t.begin());
+    }
+
+    void testError() {
+        for(int throws=0; throws<2; ++throws) {
+            checkError(throws == 1);
+        }
+    }
+
+    void checkError(bool throws) {
+        SinkFailing<3, float> failing(V(10,0,0), throws);
+        SinkWriteBehind<3, float> sink(&failing, 2);
+        sink.setShape(V(40,10,10));
+
+        bool thrown = false;
+        try {
+            for(int x=0; x<40; x+=10) {
+                A block(V(10,10,10));
+                sink.writeBlock(Roi<3>(V(x,0,0), V(x+10,10,10)), block);
+            }
+            sink.flush();
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        should(thrown);
+
+        //the failure is kept, later calls throw it again
+        for(int call=0; call<3; ++call) {
+            thrown = false;
+            try {
+                if(call == 0) {
+                    A block(V(10,10,10));
+                    sink.writeBlock(Roi<3>(V(0,0,0), V(10,10,10)), block);
+                }
+                else if(call == 1) { sink.flush(); }
+                else { sink.close(); }
+            }
+            catch(const std::runtime_error&) {
+                thrown = true;
+            }
+            should(thrown);
+        }
+    }
+};
+
+struct SinkWriteBehindTestSuite : public vigra::test_suite {
+    SinkWriteBehindTestSuite()
+        : vigra::test_suite("SinkWriteBehindTestSuite")
+    {
+        add( testCase(&SinkWriteBehindTest::test) );
+        add( testCase(&SinkWriteBehindTest::testError) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    SinkWriteBehindTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -0,0 +1,151 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+
+#include <iostream>
+#include <map>
+
+#include <bw/sizefilter.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+#include <vigra/labelvolume.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+struct SizeFilterTest {
+    typedef vigra::MultiArray<3, vigra::UInt8> A;
+    typedef A::difference_type V;
+
+    void testSizeFilter() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 30 ? 1 : 0;
+        }
+        MultiArray<3, UInt32> expected(data.shape());
+        UInt32 maxLabel = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+        std::vector<size_t> sizes(maxLabel+1);
+        for(int i=0; i<expected.size(); ++i) {
+            ++sizes[expected[i]];
+        }
+
+        SourceArray<3, UInt8> source(data);
+        for(int statistics=0; statistics<2; ++statistics) {
+            ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+            cc.setStatistics(statistics == 1);
+
+            SizeFilter<3, UInt32> filter(&cc, V(16,16,16));
+            filter.setNumThreads(3);
+
+            //the objects with 2 to 5 pixels
+            SinkArray<3, UInt32> labels;
+            filter.run(2, 5, &labels);
+            SinkArray<3, UInt8> mask;
+            filter.runMask(2, 5, &mask);
+            shouldEqual(labels.a_.shape(), data.shape());
+
+            std::map<UInt32, UInt32> newLabel;
+            UInt32 numObjects = 0;
+            for(int i=0; i<expected.size(); ++i) {
+                const size_t s = sizes[expected[i]];
+                const bool keep = expected[i] != 0 && s >= 2 && s <= 5;
+                shouldEqual(mask.a_[i], keep ? 1 : 0);
+                shouldEqual(labels.a_[i] != 0, keep);
+                if(!keep) { continue; }
+                //same object, same new label
+                if(newLabel.count(expected[i]) == 0) {
+                    newLabel[expected[i]] = labels.a_[i];
+                    ++numObjects;
+                }
+                shouldEqual(labels.a_[i], newLabel[expected[i]]);
+            }
+            shouldEqual(filter.numObjects(), numObjects);
+            should(numObjects > 0);
+            UInt32 maxNew = *std::max_element(labels.a_.begin(), labels.a_.end());
+            shouldEqual(maxNew, numObjects);
+        }
+    }
+
+    void testAfterUpdate() {
+        using namespace vigra;
+
+        A data(V(30,25,20));
+        for(int i=0; i<data.size(); ++i) {
+            data[i] = (std::rand() % 100) < 30 ? 1 : 0;
+        }
+        SourceArray<3, UInt8> source(data);
+        ConnectedComponents<3> cc(&source, V(10,8,7), 2);
+        cc.setIncremental(true);
+
+        SizeFilter<3, UInt32> filter(&cc, V(16,16,16));
+        SinkArray<3, UInt8> mask;
+        filter.runMask(1, 1000000, &mask);
+
+        //a slab cutting through many components changes labels and their number
+        data.subarray(V(0,0,9), V(30,25,11)) = 0;
+        cc.update(Roi<3>(V(0,0,9), V(30,25,11)));
+
+        MultiArray<3, UInt32> expected(data.shape());
+        UInt32 maxLabel = labelVolumeWithBackground(data, expected, NeighborCode3DSix(), (UInt8)0);
+        const std::vector<size_t>& s = filter.sizes();
+        shouldEqual(s.size(), (size_t)maxLabel+1);
+
+        std::vector<size_t> sizes(maxLabel+1);
+        for(int i=0; i<expected.size(); ++i) {
+            ++sizes[expected[i]];
+        }
+        filter.runMask(2, 5, &mask);
+        for(int i=0; i<expected.size(); ++i) {
+            const size_t n = sizes[expected[i]];
+            const bool keep = expected[i] != 0 && n >= 2 && n <= 5;
+            shouldEqual(mask.a_[i], keep ? 1 : 0);
+        }
+    }
+}; /* struct SizeFilterTest */
+
+struct SizeFilterTestSuite : public vigra::test_suite {
+    SizeFilterTestSuite()
+        : vigra::test_suite("SizeFilterTestSuite")
+    {
+        add( testCase(&SizeFilterTest::testSizeFilter) );
+        add( testCase(&SizeFilterTest::testAfterUpdate) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    SizeFilterTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
@@ -0,0 +1,148 @@
+/************************************************************************/
+/*                                                                      */
+/*    Copyright 2013 by Thorben Kroeger                                 */
+/*    thorben.kroeger@iwr.uni-heidelberg.de                             */
+/*                                                                      */
+/*    Permission is hereby granted, free of charge, to any person       */
+/*    obtaining a copy of this software and associated documentation    */
+/*    files (the "Software"), to deal in the Software without           */
+/*    restriction, including without limitation the rights to use,      */
+/*    copy, modify, merge, publish, distribute, sublicense, and/or      */
+/*    sell copies of the Software, and to permit persons to whom the    */
+/*    Software is furnished to do so, subject to the following          */
+/*    conditions:                                                       */
+/*                                                                      */
+/*    The above copyright notice and this permission notice shall be    */
+/*    included in all copies or substantial portions of the             */
+/*    Software.                                                         */
+/*                                                                      */
+/*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND    */
+/*    EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES   */
+/*    OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND          */
+/*    NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT       */
+/*    HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,      */
+/*    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      */
+/*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR     */
+/*    OTHER DEALINGS IN THE SOFTWARE.                                   */
+/*                                                                      */
+/************************************************************************/
+
+#include <iostream>
+#include <boost/thread.hpp>
+
+#include <bw/sourceprefetching.h>
+
+#include "test_utils.h"
+
+#include <vigra/unittest.hxx>
+
+#include <bw/extern_templates.h>
+
+using namespace BW;
+
+struct SourcePrefetchingTest {
+    typedef vigra::MultiArray<3, float> A;
+    typedef A::difference_type V;
+
+    void testInOrder() {
+        A data(V(24,33,40));
+        FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+
+        SourceArray<3, float> source(data);
+        Blocking<3> blocking(Roi<3>(V(), data.shape()), V(6,4,7), V());
+        SourcePrefetching<3, float> prefetching(&source, blocking, 3);
+        shouldEqual(prefetching.shape(), data.shape());
+
+        Blocking<3>::Pair p;
+        BOOST_FOREACH(p, blocking) {
+            A block(p.second.shape());
+            prefetching.readBlock(p.second, block);
+            A ref(data.subarray(p.second.p, p.second.q));
+            shouldEqualSequence(block.begin(), block.end(), ref.begin());
+        }
+        //every block has been read exactly once
+        shouldEqual(source.numReads_, (int)blocking.numBlocks());
+
+        //blocks outside of the blocking are read synchronously
+        A block(V(5,5,5));
+        prefetching.readBlock(Roi<3>(V(1,2,3), V(6,7,8)), block);
+        A ref(data.subarray(V(1,2,3), V(6,7,8)));
+        shouldEqualSequence(block.begin(), block.end(), ref.begin());
+    }
+
+    void testOutOfOrder() {
+        A data(V(24,33,40));
+        FillRandom<float, float*>::fillRandom(data.data(), data.data()+data.size());
+        SourceArray<3, float> source(data);
+
+        //skip blocks and read backwards
+        Blocking<3> blocking(Roi<3>(V(), data.shape()), V(6,4,7), V());
+        SourcePrefetching<3, float> prefetching(&source, blocking, 2);
+        for(int i=0; i<(int)blocking.numBlocks(); i += (i%2 == 0 ? 3 : -1)) {
+            const Roi<3> roi = blocking.block(i).second;
+            A block(roi.shape());
+            prefetching.readBlock(roi, block);
+            A ref(data.subarray(roi.p, roi.q));
+            shouldEqualSequence(block.begin(), block.end(), ref.begin());
+        }
+    }
+
+    void testError() {
+        A data(V(20,20,20));
+        SourceArray<3, float> source(data);
+        source.failAt_ = V(10,0,0);
+        Blocking<3> blocking(Roi<3>(V(), data.shape()), V(10,10,10), V());
+        SourcePrefetching<3, float> prefetching(&source, blocking, 8);
+
+        bool thrown = false;
+        try {
+            Blocking<3>::Pair p;
+            BOOST_FOREACH(p, blocking) {
+                A block(p.second.shape());
+                prefetching.readBlock(p.second, block);
+            }
+        }
+        catch(const std::runtime_error&) {
+            thrown = true;
+        }
+        should(thrown);
+    }
+
+    void testReadFalse() {
+        A data(V(20,20,20));
+        SourceArray<3, float> source(data);
+        source.failAt_ = V(10,0,0);
+        source.failThrows_ = false;
+        Blocking<3> blocking(Roi<3>(V(), data.shape()), V(10,10,10), V());
+        SourcePrefetching<3, float> prefetching(&source, blocking, 8);
+
+        //only the failing block returns false, even if it was prefetched
+        //(the first read starts the prefetching)
+        for(size_t i=0; i<blocking.numBlocks(); ++i) {
+            const Roi<3> roi = blocking.block(i).second;
+            A block(roi.shape());
+            shouldEqual(prefetching.readBlock(roi, block), roi.p != source.failAt_);
+            if(i == 0) {
+                boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+            }
+        }
+    }
+};
+
+struct SourcePrefetchingTestSuite : public vigra::test_suite {
+    SourcePrefetchingTestSuite()
+        : vigra::test_suite("SourcePrefetchingTestSuite")
+    {
+        add( testCase(&SourcePrefetchingTest::testInOrder) );
+        add( testCase(&SourcePrefetchingTest::testOutOfOrder) );
+        add( testCase(&SourcePrefetchingTest::testError) );
+        add( testCase(&SourcePrefetchingTest::testReadFalse) );
+    }
+};
+
+int main(int argc, char ** argv) {
+    SourcePrefetchingTestSuite test;
+    int failed = test.run(vigra::testsToBeExecuted(argc, argv));
+    std::cout << test.report() << std::endl;
+    return (failed != 0);
+}
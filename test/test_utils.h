@@ -30,7 +30,17 @@
 #ifndef TEST_UTILS_H
 #define TEST_UTILS_H
 
+#include <stdexcept>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
 #include <vigra/random.hxx>
+#include <vigra/multi_array.hxx>
+
+#include <bw/roi.h>
+#include <bw/source.h>
+#include <bw/sink.h>
 
 template<class Array>
 bool arraysEqual(const Array& a, const Array& b) {
@@ -169,5 +179,67 @@ struct FillRandom<double, Iter> {
     }
 };
 
+/**
+ * Source reading from an array in memory, counting the reads
+ * (reads may happen concurrently) and failing when reading the block
+ * starting at 'failAt_' (if set): by throwing, or by returning false
+ * unless 'failThrows_'
+ */
+template<int N, class T>
+class SourceArray : public BW::Source<N,T> {
+    public:
+    typedef typename BW::Source<N,T>::V V;
+
+    SourceArray(const vigra::MultiArrayView<N,T>& a) : a_(a), numReads_(0), failAt_(V(-1)), failThrows_(true) {}
+
+    virtual V shape() const { return a_.shape(); }
+
+    virtual bool readBlock(BW::Roi<N> roi, vigra::MultiArrayView<N,T>& block) const {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            ++numReads_;
+        }
+        if(roi.p == failAt_) {
+            if(!failThrows_) { return false; }
+            throw std::runtime_error("read failed");
+        }
+        block.copy(a_.subarray(roi.p, roi.q));
+        return true;
+    }
+
+    vigra::MultiArrayView<N,T> a_;
+    mutable int numReads_;
+    V failAt_;
+    bool failThrows_;
+    mutable boost::mutex mutex_;
+};
+
+/**
+ * Sink writing to an array in memory, counting how often each pixel
+ * was written
+ */
+template<int N, class T>
+class SinkArray : public BW::Sink<N,T> {
+    public:
+    typedef typename BW::Sink<N,T>::V V;
+
+    virtual void setShape(V shape) {
+        BW::Sink<N,T>::setShape(shape);
+        a_.reshape(shape);
+        count_.reshape(shape);
+    }
+
+    virtual bool writeBlock(BW::Roi<N> roi, const vigra::MultiArrayView<N,T>& block) {
+        a_.subarray(roi.p, roi.q) = block;
+        vigra::MultiArrayView<N,int> c = count_.subarray(roi.p, roi.q);
+        for(typename vigra::MultiArrayView<N,int>::iterator it = c.begin(); it != c.end(); ++it) {
+            ++(*it);
+        }
+        return true;
+    }
+
+    vigra::MultiArray<N,T> a_;
+    vigra::MultiArray<N,int> count_;
+};
 
 #endif /* TEST_UTILS_H */